@@ -0,0 +1,156 @@
+/*
+ *
+ *   Copyright (C) 2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+// micro-benchmark of UgetA2cf bitfield scanning
+
+#include <stdio.h>
+#include <stdint.h>
+#include <UgUtil.h>
+#include <UgetA2cf.h>
+
+#define FILE_SIZE    ((uint64_t) 100 * 1024 * 1024 * 1024)    // 100 GiB
+#define N_LOOPS      2000
+
+static void  print_time (const char* name, uint64_t time_beg, int n_loops)
+{
+	uint64_t  time_end;
+
+	time_end = ug_get_time_count ();
+	printf ("%-24s %6u ms, %8.3f us/call\n", name,
+	        (unsigned) (time_end - time_beg),
+	        (double) (time_end - time_beg) * 1000.0 / n_loops);
+}
+
+// fill the file by 16 KiB blocks like a segment does
+static void  bench_fill (UgetA2cf* a2cf)
+{
+	uint64_t  time_beg;
+	uint64_t  pos, end;
+	int       count;
+
+	time_beg = ug_get_time_count ();
+	for (count = 0, pos = 0;  pos < FILE_SIZE;  pos = end, count++) {
+		end = pos + 16384 * 3;
+		if (end > FILE_SIZE)
+			end = FILE_SIZE;
+		uget_a2cf_fill (a2cf, pos, end);
+	}
+	print_time ("uget_a2cf_fill()", time_beg, count);
+}
+
+// all pieces are completed except the last block of file
+static void  bench_lack (UgetA2cf* a2cf)
+{
+	uint64_t  time_beg;
+	uint64_t  beg, end;
+	int       count;
+
+	time_beg = ug_get_time_count ();
+	for (count = 0;  count < N_LOOPS;  count++) {
+		beg = 0;
+		if (uget_a2cf_lack (a2cf, &beg, &end) == FALSE || end != FILE_SIZE) {
+			printf ("uget_a2cf_lack() failed\n");
+			break;
+		}
+	}
+	print_time ("uget_a2cf_lack()", time_beg, N_LOOPS);
+}
+
+static void  bench_completed (UgetA2cf* a2cf)
+{
+	uint64_t  time_beg;
+	uint64_t  completed = 0;
+	int       count;
+
+	time_beg = ug_get_time_count ();
+	for (count = 0;  count < N_LOOPS;  count++)
+		completed = uget_a2cf_completed (a2cf);
+	print_time ("uget_a2cf_completed()", time_beg, N_LOOPS);
+	if (completed != FILE_SIZE - 16384)
+		printf ("uget_a2cf_completed() failed\n");
+}
+
+// a file that was interrupted many times has a lot of in-flight pieces.
+// fill the first block of every piece, then fill the rest of pieces.
+static void  bench_pieces (void)
+{
+	UgetA2cf  a2cf;
+	uint64_t  time_beg;
+	uint64_t  pos;
+	uint64_t  beg, end;
+	int       count;
+
+	uget_a2cf_init (&a2cf, FILE_SIZE);
+	for (pos = 0;  pos < FILE_SIZE;  pos += a2cf.piece_len)
+		uget_a2cf_fill (&a2cf, pos, pos + 16384);
+	printf ("%u in-flight pieces\n", (unsigned) a2cf.piece.array.length);
+
+	time_beg = ug_get_time_count ();
+	for (count = 0;  count < N_LOOPS;  count++) {
+		beg = (uint64_t) count * 997 * a2cf.piece_len % FILE_SIZE;
+		uget_a2cf_lack (&a2cf, &beg, &end);
+	}
+	print_time ("uget_a2cf_lack()", time_beg, N_LOOPS);
+
+	time_beg = ug_get_time_count ();
+	for (count = 0, pos = 16384;  pos < FILE_SIZE;  pos += a2cf.piece_len, count++)
+		uget_a2cf_fill (&a2cf, pos, pos + a2cf.piece_len - 16384);
+	print_time ("uget_a2cf_fill()", time_beg, count);
+
+	uget_a2cf_clear (&a2cf);
+}
+
+int  main (void)
+{
+	UgetA2cf  a2cf;
+
+	uget_a2cf_init (&a2cf, FILE_SIZE);
+	printf ("file size %u GiB, piece length %u KiB, %u pieces\n",
+	        (unsigned) (FILE_SIZE >> 30),
+	        (unsigned) (a2cf.piece_len >> 10),
+	        (unsigned) a2cf.piece.index_end);
+
+	bench_fill (&a2cf);
+	// leave the last block
+	uget_a2cf_erase (&a2cf, FILE_SIZE - 16384, FILE_SIZE);
+	bench_lack (&a2cf);
+	bench_completed (&a2cf);
+
+	uget_a2cf_clear (&a2cf);
+
+	bench_pieces ();
+	return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ *
+ *   Copyright (C) 2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+// benchmark of UgetPluginCurl output mode: pwrite(), io_uring, write-behind,
+// O_DIRECT and memory-mapped file.
+// All downloads preallocate file, so only the way of writing data differs.
+// Files written by other modes are compared with the file written by pwrite().
+// usage: test-output URL [folder] [connections]
+// Run a local HTTP server that support Range, e.g. nginx or lighttpd.
+// "python3 -m http.server" ignore Range, it can't test split download.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <UgUtil.h>
+#include <UgString.h>
+#include <UgStdio.h>
+#include <UgetData.h>
+#include <UgetEvent.h>
+#include <UgetPluginCurl.h>
+
+#if defined _WIN32 || defined _WIN64
+#include <windows.h>
+#define  ug_sleep                 Sleep
+#else
+#include <unistd.h>               // usleep()
+#define  ug_sleep(millisecond)    usleep (millisecond * 1000)
+#endif // _WIN32 || _WIN64
+
+#define N_LOOPS      3
+#define BUFFER_SIZE  (64 * 1024)
+
+// file that was written by the first (pwrite) download
+static char*  reference = NULL;
+
+// return TRUE if both files have the same size and data.
+static int  compare_file (const char* path1, const char* path2)
+{
+	static char  buf1[BUFFER_SIZE];
+	static char  buf2[BUFFER_SIZE];
+	int   fd1, fd2;
+	int   n1, n2;
+	int   same = FALSE;
+
+	fd1 = ug_open (path1, UG_O_RDONLY | UG_O_BINARY, 0);
+	fd2 = ug_open (path2, UG_O_RDONLY | UG_O_BINARY, 0);
+	if (fd1 != -1 && fd2 != -1) {
+		for (;;) {
+			n1 = ug_read (fd1, buf1, BUFFER_SIZE);
+			n2 = ug_read (fd2, buf2, BUFFER_SIZE);
+			if (n1 != n2 || n1 < 0 || memcmp (buf1, buf2, n1) != 0)
+				break;
+			if (n1 == 0) {
+				same = TRUE;
+				break;
+			}
+		}
+	}
+	if (fd1 != -1)
+		ug_close (fd1);
+	if (fd2 != -1)
+		ug_close (fd2);
+	return same;
+}
+
+// return elapsed time (milliseconds), 0 if download failed.
+static uint64_t  download (const char* uri, const char* folder,
+                           int n_connections, int output)
+{
+	UgInfo*       info;
+	UgetCommon*   common;
+	UgetProgress* progress;
+	UgetPlugin*   plugin;
+	UgetEvent*    cur;
+	UgetEvent*    next;
+	uint64_t      time_beg;
+	int           failed = FALSE;
+	char*         path;
+
+	info = ug_info_new (8, 0);
+	common = ug_info_realloc (info, UgetCommonInfo);
+	common->uri = ug_strdup (uri);
+	common->folder = ug_strdup (folder);
+	common->file = ug_strdup ("test-output.bin");
+	common->max_connections = n_connections;
+	common->debug_level = 0;
+	common->preallocate = UGET_PREALLOCATE_FULL;
+	common->output = output;
+	path = ug_strdup_printf ("%s/%s", folder, common->file);
+	ug_unlink (path);
+
+	time_beg = ug_get_time_count ();
+	plugin = uget_plugin_new (UgetPluginCurlInfo);
+	uget_plugin_accept (plugin, info);
+	if (uget_plugin_start (plugin) == FALSE)
+		failed = TRUE;
+	while (failed == FALSE && uget_plugin_sync (plugin, info)) {
+		ug_sleep (50);
+		for (cur = uget_plugin_pop (plugin);  cur;  cur = next) {
+			next = cur->next;
+			if (cur->type == UGET_EVENT_ERROR)
+				failed = TRUE;
+			uget_event_free (cur);
+		}
+	}
+	uget_plugin_unref (plugin);
+	time_beg = ug_get_time_count () - time_beg;
+
+	progress = ug_info_get (info, UgetProgressInfo);
+	if (progress == NULL || progress->total == 0 ||
+	    progress->complete != progress->total)
+		failed = TRUE;
+	// keep the first file, check data that written by other modes.
+	if (failed == FALSE) {
+		if (reference == NULL) {
+			reference = ug_strdup_printf ("%s/%s", folder, "test-output.ref");
+			ug_unlink (reference);
+			if (ug_rename (path, reference) != 0) {
+				ug_free (reference);
+				reference = NULL;
+				failed = TRUE;
+			}
+		}
+		else if (compare_file (path, reference) == FALSE) {
+			printf ("data of %s is different from %s\n", path, reference);
+			failed = TRUE;
+		}
+	}
+	ug_unlink (path);
+	ug_free (path);
+	ug_info_unref (info);
+	return (failed) ? 0 : time_beg;
+}
+
+// common_output: UgetOutput, it override plug-in output mode.
+static void  bench (const char* name, int output, int common_output,
+                    const char* uri, const char* folder, int n_connections)
+{
+	uint64_t  elapsed;
+	uint64_t  best = 0;
+	int       count;
+
+	uget_plugin_global_set (UgetPluginCurlInfo, UGET_PLUGIN_CURL_GLOBAL_OUTPUT,
+	                        (void*)(intptr_t) output);
+	for (count = 0;  count < N_LOOPS;  count++) {
+		elapsed = download (uri, folder, n_connections, common_output);
+		if (elapsed == 0) {
+			printf ("%-12s download failed\n", name);
+			return;
+		}
+		if (best == 0 || best > elapsed)
+			best = elapsed;
+	}
+	printf ("%-12s best of %d: %6u ms\n", name, N_LOOPS, (unsigned) best);
+}
+
+int  main (int argc, char* argv[])
+{
+	const char*  folder = "/tmp";
+	int          n_connections = 4;
+	UgetWriterStats  stats;
+
+	if (argc < 2) {
+		puts ("usage: test-output URL [folder] [connections]");
+		return 1;
+	}
+	if (argc > 2)
+		folder = argv[2];
+	if (argc > 3)
+		n_connections = atoi (argv[3]);
+
+	uget_plugin_global_set (UgetPluginCurlInfo, UGET_PLUGIN_GLOBAL_INIT, (void*) TRUE);
+	bench ("pwrite", UGET_PLUGIN_CURL_OUTPUT_PWRITE, UGET_OUTPUT_DEFAULT,
+	       argv[1], folder, n_connections);
+	bench ("io_uring", UGET_PLUGIN_CURL_OUTPUT_IO_URING, UGET_OUTPUT_DEFAULT,
+	       argv[1], folder, n_connections);
+	bench ("write-behind", UGET_PLUGIN_CURL_OUTPUT_WRITE_BEHIND, UGET_OUTPUT_DEFAULT,
+	       argv[1], folder, n_connections);
+	bench ("O_DIRECT", UGET_PLUGIN_CURL_OUTPUT_DIRECT, UGET_OUTPUT_DEFAULT,
+	       argv[1], folder, n_connections);
+	bench ("mmap", UGET_PLUGIN_CURL_OUTPUT_PWRITE, UGET_OUTPUT_MMAP,
+	       argv[1], folder, n_connections);
+	uget_plugin_global_get (UgetPluginCurlInfo,
+	                        UGET_PLUGIN_CURL_GLOBAL_WRITER_STATS, &stats);
+	printf ("write-behind pool: %d buffers, peak %d, waited %u times, "
+	        "%u writes\n", stats.n_buffers, stats.n_peak,
+	        (unsigned) stats.n_waits, (unsigned) stats.n_writes);
+	uget_plugin_global_set (UgetPluginCurlInfo, UGET_PLUGIN_GLOBAL_INIT, (void*) FALSE);
+	if (reference) {
+		ug_unlink (reference);
+		ug_free (reference);
+	}
+	return 0;
+}
@@ -274,6 +274,7 @@ void print_bitfield (uint8_t* bytes, int length)
 void print_a2cf (UgetA2cf* a2cf)
 {
 	UgetA2cfPiece* piece;
+	int            index;
 
 	if (a2cf == NULL)
 		return;
@@ -292,8 +293,9 @@ void print_a2cf (UgetA2cf* a2cf)
 		print_bitfield (a2cf->bitfield, a2cf->bitfield_len);
 	}
 
-	printf ("n_pieces : %d\n", (int)a2cf->piece.list.size);
-	for (piece = (void*)a2cf->piece.list.head;  piece;  piece = piece->next) {
+	printf ("n_pieces : %d\n", (int)a2cf->piece.array.length);
+	for (index = 0;  index < a2cf->piece.array.length;  index++) {
+		piece = a2cf->piece.array.at[index];
 		printf ("index : %d\n", (int)piece->index);
 		printf ("length : %d\n", (int)piece->length);
 		printf ("bitfield_length : %d\n", (int)piece->bitfield_len);
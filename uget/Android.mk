@@ -17,6 +17,12 @@ LOCAL_SRC_FILES  := \
 	UgetNode-compare.c  \
 	UgetNode-filter.c   \
 	UgetTask.c    \
+	UgetBucket.c  \
+	UgetRate.c    \
+	UgetHost.c    \
+	UgetUring.c   \
+	UgetWriter.c  \
+	UgetChecksum.c  \
 	UgetHash.c    \
 	UgetSite.c    \
 	UgetApp.c     \
@@ -40,6 +40,11 @@
 #include <UgStdio.h>
 #include <UgetA2cf.h>
 
+#if !(defined _WIN32 || defined _WIN64)
+#define A2CF_MMAP    1
+#include <sys/mman.h>
+#endif
+
 #define INFO_HASH_LEN_MAX    8192
 
 enum {
@@ -132,9 +137,11 @@ uint64_t uint64_to_be (uint64_t value)
 
 static int   find_bit0 (uint8_t* bytes_beg, uint32_t bytes_len, uint32_t* beg_bit);
 static int   find_bit1 (uint8_t* bytes_beg, uint32_t bytes_len, uint32_t* beg_bit);
+static uint32_t  count_bits (uint8_t* bytes, uint32_t n_bits);
 static void  fill_bits (uint8_t* bytes, uint32_t nth_bit, uint32_t n_bits);
 static int   test_bit (uint8_t* bytes, uint32_t nth_bit);
 static void  set_bit (uint8_t* bytes, uint32_t nth_bit);
+static void  clear_bit (uint8_t* bytes, uint32_t nth_bit);
 
 // ----------------------------------------------------------------------------
 
@@ -199,31 +206,29 @@ static void a2cf_piece_truncate (UgetA2cfPiece* piece, uint32_t length)
 
 static int  a2cf_piece_filled (UgetA2cfPiece* piece)
 {
-	uint8_t  mask;
-	uint8_t* bytes, *bytes_end;
-	uint32_t n_bits;
-
-	bytes = piece->bitfield;
-	bytes_end = bytes + piece->bitfield_len;
-//	n_bits = (piece->length / 16384) % 8;
-	n_bits = (piece->length >> 14) & 7;
-//	if (piece->length & 16384-1) {
-	if (piece->length & 16383) {
-		if (n_bits == 7)
-			n_bits = 0;
-		else
-			bytes_end--;
-	}
+	uint64_t  word;
+	uint32_t  bit_limit;
+	uint32_t  pos, bytes_len;
+	uint8_t   mask;
 
-	for (;  bytes < bytes_end;  bytes++) {
-		if (bytes[0] != 0xFF)
+//	bit_limit = (piece->length / 16384) + ((piece->length % 16384) ? 1 : 0);
+	bit_limit = (piece->length >> 14) + ((piece->length & 16383) ? 1 : 0);
+	bytes_len = bit_limit >> 3;
+
+	for (pos = 0;  bytes_len - pos >= 8;  pos += 8) {
+		memcpy (&word, piece->bitfield + pos, 8);
+		if (word != UINT64_MAX)
 			return FALSE;
 	}
-
-	for (mask = 0x80;  n_bits > 0;  n_bits--, mask >>= 1) {
-		if (bytes[0] & mask)
-			continue;
-		return FALSE;
+	for (;  pos < bytes_len;  pos++) {
+		if (piece->bitfield[pos] != 0xFF)
+			return FALSE;
+	}
+	// bits in the last byte
+	if (bit_limit & 7) {
+		mask = (uint8_t) (0xFF << (8 - (bit_limit & 7)));
+		if ((piece->bitfield[pos] & mask) != mask)
+			return FALSE;
 	}
 	return TRUE;
 }
@@ -260,32 +265,45 @@ static int  a2cf_piece_lack (UgetA2cfPiece* piece, uint32_t* beg, uint32_t* end)
 
 static uint64_t  a2cf_piece_completed (UgetA2cfPiece* piece)
 {
-	uint32_t  bit_beg;
 	uint32_t  bit_limit;
 	uint32_t  last_bit_len;
 	uint64_t  completed;
 
 //	bit_limit = (piece->length / 16384) + ((piece->length % 16384) ? 1 : 0);
 	bit_limit = (piece->length >> 14) + ((piece->length & 16383) ? 1 : 0);
-	bit_beg = 0;
-	completed = 0;
+	completed = (uint64_t) count_bits (piece->bitfield, bit_limit) << 14;
 
-	while (find_bit1 (piece->bitfield, piece->bitfield_len, &bit_beg)) {
-		if (bit_beg >= bit_limit)
-			break;
-		if (bit_beg == bit_limit - 1) {
-			last_bit_len = piece->length & 16383;
-			if (last_bit_len) {
-				completed += last_bit_len;
-				break;
-			}
-		}
-		completed += 16384;
-		bit_beg++;
-	}
+	// the last block may be shorter than 16 KiB
+	last_bit_len = piece->length & 16383;
+	if (last_bit_len && test_bit (piece->bitfield, bit_limit - 1))
+		completed -= 16384 - last_bit_len;
 	return completed;
 }
 
+// compare UgetA2cfPiece* in UgetA2cf::piece.array with piece index.
+// It is used by ug_array_find_sorted()
+static int  a2cf_piece_compare (const void* piece, const void* index)
+{
+	uint32_t  index1 = (*(UgetA2cfPiece**)piece)->index;
+	uint32_t  index2 = *(uint32_t*)index;
+
+	if (index1 > index2)
+		return 1;
+	if (index1 < index2)
+		return -1;
+	return 0;
+}
+
+// return position of the first piece that it's index >= piece_index
+static int  a2cf_piece_position (UgetA2cf* a2cf, uint32_t piece_index)
+{
+	int  position;
+
+	ug_array_find_sorted (&a2cf->piece.array, &piece_index,
+	                      a2cf_piece_compare, &position);
+	return position;
+}
+
 // ----------------------------------------------------------------------------
 
 static const uint64_t size_piece[14] = {
@@ -336,11 +354,12 @@ void  uget_a2cf_init (UgetA2cf* a2cf, uint64_t size)
 //	a2cf->piece.index_end += (uint32_t) (size % a2cf->piece_len) ? 1 : 0;
 	a2cf->piece.index_end  = (uint32_t) (size >> (3+14+index));
 	a2cf->piece.index_end += (uint32_t) (size & (a2cf->piece_len-1)) ? 1 : 0;
-	ug_list_init (&a2cf->piece.list);
+	ug_array_init (&a2cf->piece.array, sizeof (UgetA2cfPiece*), 0);
 }
 
 void  uget_a2cf_clear (UgetA2cf* a2cf)
 {
+	uget_a2cf_unmap (a2cf);
 	ug_free (a2cf->info_hash);
 	ug_free (a2cf->bitfield);
 	a2cf->info_hash = NULL;
@@ -348,8 +367,8 @@ void  uget_a2cf_clear (UgetA2cf* a2cf)
 	a2cf->info_hash_len = 0;
 	a2cf->bitfield_len = 0;
 	// piece
-	ug_list_foreach (&a2cf->piece.list, (UgForeachFunc) ug_free, NULL);
-	ug_list_clear (&a2cf->piece.list, FALSE);
+	ug_array_foreach_ptr (&a2cf->piece.array, (UgForeachFunc) ug_free, NULL);
+	ug_array_clear (&a2cf->piece.array);
 }
 
 int  uget_a2cf_load (UgetA2cf* a2cf, const char* filename)
@@ -361,6 +380,7 @@ int  uget_a2cf_load (UgetA2cf* a2cf, const char* filename)
 	uint32_t bitfield_len;
 
 	init_endian_type ();
+	a2cf->map.addr = NULL;
 
 	file = ug_fopen (filename, "rb");
 	if (file == NULL)
@@ -421,13 +441,17 @@ int  uget_a2cf_load (UgetA2cf* a2cf, const char* filename)
 			( (a2cf->total_len % a2cf->piece_len) ? 1 : 0 );
 
 	// load in-flight pieces
+	ug_array_init (&a2cf->piece.array, sizeof (UgetA2cfPiece*), 0);
 	for (index = 0;  index < n_pieces;  index++) {
 		piece = a2cf_piece_new (a2cf->piece_len);
-		if (a2cf_piece_read (piece, file) == FALSE) {
+		if (a2cf_piece_read (piece, file) == FALSE ||
+		    piece->index >= a2cf->piece.index_end ||
+		    uget_a2cf_find (a2cf, piece->index))
+		{
 			ug_free (piece);
 			break;
 		}
-		ug_list_append (&a2cf->piece.list, (UgLink*) piece);
+		uget_a2cf_insert (a2cf, piece);
 	}
 
 	fclose (file);
@@ -440,9 +464,9 @@ failed:
 
 int   uget_a2cf_save (UgetA2cf* a2cf, const char* filename)
 {
-	UgetA2cfPiece*  piece;
 	FILE*    file;
 	uint32_t n_pieces;
+	int      index;
 	union {
 		union un_int16  value16;
 		union un_int32  value32;
@@ -480,12 +504,12 @@ int   uget_a2cf_save (UgetA2cf* a2cf, const char* filename)
 	if (a2cf->bitfield_len)
 		ug_fwrite (file, a2cf->bitfield, a2cf->bitfield_len);
 
-	n_pieces = a2cf->piece.list.size;
+	n_pieces = a2cf->piece.array.length;
 	temp.value32.integer = uint32_to_be (n_pieces);
 	ug_fwrite (file, temp.value32.bytes, 4);
 
-	for (piece = (void*)a2cf->piece.list.head;  piece;  piece = piece->next)
-		a2cf_piece_write (piece, file);
+	for (index = 0;  index < a2cf->piece.array.length;  index++)
+		a2cf_piece_write (a2cf->piece.array.at[index], file);
 
 #ifndef __ANDROID__
 //	ug_ftruncate (file, ug_ftell (file));  // for updating existing file.
@@ -494,12 +518,161 @@ int   uget_a2cf_save (UgetA2cf* a2cf, const char* filename)
 	return TRUE;
 }
 
+// ----------------------------------------------------------------------------
+// memory-mapped control file
+
+#ifdef A2CF_MMAP
+// offset of bitfield in control file
+#define A2CF_BITFIELD_OFFSET(a2cf)  (2 + 4 + 4 + (a2cf)->info_hash_len + 4 + 8 + 8 + 4)
+
+// size of control file
+static size_t  a2cf_file_size (UgetA2cf* a2cf)
+{
+	size_t  size;
+	int     index;
+
+	size = A2CF_BITFIELD_OFFSET (a2cf) + a2cf->bitfield_len + 4;
+	for (index = 0;  index < a2cf->piece.array.length;  index++)
+		size += 12 + a2cf->piece.array.at[index]->bitfield_len;
+	return size;
+}
+
+// copy changed bytes only, unchanged pages of mapped file don't become dirty.
+static void  a2cf_map_copy (UgetA2cf* a2cf, size_t offset, const void* data, size_t length)
+{
+	uint8_t*  dest;
+	size_t    count;
+
+	dest = a2cf->map.addr + offset;
+	for (;  length > 0;  length -= count) {
+		count = (length > 64) ? 64 : length;
+		if (memcmp (dest, data, count) != 0)
+			memcpy (dest, data, count);
+		dest += count;
+		data = (const uint8_t*) data + count;
+	}
+}
+
+static void  a2cf_map_copy32 (UgetA2cf* a2cf, size_t offset, uint32_t value)
+{
+	union un_int32  value32;
+
+	value32.integer = uint32_to_be (value);
+	a2cf_map_copy (a2cf, offset, value32.bytes, 4);
+}
+
+// resize file and map it again. Data after in-flight pieces is ignored by
+// uget_a2cf_load() and aria2, so file is never shrunk.
+static int  a2cf_map_resize (UgetA2cf* a2cf, size_t size)
+{
+	struct stat  st;
+
+	if (a2cf->map.addr) {
+		munmap (a2cf->map.addr, a2cf->map.size);
+		a2cf->map.addr = NULL;
+	}
+	if (fstat (a2cf->map.fd, &st) == -1)
+		return FALSE;
+	if ((size_t) st.st_size < size) {
+		if (ug_truncate (a2cf->map.fd, size) == -1)
+			return FALSE;
+	}
+	else
+		size = (size_t) st.st_size;
+
+	a2cf->map.addr = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	                       a2cf->map.fd, 0);
+	if (a2cf->map.addr == MAP_FAILED) {
+		a2cf->map.addr = NULL;
+		return FALSE;
+	}
+	a2cf->map.size = size;
+	return TRUE;
+}
+#endif  // A2CF_MMAP
+
+int   uget_a2cf_map (UgetA2cf* a2cf, const char* filename)
+{
+#ifdef A2CF_MMAP
+	uget_a2cf_unmap (a2cf);
+	// write header and current state
+	if (uget_a2cf_save (a2cf, filename) == FALSE)
+		return FALSE;
+	a2cf->map.fd = ug_open (filename, UG_O_RDWR | UG_O_BINARY, 0);
+	if (a2cf->map.fd == -1)
+		return FALSE;
+	if (a2cf_map_resize (a2cf, a2cf_file_size (a2cf)) == FALSE) {
+		ug_close (a2cf->map.fd);
+		return FALSE;
+	}
+	return TRUE;
+#else
+	return FALSE;
+#endif  // A2CF_MMAP
+}
+
+int   uget_a2cf_sync (UgetA2cf* a2cf)
+{
+#ifdef A2CF_MMAP
+	UgetA2cfPiece*  piece;
+	size_t          offset;
+	size_t          size;
+	int             index;
+
+	if (a2cf->map.addr == NULL)
+		return FALSE;
+	// in-flight pieces need more space. Reserve more to avoid remapping often.
+	size = a2cf_file_size (a2cf);
+	if (size > a2cf->map.size) {
+		if (a2cf_map_resize (a2cf, size + size / 4) == FALSE) {
+			ug_close (a2cf->map.fd);
+			a2cf->map.size = 0;
+			return FALSE;
+		}
+	}
+
+	offset = A2CF_BITFIELD_OFFSET (a2cf);
+	a2cf_map_copy (a2cf, offset, a2cf->bitfield, a2cf->bitfield_len);
+	offset += a2cf->bitfield_len;
+	// in-flight pieces
+	a2cf_map_copy32 (a2cf, offset, a2cf->piece.array.length);
+	offset += 4;
+	for (index = 0;  index < a2cf->piece.array.length;  index++) {
+		piece = a2cf->piece.array.at[index];
+		a2cf_map_copy32 (a2cf, offset + 0, piece->index);
+		a2cf_map_copy32 (a2cf, offset + 4, piece->length);
+		a2cf_map_copy32 (a2cf, offset + 8, piece->bitfield_len);
+		a2cf_map_copy (a2cf, offset + 12, piece->bitfield, piece->bitfield_len);
+		offset += 12 + piece->bitfield_len;
+	}
+
+	// msync() only write dirty pages
+	return (msync (a2cf->map.addr, a2cf->map.size, MS_SYNC) == 0);
+#else
+	return FALSE;
+#endif  // A2CF_MMAP
+}
+
+void  uget_a2cf_unmap (UgetA2cf* a2cf)
+{
+#ifdef A2CF_MMAP
+	if (a2cf->map.addr) {
+		munmap (a2cf->map.addr, a2cf->map.size);
+		ug_close (a2cf->map.fd);
+		a2cf->map.addr = NULL;
+		a2cf->map.size = 0;
+	}
+#endif  // A2CF_MMAP
+}
+
 int   uget_a2cf_lack (UgetA2cf* a2cf, uint64_t* beg, uint64_t* end)
 {
 	UgetA2cfPiece*  piece;
 	uint32_t  index;
+	uint32_t  index_filled;
 	uint32_t  piece_beg;
 	uint32_t  piece_end;
+	int       pos;
 
 	// check
 	if (beg[0] == a2cf->total_len)
@@ -510,10 +683,14 @@ int   uget_a2cf_lack (UgetA2cf* a2cf, uint64_t* beg, uint64_t* end)
 
 	// find begin
 	for (;  index < a2cf->piece.index_end;  index++) {
-		// test a2cf->bitfield
+		// skip completed pieces
 		if (test_bit (a2cf->bitfield, index) == TRUE) {
 			piece_beg = 0;
-			continue;
+			if (find_bit0 (a2cf->bitfield, a2cf->bitfield_len, &index) == FALSE ||
+			    index >= a2cf->piece.index_end)
+			{
+				return FALSE;
+			}
 		}
 		// find begin in piece
 		piece = uget_a2cf_find (a2cf, index);
@@ -542,31 +719,36 @@ int   uget_a2cf_lack (UgetA2cf* a2cf, uint64_t* beg, uint64_t* end)
 	if (index >= a2cf->piece.index_end)
 		return FALSE;
 
-	// find end
-	for (index += 1;  index < a2cf->piece.index_end;  index++) {
-		// test a2cf->bitfield
-		if (test_bit (a2cf->bitfield, index) == TRUE) {
-			end[0] = (uint64_t)index * a2cf->piece_len;
+	// find end: next completed piece
+	index_filled = index + 1;
+	if (find_bit1 (a2cf->bitfield, a2cf->bitfield_len, &index_filled) == FALSE ||
+	    index_filled > a2cf->piece.index_end)
+	{
+		index_filled = a2cf->piece.index_end;
+	}
+	// find end in in-flight pieces before next completed piece
+	pos = a2cf_piece_position (a2cf, index + 1);
+	for (;  pos < a2cf->piece.array.length;  pos++) {
+		piece = a2cf->piece.array.at[pos];
+		if (piece->index >= index_filled)
+			break;
+		piece_beg = 0;
+		piece_end = piece->length;
+		a2cf_piece_lack (piece, &piece_beg, &piece_end);
+		if (piece_beg != 0) {
+			end[0] = (uint64_t)piece->index * a2cf->piece_len;
 			return TRUE;
 		}
-		// find end in piece
-		piece = uget_a2cf_find (a2cf, index);
-		if (piece) {
-			piece_beg = 0;
-			piece_end = piece->length;
-			a2cf_piece_lack (piece, &piece_beg, &piece_end);
-			if (piece_beg != 0) {
-				end[0] = (uint64_t)index * a2cf->piece_len;
-				return TRUE;
-			}
-			if (piece_end != piece->length) {
-				end[0] = (uint64_t)index * a2cf->piece_len + piece_end;
-				return TRUE;
-			}
+		if (piece_end != piece->length) {
+			end[0] = (uint64_t)piece->index * a2cf->piece_len + piece_end;
+			return TRUE;
 		}
 	}
 
-	end[0] = a2cf->total_len;
+	if (index_filled < a2cf->piece.index_end)
+		end[0] = (uint64_t)index_filled * a2cf->piece_len;
+	else
+		end[0] = a2cf->total_len;
 	return TRUE;
 }
 
@@ -596,7 +778,8 @@ static void uget_a2cf_fill_piece (UgetA2cf* a2cf, uint32_t index, uint32_t beg,
 		if (a2cf_piece_filled (piece)) {
 			set_bit (a2cf->bitfield, index);
 			// delete piece
-			ug_list_remove (&a2cf->piece.list, (UgLink*)piece);
+			ug_array_erase (&a2cf->piece.array,
+			                a2cf_piece_position (a2cf, index), 1);
 			ug_free (piece);
 		}
 	}
@@ -604,8 +787,7 @@ static void uget_a2cf_fill_piece (UgetA2cf* a2cf, uint32_t index, uint32_t beg,
 
 uint64_t  uget_a2cf_fill (UgetA2cf* a2cf, uint64_t beg, uint64_t end)
 {
-	UgetA2cfPiece*  piece;
-	uint32_t        index;
+	int             pos, pos_end;
 	uint32_t        index_beg, index_end;
 	uint32_t        piece_beg, piece_end;
 
@@ -630,17 +812,15 @@ uint64_t  uget_a2cf_fill (UgetA2cf* a2cf, uint64_t beg, uint64_t end)
 //		piece_end = 0;
 	}
 
-	// middle
-	for (index = index_beg;  index < index_end;  index++) {
-		if (test_bit (a2cf->bitfield, index) == TRUE)
-			continue;
-		// delete piece
-		piece = uget_a2cf_find (a2cf, index);
-		if (piece) {
-			ug_list_remove (&a2cf->piece.list, (UgLink*)piece);
-			ug_free (piece);
-		}
+	// middle: delete pieces in [index_beg, index_end)
+	pos = a2cf_piece_position (a2cf, index_beg);
+	for (pos_end = pos;  pos_end < a2cf->piece.array.length;  pos_end++) {
+		if (a2cf->piece.array.at[pos_end]->index >= index_end)
+			break;
+		ug_free (a2cf->piece.array.at[pos_end]);
 	}
+	if (pos_end > pos)
+		ug_array_erase (&a2cf->piece.array, pos, pos_end - pos);
 	fill_bits (a2cf->bitfield, index_beg, index_end - index_beg);
 
 exit:
@@ -649,65 +829,95 @@ exit:
 	return end & ~16383;
 }
 
-uint64_t  uget_a2cf_completed (UgetA2cf* a2cf)
+uint64_t  uget_a2cf_erase (UgetA2cf* a2cf, uint64_t beg, uint64_t end)
 {
 	UgetA2cfPiece*  piece;
+	uint64_t        piece_beg;
+	uint64_t        erased;
 	uint32_t        index;
-	uint32_t        last_piece_len;
-	uint64_t        completed;
+	uint32_t        bit_beg, bit_end;
 
-	completed = 0;
-	piece = (UgetA2cfPiece*) a2cf->piece.list.head;
+	if (end > a2cf->total_len)
+		end = a2cf->total_len;
+	erased = 0;
 
-	for (index = 0;  index < a2cf->piece.index_end;  index++) {
-		if (test_bit (a2cf->bitfield, index) == TRUE) {
-			if (index == a2cf->piece.index_end - 1) {
-				last_piece_len = a2cf->total_len % a2cf->piece_len;
-				if (last_piece_len) {
-					completed += last_piece_len;
-					break;
-				}
-			}
-			completed += a2cf->piece_len;
-			continue;
+	for (index = (uint32_t) (beg / a2cf->piece_len);
+	     index < a2cf->piece.index_end;  index++)
+	{
+		piece_beg = (uint64_t)index * a2cf->piece_len;
+		if (piece_beg >= end)
+			break;
+		piece = uget_a2cf_find (a2cf, index);
+		if (piece == NULL) {
+			if (test_bit (a2cf->bitfield, index) == FALSE)
+				continue;
+			// completed piece: turn it to a piece that all blocks are filled.
+			clear_bit (a2cf->bitfield, index);
+			piece = uget_a2cf_realloc (a2cf, index);
+			fill_bits (piece->bitfield, 0,
+			           (piece->length >> 14) + ((piece->length & 16383) ? 1 : 0));
 		}
-		if (piece && piece->index == index) {
-			completed += a2cf_piece_completed (piece);
-			piece = piece->next;
+
+		bit_beg = (beg > piece_beg) ? (uint32_t) ((beg - piece_beg) >> 14) : 0;
+		if (end - piece_beg >= piece->length)
+			bit_end = (piece->length >> 14) + ((piece->length & 16383) ? 1 : 0);
+		else
+			bit_end = (uint32_t) ((end - piece_beg + 16383) >> 14);
+
+		for (;  bit_beg < bit_end;  bit_beg++) {
+			if (test_bit (piece->bitfield, bit_beg) == FALSE)
+				continue;
+			clear_bit (piece->bitfield, bit_beg);
+			// the last block of the last piece may be shorter
+			if (((bit_beg + 1) << 14) > piece->length)
+				erased += piece->length - (bit_beg << 14);
+			else
+				erased += 16384;
 		}
 	}
+	return erased;
+}
+
+uint64_t  uget_a2cf_completed (UgetA2cf* a2cf)
+{
+	UgetA2cfPiece*  piece;
+	uint32_t        last_piece_len;
+	uint64_t        completed;
+	int             pos;
+
+	// completed pieces
+	completed = (uint64_t) count_bits (a2cf->bitfield, a2cf->piece.index_end) *
+	            a2cf->piece_len;
+	last_piece_len = a2cf->total_len % a2cf->piece_len;
+	if (last_piece_len && test_bit (a2cf->bitfield, a2cf->piece.index_end - 1))
+		completed -= a2cf->piece_len - last_piece_len;
+
+	// pieces that partially completed
+	for (pos = 0;  pos < a2cf->piece.array.length;  pos++) {
+		piece = a2cf->piece.array.at[pos];
+		if (test_bit (a2cf->bitfield, piece->index) == FALSE)
+			completed += a2cf_piece_completed (piece);
+	}
 
 	return completed;
 }
 
 void  uget_a2cf_insert (UgetA2cf* a2cf, UgetA2cfPiece* newpiece)
 {
-	UgetA2cfPiece*  piece;
+	int  pos;
 
-	if (a2cf->piece.list.head == NULL) {
-		ug_list_prepend (&a2cf->piece.list, (UgLink*)newpiece);
-		return;
-	}
-
-	for (piece = (void*)a2cf->piece.list.head;  piece;  piece = piece->next) {
-		if (piece->index > newpiece->index) {
-			ug_list_insert (&a2cf->piece.list, (void*)piece, (void*)newpiece);
-			return;
-		}
-	}
-	ug_list_append (&a2cf->piece.list, (void*)newpiece);
+	pos = a2cf_piece_position (a2cf, newpiece->index);
+	*(UgetA2cfPiece**) ug_array_insert (&a2cf->piece.array, pos, 1) = newpiece;
 }
 
 UgetA2cfPiece*  uget_a2cf_find (UgetA2cf* a2cf, uint32_t piece_index)
 {
-	UgetA2cfPiece*  piece;
+	UgetA2cfPiece**  piece;
 
-	for (piece = (void*)a2cf->piece.list.head;  piece;  piece = piece->next) {
-		if (piece->index == piece_index)
-			return piece;
-		else if (piece->index > piece_index)
-			return NULL;
-	}
+	piece = ug_array_find_sorted (&a2cf->piece.array, &piece_index,
+	                              a2cf_piece_compare, NULL);
+	if (piece)
+		return piece[0];
 	return NULL;
 }
 
@@ -719,95 +929,183 @@ UgetA2cfPiece*  uget_a2cf_realloc (UgetA2cf* a2cf, uint32_t piece_index)
 	if (piece == NULL) {
 		piece = a2cf_piece_new (a2cf->piece_len);
 		piece->index = piece_index;
-		if (piece_index == a2cf->piece.index_end - 1)
+		// the last piece is shorter if total_len isn't multiple of piece_len
+		if (piece_index == a2cf->piece.index_end - 1 &&
+		    a2cf->total_len % a2cf->piece_len)
+		{
 			a2cf_piece_truncate (piece, a2cf->total_len % a2cf->piece_len);
+		}
 		uget_a2cf_insert (a2cf, piece);
 	}
 	return piece;
 }
 
 // ----------------------------------------------------------------------------
+// bitfield kernels
+// Bits are stored from the most significant bit of each byte. A word loaded in
+// big-endian order keeps the bit order, so clz() returns the bit position.
 
-// beg_bit: [in, out]
-static int find_bit0 (uint8_t* bytes_beg, uint32_t bytes_len, uint32_t* beg_bit)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define A2CF_AVX2    1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define bit_clz64(word)        __builtin_clzll (word)
+#define bit_popcount64(word)   __builtin_popcountll (word)
+#else
+static int  bit_clz64 (uint64_t word)
 {
-	int       counts;
-	uint8_t*  bytes;
-	uint8_t*  bytes_end;
-	uint8_t   mask;
+	int  count = 0;
+
+	if ((word >> 32) == 0) { count += 32;  word <<= 32; }
+	if ((word >> 48) == 0) { count += 16;  word <<= 16; }
+	if ((word >> 56) == 0) { count +=  8;  word <<=  8; }
+	if ((word >> 60) == 0) { count +=  4;  word <<=  4; }
+	if ((word >> 62) == 0) { count +=  2;  word <<=  2; }
+	if ((word >> 63) == 0) { count +=  1; }
+	return count;
+}
 
-	bytes_end = bytes_beg + bytes_len;
-	bytes = bytes_beg + (beg_bit[0] >> 3);
-	counts = beg_bit[0] & 7;
-	if (bytes >= bytes_end)
-		return FALSE;
+static int  bit_popcount64 (uint64_t word)
+{
+	word = word - ((word >> 1) & 0x5555555555555555ULL);
+	word = (word & 0x3333333333333333ULL) + ((word >> 2) & 0x3333333333333333ULL);
+	word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+	return (int) ((word * 0x0101010101010101ULL) >> 56);
+}
+#endif
 
-	if (counts != 0) {
-		for (mask = 0x80 >> counts;  counts < 8;  counts++, mask >>= 1) {
-			if ((bytes[0] & mask) == 0) {
-				beg_bit[0] = ((bytes - bytes_beg) << 3) + counts;
-				return TRUE;
-			}
-		}
-		bytes++;
+// load 'length' bytes as big-endian word and XOR it with 'flip'.
+// bits after the end of bytes are zero.
+static uint64_t  load_word (const uint8_t* bytes, uint32_t length, uint64_t flip)
+{
+	uint64_t  word;
+	uint32_t  index;
+
+	if (length >= 8) {
+		word = ((uint64_t)bytes[0] << 56) | ((uint64_t)bytes[1] << 48) |
+		       ((uint64_t)bytes[2] << 40) | ((uint64_t)bytes[3] << 32) |
+		       ((uint64_t)bytes[4] << 24) | ((uint64_t)bytes[5] << 16) |
+		       ((uint64_t)bytes[6] <<  8) |  (uint64_t)bytes[7];
+		return word ^ flip;
 	}
 
-	for (;  bytes < bytes_end;  bytes++) {
-		if (bytes[0] != 0xFF)
+	for (word = 0, index = 0;  index < length;  index++)
+		word |= (uint64_t)bytes[index] << (56 - (index << 3));
+	return (word ^ flip) & ~(UINT64_MAX >> (length << 3));
+}
+
+// skip 32 bytes chunks that all bytes equal to (uint8_t)flip.
+// return position of the first chunk that doesn't match or the last (< 32) bytes.
+static uint32_t  skip_words (const uint8_t* bytes, uint32_t bytes_len, uint32_t pos, uint64_t flip)
+{
+	uint64_t  words[4];
+
+	for (;  bytes_len - pos >= 32;  pos += 32) {
+		memcpy (words, bytes + pos, 32);
+		if ((words[0] ^ flip) | (words[1] ^ flip) |
+		    (words[2] ^ flip) | (words[3] ^ flip))
+		{
 			break;
+		}
 	}
+	return pos;
+}
 
-	if (bytes < bytes_end) {
-		for (mask = 0x80, counts = 0;  counts < 8;  counts++, mask >>= 1) {
-			if ((bytes[0] & mask) == 0) {
-				beg_bit[0] = ((bytes - bytes_beg) << 3) + counts;
-				return TRUE;
-			}
-		}
+#ifdef A2CF_AVX2
+__attribute__((target("avx2")))
+static uint32_t  skip_avx2 (const uint8_t* bytes, uint32_t bytes_len, uint32_t pos, uint64_t flip)
+{
+	__m256i  skipped;
+	__m256i  chunk0, chunk1;
+
+	skipped = _mm256_set1_epi8 ((char) flip);
+	for (;  bytes_len - pos >= 64;  pos += 64) {
+		chunk0 = _mm256_xor_si256 (skipped,
+				_mm256_loadu_si256 ((const __m256i*) (bytes + pos)));
+		chunk1 = _mm256_xor_si256 (skipped,
+				_mm256_loadu_si256 ((const __m256i*) (bytes + pos + 32)));
+		chunk0 = _mm256_or_si256 (chunk0, chunk1);
+		if (_mm256_testz_si256 (chunk0, chunk0) == 0)
+			break;
 	}
+	// the last 32 bytes or the chunk that doesn't match
+	return skip_words (bytes, bytes_len, pos, flip);
+}
+#endif  // A2CF_AVX2
 
-	return FALSE;
+// select skip function by CPU at first call
+static uint32_t  skip_select (const uint8_t* bytes, uint32_t bytes_len, uint32_t pos, uint64_t flip);
+static uint32_t  (*skip_bytes) (const uint8_t* bytes, uint32_t bytes_len, uint32_t pos, uint64_t flip) = skip_select;
+
+static uint32_t  skip_select (const uint8_t* bytes, uint32_t bytes_len, uint32_t pos, uint64_t flip)
+{
+#ifdef A2CF_AVX2
+	__builtin_cpu_init ();
+	if (__builtin_cpu_supports ("avx2"))
+		skip_bytes = skip_avx2;
+	else
+#endif
+		skip_bytes = skip_words;
+	return skip_bytes (bytes, bytes_len, pos, flip);
 }
 
+// find bit that is not equal to the bits of 'flip'
 // beg_bit: [in, out]
-static int find_bit1 (uint8_t* bytes_beg, uint32_t bytes_len, uint32_t* beg_bit)
+static int  find_bit (const uint8_t* bytes, uint32_t bytes_len, uint32_t* beg_bit, uint64_t flip)
 {
-	int       counts;
-	uint8_t*  bytes;
-	uint8_t*  bytes_end;
-	uint8_t   mask;
+	uint64_t  word;
+	uint32_t  pos;
 
-	bytes_end = bytes_beg + bytes_len;
-	bytes = bytes_beg + (beg_bit[0] >> 3);
-	counts = beg_bit[0] & 7;
-	if (bytes >= bytes_end)
+	pos = beg_bit[0] >> 3;
+	if (pos >= bytes_len)
 		return FALSE;
+	// ignore bits before beg_bit in the first word
+	word = load_word (bytes + pos, bytes_len - pos, flip);
+	word &= UINT64_MAX >> (beg_bit[0] & 7);
 
-	if (counts != 0) {
-		for (mask = 0x80 >> counts;  counts < 8;  counts++, mask >>= 1) {
-			if (bytes[0] & mask) {
-				beg_bit[0] = ((bytes - bytes_beg) << 3) + counts;
-				return TRUE;
-			}
-		}
-		bytes++;
+	while (word == 0) {
+		pos += 8;
+		if (pos >= bytes_len)
+			return FALSE;
+		pos = skip_bytes (bytes, bytes_len, pos, flip);
+		word = load_word (bytes + pos, bytes_len - pos, flip);
 	}
+	beg_bit[0] = (pos << 3) + bit_clz64 (word);
+	return TRUE;
+}
 
-	for (;  bytes < bytes_end;  bytes++) {
-		if (bytes[0] != 0)
-			break;
-	}
+// beg_bit: [in, out]
+static int find_bit0 (uint8_t* bytes_beg, uint32_t bytes_len, uint32_t* beg_bit)
+{
+	return find_bit (bytes_beg, bytes_len, beg_bit, UINT64_MAX);
+}
 
-	if (bytes < bytes_end) {
-		for (mask = 0x80, counts = 0;  counts < 8;  counts++, mask >>= 1) {
-			if (bytes[0] & mask) {
-				beg_bit[0] = ((bytes - bytes_beg) << 3) + counts;
-				return TRUE;
-			}
-		}
-	}
+// beg_bit: [in, out]
+static int find_bit1 (uint8_t* bytes_beg, uint32_t bytes_len, uint32_t* beg_bit)
+{
+	return find_bit (bytes_beg, bytes_len, beg_bit, 0);
+}
 
-	return FALSE;
+// return number of 1 bits in [0, n_bits)
+static uint32_t  count_bits (uint8_t* bytes, uint32_t n_bits)
+{
+	uint64_t  word;
+	uint32_t  pos, bytes_len;
+	uint32_t  counts = 0;
+
+	bytes_len = n_bits >> 3;
+	for (pos = 0;  bytes_len - pos >= 8;  pos += 8) {
+		memcpy (&word, bytes + pos, 8);
+		counts += bit_popcount64 (word);
+	}
+	if (n_bits & 7)
+		bytes_len++;
+	if (pos < bytes_len)
+		counts += bit_popcount64 (load_word (bytes + pos, bytes_len - pos, 0) &
+		                          ~(UINT64_MAX >> (n_bits - (pos << 3))));
+	return counts;
 }
 
 static void  set_bit (uint8_t* bytes, uint32_t nth_bit)
@@ -822,6 +1120,12 @@ static void  set_bit (uint8_t* bytes, uint32_t nth_bit)
 	bytes[0] |= (0x80 >> cur_bit);
 }
 
+static void  clear_bit (uint8_t* bytes, uint32_t nth_bit)
+{
+	bytes += nth_bit >> 3;
+	bytes[0] &= ~(0x80 >> (nth_bit & 7));
+}
+
 static int   test_bit (uint8_t* bytes, uint32_t nth_bit)
 {
 	uint8_t  cur_bit;
@@ -839,34 +1143,34 @@ static int   test_bit (uint8_t* bytes, uint32_t nth_bit)
 
 static void  fill_bits (uint8_t* bytes, uint32_t nth_bit, uint32_t n_bits)
 {
-	uint8_t  mask;
-	uint8_t  counts;
+	uint32_t  counts;
 
+	if (n_bits == 0)
+		return;
 //	bytes += nth_bit / 8;
 	bytes += nth_bit >> 3;
-
 //	nth_bit %= 8;
 	nth_bit &= 7;
 
+	// bits in the first byte
 	if (nth_bit != 0) {
-		mask = 0x80;
-		if (nth_bit + n_bits >= 8)
-			counts = 8 - nth_bit;
-		else
+		counts = 8 - nth_bit;
+		if (counts > n_bits)
 			counts = n_bits;
-
-		for (mask >>= nth_bit;  counts > 0;  counts--, mask >>= 1) {
-			bytes[0] |= mask;
-			nth_bit++;
-			n_bits--;
-		}
+		bytes[0] |= (uint8_t) ((0xFF >> nth_bit) & (0xFF << (8 - nth_bit - counts)));
+		n_bits -= counts;
 		bytes++;
 	}
-
-	for (; n_bits >= 8; n_bits -= 8)
+	// whole bytes, a segment usually fills only a few blocks at a time.
+	if (n_bits >= 256) {
+		memset (bytes, 0xFF, n_bits >> 3);
+		bytes += n_bits >> 3;
+		n_bits &= 7;
+	}
+	for (;  n_bits >= 8;  n_bits -= 8)
 		*bytes++ = 0xFF;
-
-	for (mask = 0x80;  n_bits > 0;  n_bits--, mask >>= 1)
-		bytes[0] |= mask;
+	// bits in the last byte
+	if (n_bits & 7)
+		bytes[0] |= (uint8_t) (0xFF << (8 - (n_bits & 7)));
 }
 
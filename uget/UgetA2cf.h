@@ -39,7 +39,7 @@
 #define UGET_A2CF_H
 
 #include <stdint.h>
-#include <UgList.h>
+#include <UgArray.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -51,11 +51,6 @@ typedef struct UgetA2cfPiece    UgetA2cfPiece;
 
 struct UgetA2cfPiece
 {
-	UG_LINK_MEMBERS (UgetA2cfPiece, UgetA2cfPiece, self);
-//	UgetA2cfPiece*     self;
-//	UgetA2cfPiece*     next;
-//	UgetA2cfPiece*     prev;
-
 	uint32_t    index;
 	uint32_t    length;
 	uint32_t    bitfield_len;
@@ -80,9 +75,17 @@ struct UgetA2cf
 
 	// piece
 	struct {
-		UgList   list;
+		// in-flight pieces, sorted by UgetA2cfPiece::index
+		UG_ARRAY (UgetA2cfPiece*)  array;
 		uint32_t index_end;
 	} piece;
+
+	// memory-mapped control file, see uget_a2cf_map()
+	struct {
+		uint8_t*  addr;    // NULL if control file isn't mapped
+		size_t    size;
+		int       fd;
+	} map;
 };
 
 void  uget_a2cf_init (UgetA2cf* a2cf, uint64_t total_size);
@@ -91,10 +94,20 @@ void  uget_a2cf_clear (UgetA2cf* a2cf);
 int   uget_a2cf_load (UgetA2cf* a2cf, const char* filename);
 int   uget_a2cf_save (UgetA2cf* a2cf, const char* filename);
 
+// write control file and map it to memory. After that, uget_a2cf_sync()
+// only copy changed bytes to mapped file and flush them.
+// return FALSE if platform doesn't support it, caller can use uget_a2cf_save()
+int   uget_a2cf_map (UgetA2cf* a2cf, const char* filename);
+int   uget_a2cf_sync (UgetA2cf* a2cf);
+void  uget_a2cf_unmap (UgetA2cf* a2cf);
+
 // beg [in, out]: pass search position and return new begin position
 // end [out]    : return end position
 int       uget_a2cf_lack (UgetA2cf* a2cf, uint64_t* beg, uint64_t* end);
 uint64_t  uget_a2cf_fill (UgetA2cf* a2cf, uint64_t  beg, uint64_t  end);
+// clear 16 KiB blocks that overlap [beg, end), uget_a2cf_lack() will return
+// them again. return number of downloaded bytes that were cleared.
+uint64_t  uget_a2cf_erase (UgetA2cf* a2cf, uint64_t  beg, uint64_t  end);
 
 uint64_t  uget_a2cf_completed (UgetA2cf* a2cf);
 
@@ -267,6 +267,27 @@ static int  uget_app_activate (UgetApp* app, UgetNode* cnode, UgetCategory* cate
 	return category->active->n_children;
 }
 
+// return TRUE if host of download has spare connection
+static int  uget_app_check_host (UgetApp* app, UgetNode* dnode)
+{
+	UgetCommon*   common;
+	UgetHost*     host;
+	int           spare;
+
+	common = ug_info_get (dnode->info, UgetCommonInfo);
+	if (common == NULL || common->uri == NULL)
+		return TRUE;
+	host = uget_host_find (app->task.host, common->uri);
+	if (host == NULL)
+		return TRUE;
+	spare = uget_host_spare (host);
+	// active downloads leave spare connection for waiting one.
+	if (spare == 0)
+		uget_host_wait (host);
+	uget_host_unref (host);
+	return (spare == 0) ? FALSE : TRUE;
+}
+
 static void uget_app_queuing (UgetApp* app, UgetNode* cnode, UgetCategory* category)
 {
 	UgetRelation* relation;
@@ -285,6 +306,9 @@ static void uget_app_queuing (UgetApp* app, UgetNode* cnode, UgetCategory* categ
 		relation = ug_info_realloc(dnode->info, UgetRelationInfo);
 		if (relation->group & UGET_GROUP_INACTIVE)
 			continue;
+		// host is busy, try downloads of other hosts.
+		if (uget_app_check_host (app, dnode) == FALSE)
+			continue;
 		uget_app_activate_download (app, dnode);
 		app->n_moved++;
 	}
@@ -301,6 +325,8 @@ int  uget_app_grow (UgetApp* app, int no_queuing)
 
 	// dispatch plug-in event, calc speed
 	uget_task_dispatch (&app->task);
+	// uget_app_queuing() count downloads that wait for hosts again.
+	uget_host_clear_waiting (app->task.host);
 	// active, queuing, finished, recycled
 	for (cnode = app->real.children;  cnode;  cnode = cnode->next) {
 		category = ug_info_realloc (cnode->info, UgetCategoryInfo);
@@ -1658,6 +1684,10 @@ void  uget_node_set_keeping (UgetNode* node, int enable)
 				temp.common->keeping.user = TRUE;
 			if (temp.common->password)
 				temp.common->keeping.password = TRUE;
+			if (temp.common->checksum)
+				temp.common->keeping.checksum = TRUE;
+			if (temp.common->piece_hashes)
+				temp.common->keeping.piece_hashes = TRUE;
 //			if (temp.common->connect_timeout)
 //				temp.common->keeping.connect_timeout = TRUE;
 //			if (temp.common->transmit_timeout)
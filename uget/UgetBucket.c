@@ -0,0 +1,266 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include <UgDefine.h>
+#include <UgUtil.h>
+#include <UgetBucket.h>
+
+#define BUCKET_ACTIVE_MS     1000    // child is active if it took tokens recently
+#define BUCKET_BURST_MIN     16384   // bytes
+#define BUCKET_BURST_DIV     8       // burst size = rate / 8 (125 ms)
+
+static UgetBucket*  bucket_root (UgetBucket* bucket)
+{
+	while (bucket->parent)
+		bucket = bucket->parent;
+	return bucket;
+}
+
+// decide speed of bucket by it's limit and share of parent's limit.
+// caller must lock root bucket.
+static int64_t  bucket_rate (UgetBucket* bucket, uint64_t now)
+{
+	UgetBucket*  sibling;
+	int64_t      parent_rate;
+	int64_t      share;
+	int          weights;
+
+	if (bucket->parent == NULL)
+		return bucket->rate;
+	share = bucket_rate (bucket->parent, now);
+	if (share == 0)
+		return bucket->rate;
+
+	// share parent's rate with active siblings by weight
+	weights = bucket->weight;
+	for (sibling = bucket->parent->children;  sibling;  sibling = sibling->next) {
+		if (sibling != bucket && now < sibling->active + BUCKET_ACTIVE_MS)
+			weights += sibling->weight;
+	}
+	// sibling that limited below it's share leave the rest to others.
+	parent_rate = share;
+	for (sibling = bucket->parent->children;  sibling;  sibling = sibling->next) {
+		if (sibling == bucket || now >= sibling->active + BUCKET_ACTIVE_MS)
+			continue;
+		if (sibling->rate > 0 &&
+		    sibling->rate < parent_rate * sibling->weight / weights)
+		{
+			share -= sibling->rate;
+			weights -= sibling->weight;
+		}
+	}
+	share = share * bucket->weight / weights;
+	if (share == 0)
+		share = 1;
+	if (bucket->rate == 0 || bucket->rate > share)
+		return share;
+	return bucket->rate;
+}
+
+// caller must lock root bucket.
+static void  bucket_refill (UgetBucket* bucket, int64_t rate, uint64_t now)
+{
+	int64_t  tokens;
+	int64_t  burst;
+
+	if (rate == 0) {
+		bucket->tokens = 0;
+		bucket->time = now;
+		return;
+	}
+	// Don't move time if tokens is less than 1 byte, avoid losing fraction.
+	tokens = rate * (int64_t) (now - bucket->time) / 1000;
+	if (tokens > 0) {
+		bucket->tokens += tokens;
+		bucket->time = now;
+	}
+	burst = rate / BUCKET_BURST_DIV;
+	if (burst < BUCKET_BURST_MIN)
+		burst = BUCKET_BURST_MIN;
+	if (bucket->tokens > burst)
+		bucket->tokens = burst;
+}
+
+static int  bucket_update (UgetBucket* bucket, int64_t n_bytes)
+{
+	UgetBucket*  root;
+	uint64_t     now;
+	int64_t      rate;
+	int64_t      wait;
+	int64_t      wait_max = 0;
+
+	root = bucket_root (bucket);
+	now = ug_get_time_count ();
+	ug_mutex_lock (&root->mutex);
+	for (;  bucket;  bucket = bucket->parent) {
+		if (n_bytes > 0)
+			bucket->active = now;
+		rate = bucket_rate (bucket, now);
+		bucket_refill (bucket, rate, now);
+		if (rate == 0)
+			continue;
+		bucket->tokens -= n_bytes;
+		if (bucket->tokens < 0) {
+			wait = (-bucket->tokens * 1000 + rate - 1) / rate;
+			if (wait_max < wait)
+				wait_max = wait;
+		}
+	}
+	ug_mutex_unlock (&root->mutex);
+	return (int) wait_max;
+}
+
+// ----------------------------------------------------------------------------
+// UgetBucket
+
+UgetBucket*  uget_bucket_new (UgetBucket* parent)
+{
+	UgetBucket*  bucket;
+	UgetBucket*  root;
+
+	bucket = ug_malloc0 (sizeof (UgetBucket));
+	bucket->weight = 1;
+	bucket->ref_count = 1;
+	bucket->time = ug_get_time_count ();
+
+	if (parent == NULL)
+		ug_mutex_init (&bucket->mutex);
+	else {
+		uget_bucket_ref (parent);
+		root = bucket_root (parent);
+		ug_mutex_lock (&root->mutex);
+		bucket->parent = parent;
+		bucket->next = parent->children;
+		parent->children = bucket;
+		ug_mutex_unlock (&root->mutex);
+	}
+	return bucket;
+}
+
+void  uget_bucket_ref (UgetBucket* bucket)
+{
+	UgetBucket*  root;
+
+	root = bucket_root (bucket);
+	ug_mutex_lock (&root->mutex);
+	bucket->ref_count++;
+	ug_mutex_unlock (&root->mutex);
+}
+
+void  uget_bucket_unref (UgetBucket* bucket)
+{
+	UgetBucket*  root;
+	UgetBucket*  parent;
+	UgetBucket** link;
+	int          ref_count;
+
+	root = bucket_root (bucket);
+	ug_mutex_lock (&root->mutex);
+	ref_count = --bucket->ref_count;
+	if (ref_count == 0 && bucket->parent) {
+		// remove from parent's children
+		for (link = &bucket->parent->children;  *link;  link = &(*link)->next) {
+			if (*link == bucket) {
+				*link = bucket->next;
+				break;
+			}
+		}
+	}
+	ug_mutex_unlock (&root->mutex);
+
+	if (ref_count == 0) {
+		parent = bucket->parent;
+		if (parent == NULL)
+			ug_mutex_clear (&bucket->mutex);
+		ug_free (bucket);
+		if (parent)
+			uget_bucket_unref (parent);
+	}
+}
+
+void  uget_bucket_set_rate (UgetBucket* bucket, int64_t rate)
+{
+	UgetBucket*  root;
+
+	root = bucket_root (bucket);
+	ug_mutex_lock (&root->mutex);
+	if (bucket->rate != rate) {
+		bucket->rate = rate;
+		bucket->tokens = 0;
+		bucket->time = ug_get_time_count ();
+	}
+	ug_mutex_unlock (&root->mutex);
+}
+
+void  uget_bucket_set_weight (UgetBucket* bucket, int weight)
+{
+	UgetBucket*  root;
+
+	if (weight < 1)
+		weight = 1;
+	root = bucket_root (bucket);
+	ug_mutex_lock (&root->mutex);
+	bucket->weight = weight;
+	ug_mutex_unlock (&root->mutex);
+}
+
+UgetBucket*  uget_bucket_find (UgetBucket* parent, void* data)
+{
+	UgetBucket*  root;
+	UgetBucket*  bucket;
+
+	root = bucket_root (parent);
+	ug_mutex_lock (&root->mutex);
+	for (bucket = parent->children;  bucket;  bucket = bucket->next) {
+		if (bucket->data == data) {
+			bucket->ref_count++;
+			break;
+		}
+	}
+	ug_mutex_unlock (&root->mutex);
+	return bucket;
+}
+
+int   uget_bucket_take (UgetBucket* bucket, int64_t n_bytes)
+{
+	return bucket_update (bucket, n_bytes);
+}
+
+int   uget_bucket_wait (UgetBucket* bucket)
+{
+	return bucket_update (bucket, 0);
+}
+
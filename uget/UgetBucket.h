@@ -0,0 +1,98 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+// Hierarchical token bucket for speed limit (global -> category -> download)
+#ifndef UGET_BUCKET_H
+#define UGET_BUCKET_H
+
+#include <stdint.h>
+#include <UgThread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct UgetBucket      UgetBucket;
+
+/* ----------------------------------------------------------------------------
+   UgetBucket: Each transfer take tokens (bytes) from it's bucket and all of
+               parent buckets after receiving data. If any of them has no
+               tokens, transfer must wait until tokens are refilled.
+
+   If parent bucket has speed limit, active children share it by weight.
+   All buckets in the same tree are locked by mutex of root bucket.
+   Parent of bucket can't be changed after it was created.
+ */
+
+struct UgetBucket
+{
+	UgetBucket*  parent;
+	UgetBucket*  children;   // first child
+	UgetBucket*  next;       // next sibling
+
+	UgMutex      mutex;      // only root bucket use this
+	void*        data;       // user data, see uget_bucket_find()
+
+	int64_t      rate;       // bytes per second, 0 = unlimited
+	int64_t      tokens;     // negative value is debt
+	uint64_t     time;       // last time to refill tokens (milliseconds)
+	uint64_t     active;     // last time to take tokens (milliseconds)
+	int          weight;     // share of parent's rate, default is 1
+	int          ref_count;
+};
+
+UgetBucket*  uget_bucket_new (UgetBucket* parent);
+void  uget_bucket_ref (UgetBucket* bucket);
+void  uget_bucket_unref (UgetBucket* bucket);
+
+void  uget_bucket_set_rate (UgetBucket* bucket, int64_t rate);
+void  uget_bucket_set_weight (UgetBucket* bucket, int weight);
+
+// find child bucket by user data. caller must unref returned bucket.
+UgetBucket*  uget_bucket_find (UgetBucket* parent, void* data);
+
+// take n_bytes from bucket and all of it's parents.
+// return milliseconds to wait before taking next data, 0 if no need to wait.
+int   uget_bucket_take (UgetBucket* bucket, int64_t n_bytes);
+// return milliseconds to wait before taking data, 0 if no need to wait.
+int   uget_bucket_wait (UgetBucket* bucket);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // End of UGET_BUCKET_H
+
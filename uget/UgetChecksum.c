@@ -0,0 +1,521 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+// Digests are implemented here because OpenSSL and GnuTLS are optional.
+
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <UgDefine.h>
+#include <UgUtil.h>
+#include <UgetChecksum.h>
+
+#ifdef _MSC_VER
+#define strncasecmp  strnicmp
+#else
+#include <strings.h>
+#endif
+
+#define ROTL32(x, n)    (((x) << (n)) | ((x) >> (32 - (n))))
+#define ROTR32(x, n)    (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const char  hex_digits[] = "0123456789abcdef";
+
+static uint32_t  get_le32 (const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	       ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t  get_be32 (const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+// ----------------------------------------------------------------------------
+// MD5 (RFC 1321)
+
+static const uint32_t  md5_k[64] =
+{
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+	0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+	0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+	0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+	0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+	0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+
+static const uint8_t  md5_r[64] =
+{
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21,
+};
+
+static void  md5_block (uint32_t* state, const uint8_t* block)
+{
+	uint32_t  w[16];
+	uint32_t  a, b, c, d, f, temp;
+	int       i, g;
+
+	for (i = 0;  i < 16;  i++)
+		w[i] = get_le32 (block + i * 4);
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	for (i = 0;  i < 64;  i++) {
+		if (i < 16) {
+			f = (b & c) | (~b & d);
+			g = i;
+		}
+		else if (i < 32) {
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) & 15;
+		}
+		else if (i < 48) {
+			f = b ^ c ^ d;
+			g = (3 * i + 5) & 15;
+		}
+		else {
+			f = c ^ (b | ~d);
+			g = (7 * i) & 15;
+		}
+		temp = d;
+		d = c;
+		c = b;
+		b = b + ROTL32 (a + f + md5_k[i] + w[g], md5_r[i]);
+		a = temp;
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+// ----------------------------------------------------------------------------
+// SHA-1 (FIPS 180-4)
+
+static void  sha1_block (uint32_t* state, const uint8_t* block)
+{
+	uint32_t  w[80];
+	uint32_t  a, b, c, d, e, f, k, temp;
+	int       i;
+
+	for (i = 0;  i < 16;  i++)
+		w[i] = get_be32 (block + i * 4);
+	for (;  i < 80;  i++)
+		w[i] = ROTL32 (w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+	e = state[4];
+	for (i = 0;  i < 80;  i++) {
+		if (i < 20) {
+			f = (b & c) | (~b & d);
+			k = 0x5a827999;
+		}
+		else if (i < 40) {
+			f = b ^ c ^ d;
+			k = 0x6ed9eba1;
+		}
+		else if (i < 60) {
+			f = (b & c) | (b & d) | (c & d);
+			k = 0x8f1bbcdc;
+		}
+		else {
+			f = b ^ c ^ d;
+			k = 0xca62c1d6;
+		}
+		temp = ROTL32 (a, 5) + f + e + k + w[i];
+		e = d;
+		d = c;
+		c = ROTL32 (b, 30);
+		b = a;
+		a = temp;
+	}
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+	state[4] += e;
+}
+
+// ----------------------------------------------------------------------------
+// SHA-256 (FIPS 180-4)
+
+static const uint32_t  sha256_k[64] =
+{
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+	0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+	0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+	0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+	0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static void  sha256_block (uint32_t* state, const uint8_t* block)
+{
+	uint32_t  w[64];
+	uint32_t  v[8];
+	uint32_t  s0, s1, t1, t2;
+	int       i;
+
+	for (i = 0;  i < 16;  i++)
+		w[i] = get_be32 (block + i * 4);
+	for (;  i < 64;  i++) {
+		s0 = ROTR32 (w[i-15], 7) ^ ROTR32 (w[i-15], 18) ^ (w[i-15] >> 3);
+		s1 = ROTR32 (w[i-2], 17) ^ ROTR32 (w[i-2], 19) ^ (w[i-2] >> 10);
+		w[i] = w[i-16] + s0 + w[i-7] + s1;
+	}
+
+	memcpy (v, state, sizeof (v));
+	for (i = 0;  i < 64;  i++) {
+		s1 = ROTR32 (v[4], 6) ^ ROTR32 (v[4], 11) ^ ROTR32 (v[4], 25);
+		t1 = v[7] + s1 + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256_k[i] + w[i];
+		s0 = ROTR32 (v[0], 2) ^ ROTR32 (v[0], 13) ^ ROTR32 (v[0], 22);
+		t2 = s0 + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+		v[7] = v[6];
+		v[6] = v[5];
+		v[5] = v[4];
+		v[4] = v[3] + t1;
+		v[3] = v[2];
+		v[2] = v[1];
+		v[1] = v[0];
+		v[0] = t1 + t2;
+	}
+	for (i = 0;  i < 8;  i++)
+		state[i] += v[i];
+}
+
+// ----------------------------------------------------------------------------
+// UgetChecksum
+
+static void  checksum_block (UgetChecksum* checksum, const uint8_t* block)
+{
+	switch (checksum->type) {
+	case UGET_CHECKSUM_MD5:
+		md5_block (checksum->state, block);
+		break;
+
+	case UGET_CHECKSUM_SHA1:
+		sha1_block (checksum->state, block);
+		break;
+
+	case UGET_CHECKSUM_SHA256:
+		sha256_block (checksum->state, block);
+		break;
+	}
+}
+
+void  uget_checksum_init (UgetChecksum* checksum, int type)
+{
+	static const uint32_t  sha256_h[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+
+	memset (checksum, 0, sizeof (UgetChecksum));
+	checksum->type = type;
+	switch (type) {
+	case UGET_CHECKSUM_SHA256:
+		memcpy (checksum->state, sha256_h, sizeof (sha256_h));
+		break;
+
+	case UGET_CHECKSUM_SHA1:
+		checksum->state[4] = 0xc3d2e1f0;
+		// fall through
+	case UGET_CHECKSUM_MD5:
+		checksum->state[0] = 0x67452301;
+		checksum->state[1] = 0xefcdab89;
+		checksum->state[2] = 0x98badcfe;
+		checksum->state[3] = 0x10325476;
+		break;
+	}
+}
+
+void  uget_checksum_update (UgetChecksum* checksum, const void* data, size_t length)
+{
+	const uint8_t*  cur = data;
+	size_t          used;
+	size_t          n;
+
+	used = (size_t) (checksum->pos & 63);
+	checksum->pos += length;
+
+	if (used) {
+		n = 64 - used;
+		if (n > length)
+			n = length;
+		memcpy (checksum->buffer + used, cur, n);
+		cur += n;
+		length -= n;
+		if (used + n < 64)
+			return;
+		checksum_block (checksum, checksum->buffer);
+	}
+
+	for (;  length >= 64;  length -= 64, cur += 64)
+		checksum_block (checksum, cur);
+	if (length)
+		memcpy (checksum->buffer, cur, length);
+}
+
+int   uget_checksum_final (UgetChecksum* checksum, char* hex)
+{
+	uint64_t  bits;
+	size_t    used;
+	int       index, n_words;
+	uint8_t   byte;
+
+	bits = (uint64_t) checksum->pos * 8;
+	used = (size_t) (checksum->pos & 63);
+	checksum->buffer[used++] = 0x80;
+	if (used > 56) {
+		memset (checksum->buffer + used, 0, 64 - used);
+		checksum_block (checksum, checksum->buffer);
+		used = 0;
+	}
+	memset (checksum->buffer + used, 0, 56 - used);
+
+	// MD5 is little-endian, SHA family is big-endian.
+	for (index = 0;  index < 8;  index++) {
+		if (checksum->type == UGET_CHECKSUM_MD5)
+			checksum->buffer[56 + index] = (uint8_t) (bits >> (index * 8));
+		else
+			checksum->buffer[63 - index] = (uint8_t) (bits >> (index * 8));
+	}
+	checksum_block (checksum, checksum->buffer);
+
+	switch (checksum->type) {
+	case UGET_CHECKSUM_MD5:
+		n_words = 4;
+		break;
+
+	case UGET_CHECKSUM_SHA1:
+		n_words = 5;
+		break;
+
+	case UGET_CHECKSUM_SHA256:
+		n_words = 8;
+		break;
+
+	default:
+		n_words = 0;
+		break;
+	}
+
+	for (index = 0;  index < n_words * 4;  index++) {
+		if (checksum->type == UGET_CHECKSUM_MD5)
+			byte = (uint8_t) (checksum->state[index >> 2] >> ((index & 3) * 8));
+		else
+			byte = (uint8_t) (checksum->state[index >> 2] >> ((3 - (index & 3)) * 8));
+		hex[index * 2]     = hex_digits[byte >> 4];
+		hex[index * 2 + 1] = hex_digits[byte & 15];
+	}
+	hex[index * 2] = 0;
+	return index * 2;
+}
+
+// return UgetChecksumType by name, e.g. "md5", "sha-1", "sha-256"
+static int  checksum_type (const char* name, int length)
+{
+	static const struct {
+		const char*  name;
+		int          type;
+	} names[] = {
+		{"md5",     UGET_CHECKSUM_MD5},
+		{"sha-1",   UGET_CHECKSUM_SHA1},
+		{"sha1",    UGET_CHECKSUM_SHA1},
+		{"sha-256", UGET_CHECKSUM_SHA256},
+		{"sha256",  UGET_CHECKSUM_SHA256},
+	};
+	int  index;
+
+	for (index = 0;  index < (int) (sizeof (names) / sizeof (names[0]));  index++) {
+		if (strlen (names[index].name) == (size_t) length &&
+		    strncasecmp (names[index].name, name, length) == 0)
+		{
+			return names[index].type;
+		}
+	}
+	return UGET_CHECKSUM_NONE;
+}
+
+int   uget_checksum_parse (const char* string, char* hex)
+{
+	const char*  digest;
+	int          type = UGET_CHECKSUM_NONE;
+	int          index, length;
+
+	if (string == NULL)
+		return UGET_CHECKSUM_NONE;
+	while (isspace ((unsigned char) string[0]))
+		string++;
+
+	// type=HEX or type:HEX
+	digest = strpbrk (string, "=:");
+	if (digest) {
+		type = checksum_type (string, (int) (digest - string));
+		if (type == UGET_CHECKSUM_NONE)
+			return UGET_CHECKSUM_NONE;
+		string = digest + 1;
+	}
+
+	for (length = 0;  isxdigit ((unsigned char) string[length]);  length++) {
+		if (length == UGET_CHECKSUM_HEX_MAX - 1)
+			return UGET_CHECKSUM_NONE;
+		hex[length] = (char) tolower ((unsigned char) string[length]);
+	}
+	hex[length] = 0;
+	// allow trailing space only
+	for (index = length;  string[index];  index++) {
+		if (isspace ((unsigned char) string[index]) == 0)
+			return UGET_CHECKSUM_NONE;
+	}
+
+	switch (length) {
+	case 32:
+		if (type == UGET_CHECKSUM_NONE || type == UGET_CHECKSUM_MD5)
+			return UGET_CHECKSUM_MD5;
+		break;
+
+	case 40:
+		if (type == UGET_CHECKSUM_NONE || type == UGET_CHECKSUM_SHA1)
+			return UGET_CHECKSUM_SHA1;
+		break;
+
+	case 64:
+		if (type == UGET_CHECKSUM_NONE || type == UGET_CHECKSUM_SHA256)
+			return UGET_CHECKSUM_SHA256;
+		break;
+	}
+	return UGET_CHECKSUM_NONE;
+}
+
+// ----------------------------------------------------------------------------
+// UgetChecksumPieces
+
+void  uget_checksum_pieces_init (UgetChecksumPieces* pieces)
+{
+	memset (pieces, 0, sizeof (UgetChecksumPieces));
+}
+
+void  uget_checksum_pieces_clear (UgetChecksumPieces* pieces)
+{
+	ug_free (pieces->hex);
+	uget_checksum_pieces_init (pieces);
+}
+
+int   uget_checksum_pieces_parse (UgetChecksumPieces* pieces, const char* string)
+{
+	const char*  end;
+	char*        hex;
+	int          length;
+
+	uget_checksum_pieces_clear (pieces);
+	if (string == NULL)
+		return FALSE;
+
+	// TYPE:
+	end = strchr (string, ':');
+	if (end == NULL)
+		return FALSE;
+	pieces->type = checksum_type (string, (int) (end - string));
+	switch (pieces->type) {
+	case UGET_CHECKSUM_MD5:
+		pieces->hex_len = 32;
+		break;
+
+	case UGET_CHECKSUM_SHA1:
+		pieces->hex_len = 40;
+		break;
+
+	case UGET_CHECKSUM_SHA256:
+		pieces->hex_len = 64;
+		break;
+
+	default:
+		return FALSE;
+	}
+	// LENGTH:
+	string = end + 1;
+	pieces->length = (uint32_t) strtoul (string, (char**) &end, 10);
+	if (end[0] != ':' || pieces->length == 0) {
+		uget_checksum_pieces_clear (pieces);
+		return FALSE;
+	}
+	string = end + 1;
+
+	// HEX,HEX,...  allocate enough space by length of string.
+	pieces->hex = ug_malloc (strlen (string) + 1);
+	hex = pieces->hex;
+	for (;;) {
+		while (string[0] == ',' || isspace ((unsigned char) string[0]))
+			string++;
+		if (string[0] == 0)
+			break;
+		for (length = 0;  isxdigit ((unsigned char) string[length]);  length++)
+			hex[length] = (char) tolower ((unsigned char) string[length]);
+		if (length != pieces->hex_len) {
+			uget_checksum_pieces_clear (pieces);
+			return FALSE;
+		}
+		hex += length;
+		string += length;
+		pieces->n_pieces++;
+	}
+	if (pieces->n_pieces == 0) {
+		uget_checksum_pieces_clear (pieces);
+		return FALSE;
+	}
+	return TRUE;
+}
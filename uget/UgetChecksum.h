@@ -0,0 +1,107 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+// MD5, SHA-1 and SHA-256 digests for verifying downloaded file
+#ifndef UGET_CHECKSUM_H
+#define UGET_CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct UgetChecksum        UgetChecksum;
+typedef struct UgetChecksumPieces  UgetChecksumPieces;
+
+typedef enum {
+	UGET_CHECKSUM_NONE,
+	UGET_CHECKSUM_MD5,
+	UGET_CHECKSUM_SHA1,
+	UGET_CHECKSUM_SHA256,
+} UgetChecksumType;
+
+// length of hex digest string (include null-terminated)
+#define UGET_CHECKSUM_HEX_MAX    65
+
+/* ----------------------------------------------------------------------------
+   UgetChecksum: data must be added in order. Member 'pos' is the number of
+                 bytes have been added, it is also file offset of next data.
+ */
+
+struct UgetChecksum
+{
+	int        type;         // UgetChecksumType
+	int64_t    pos;
+
+	uint32_t   state[8];
+	uint8_t    buffer[64];
+};
+
+void  uget_checksum_init (UgetChecksum* checksum, int type);
+void  uget_checksum_update (UgetChecksum* checksum, const void* data, size_t length);
+// write lowercase hex digest to 'hex'. return length of digest string.
+int   uget_checksum_final (UgetChecksum* checksum, char* hex);
+
+// parse "md5=HEX", "sha-1=HEX", "sha-256:HEX" or bare HEX (type is decided by
+// length). write lowercase HEX to 'hex' and return UgetChecksumType.
+int   uget_checksum_parse (const char* string, char* hex);
+
+/* ----------------------------------------------------------------------------
+   UgetChecksumPieces: expected digest of each piece, like <pieces> of Metalink.
+                       The string format is "TYPE:LENGTH:HEX,HEX,..."
+ */
+
+struct UgetChecksumPieces
+{
+	int        type;        // UgetChecksumType
+	int        hex_len;     // length of each hex digest
+	uint32_t   length;      // piece length
+	uint32_t   n_pieces;
+	char*      hex;         // n_pieces * hex_len, not null-terminated
+};
+
+void  uget_checksum_pieces_init (UgetChecksumPieces* pieces);
+void  uget_checksum_pieces_clear (UgetChecksumPieces* pieces);
+// return FALSE if string is invalid.
+int   uget_checksum_pieces_parse (UgetChecksumPieces* pieces, const char* string);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // End of UGET_CHECKSUM_H
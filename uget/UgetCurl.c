@@ -39,13 +39,30 @@
 #include <UgStdio.h>
 #include <UgetCurl.h>
 
+#if defined _WIN32 || defined _WIN64
+#include <windows.h>    // Sleep(), GetSystemInfo()
+#define  ug_sleep       Sleep
+#else
+#include <unistd.h>     // usleep(), sysconf()
+#include <sys/stat.h>   // fstat()
+#include <sys/mman.h>   // mmap(), msync()
+#define  ug_sleep(millisecond)    usleep(millisecond * 1000)
+#define  OUTPUT_MMAP    1
+#endif // _WIN32 || _WIN64
+
+#if defined(_MSC_VER)
+#define strtoll		_strtoi64    // stdlib.h
+#endif
+
 #ifdef HAVE_LIBPWMD
 #include "pwmd.h"
 #endif  // HAVE_LIBPWMD
 
-#define PROGRESS_COUNT_LIMIT    2
 #define LOW_SPEED_LIMIT         128
 #define LOW_SPEED_TIME          60
+// If end of segment was cut and requested Range has less than this beyond
+// it, receive and discard the rest instead of aborting the connection.
+#define RANGE_DRAIN_SIZE        (64 * 1024)
 
 enum SchemeType
 {
@@ -68,12 +85,23 @@ static size_t uget_curl_output_none (char *buffer, size_t size,
                                      size_t nmemb, void* data);
 static size_t uget_curl_output_default (char *buffer, size_t size,
                                         size_t nmemb, void* data);
+static int    uget_curl_range_is_large (UgetCurl* ugcurl, int64_t end);
 static int    uget_curl_progress (UgetCurl* ugcurl,
-                                  double  dltotal, double  dlnow,
-                                  double  ultotal, double  ulnow);
+                                  curl_off_t  dltotal, curl_off_t  dlnow,
+                                  curl_off_t  ultotal, curl_off_t  ulnow);
+#if LIBCURL_VERSION_NUM < 0x072000    // 7.32.0
+static int    uget_curl_progress_double (UgetCurl* ugcurl,
+                                         double  dltotal, double  dlnow,
+                                         double  ultotal, double  ulnow);
+#endif
 #ifdef HAVE_LIBPWMD
 static int  uget_curl_set_proxy_pwmd (UgetCurl* ugcurl, UgetProxy *proxy);
 #endif
+static int    uget_curl_engine_add (UgetCurl* ugcurl);
+static void   uget_curl_engine_pause (UgetCurl* ugcurl, int milliseconds);
+static void   uget_curl_apply_speed (UgetCurl* ugcurl);
+static void   uget_curl_output_map (UgetCurlOutput* output, const char* path);
+static void   uget_curl_output_unmap (UgetCurlOutput* output);
 
 UgetCurl*  uget_curl_new (void)
 {
@@ -83,6 +111,8 @@ UgetCurl*  uget_curl_new (void)
 	ugcurl->self = ugcurl;
 	ugcurl->curl = curl_easy_init ();
 	curl_easy_setopt (ugcurl->curl, CURLOPT_ERRORBUFFER, ugcurl->error_string);
+	// curl_multi engine use this to get UgetCurl from CURL easy handle
+	curl_easy_setopt (ugcurl->curl, CURLOPT_PRIVATE, ugcurl);
 //	ugcurl->ftp_command = NULL;
 //	ugcurl->ftp_command = curl_slist_append (ugcurl->ftp_command, "REST 10");
 
@@ -93,8 +123,7 @@ void  uget_curl_free (UgetCurl* ugcurl)
 {
 	if (ugcurl->curl)
 		curl_easy_cleanup (ugcurl->curl);
-	if (ugcurl->file.output)
-		ug_fclose (ugcurl->file.output);
+	uget_curl_close_file (ugcurl);
 	if (ugcurl->file.post)
 		ug_fclose (ugcurl->file.post);
 	if (ugcurl->event)
@@ -104,19 +133,100 @@ void  uget_curl_free (UgetCurl* ugcurl)
 	ug_free (ugcurl);
 }
 
-static UgThreadResult  uget_curl_thread (UgetCurl* ugcurl)
+void  uget_curl_reset (UgetCurl* ugcurl, int all)
 {
-	char*     tempstr;
-	CURLcode  code;
+	uget_curl_close_file (ugcurl);
+	if (ugcurl->event) {
+		uget_event_free (ugcurl->event);
+		ugcurl->event = NULL;
+	}
+	ugcurl->next = NULL;
+	ugcurl->prev = NULL;
+	ugcurl->engine.worker = NULL;
+	ugcurl->engine.next = NULL;
+	ugcurl->engine.resume = 0;
+	uget_curl_set_beg (ugcurl, 0);
+	uget_curl_set_end (ugcurl, 0);
+	ugcurl->pos = 0;
+	ugcurl->range_end = 0;
+	ugcurl->wasted = 0;
+	ugcurl->size[0] = 0;
+	ugcurl->size[1] = 0;
+	ugcurl->speed[0] = 0;
+	ugcurl->speed[1] = 0;
+	ugcurl->response = 0;
+	ugcurl->event_code = 0;
+	ugcurl->state = UGET_CURL_READY;
+	ugcurl->restart = FALSE;
+	ugcurl->paused = FALSE;
+	ugcurl->split = FALSE;
+	ugcurl->endgame = FALSE;
+	ugcurl->html = FALSE;
+	// post data must be sent from beginning again
+	if (ugcurl->file.post)
+		rewind (ugcurl->file.post);
 
-	// perform
-	do {
-		ugcurl->restart = FALSE;
-		code = curl_easy_perform (ugcurl->curl);
-		curl_easy_getinfo (ugcurl->curl, CURLINFO_RESPONSE_CODE,
-				&ugcurl->response);
-		ugcurl->tested = TRUE;
-	} while (ugcurl->restart);
+	if (all == FALSE)
+		return;
+	if (ugcurl->file.post) {
+		ug_fclose (ugcurl->file.post);
+		ugcurl->file.post = NULL;
+	}
+	ug_free (ugcurl->header.uri);
+	ug_free (ugcurl->header.filename);
+	ugcurl->header.uri = NULL;
+	ugcurl->header.filename = NULL;
+	ugcurl->header.size = 0;
+	ugcurl->common = NULL;
+	ugcurl->http = NULL;
+	ugcurl->ftp = NULL;
+	ugcurl->notify = NULL;
+	ugcurl->bucket = NULL;
+	ugcurl->buffer_size = 0;
+	ugcurl->file.output = NULL;
+	ugcurl->prepare.func = NULL;
+	ugcurl->prepare.data = NULL;
+	ugcurl->uri.link = NULL;
+	ugcurl->uri.host = NULL;
+	uget_curl_set_speed (ugcurl, 0, 0);
+	ug_atomic_store_int (&ugcurl->limit_changed, FALSE);
+	ugcurl->header_store = FALSE;
+	ugcurl->tested = FALSE;
+	ugcurl->test_ok = FALSE;
+	ugcurl->resumable = FALSE;
+	// curl_easy_reset() keep live connections, DNS cache, cookies and
+	// share handle. Handle may be used by other download, erase cookies.
+	curl_easy_setopt (ugcurl->curl, CURLOPT_COOKIELIST, "ALL");
+	curl_easy_reset (ugcurl->curl);
+	curl_easy_setopt (ugcurl->curl, CURLOPT_ERRORBUFFER, ugcurl->error_string);
+	curl_easy_setopt (ugcurl->curl, CURLOPT_PRIVATE, ugcurl);
+}
+
+// UgetCurlNotify::mutex protect state, UgetPluginCurl may free UgetCurl
+// after state changed. Don't access UgetCurl after calling this function.
+static void  uget_curl_set_state (UgetCurl* ugcurl, uint8_t state)
+{
+	UgetCurlNotify*  notify;
+
+	notify = ugcurl->notify;
+	if (notify == NULL) {
+		ugcurl->state = state;
+		return;
+	}
+	ug_mutex_lock (&notify->mutex);
+	ugcurl->state = state;
+	notify->count++;
+	ug_cond_signal (&notify->cond);
+	ug_mutex_unlock (&notify->mutex);
+}
+
+// decide UgetCurl::state by result of transfer.
+// UgetCurl::state must be set at last, UgetPluginCurl may free UgetCurl after it changed.
+static void  uget_curl_finish (UgetCurl* ugcurl, CURLcode code)
+{
+	char*     tempstr;
+	int64_t   end;
+	uint8_t   state;
 
 	// free event
 	if (ugcurl->event) {
@@ -126,35 +236,50 @@ static UgThreadResult  uget_curl_thread (UgetCurl* ugcurl)
 
 	// HTTP response error code: 4xx Client Error, 5xx Server Error
 	if (ugcurl->response >= 400 && ugcurl->scheme_type == SCHEME_HTTP) {
-		ugcurl->state = UGET_CURL_ERROR;
+		state = UGET_CURL_ERROR;
 		tempstr = ug_strdup_printf ("Server response code : %ld",
 				ugcurl->response);
 		ugcurl->event = uget_event_new_error (
 				UGET_EVENT_ERROR_CUSTOM, tempstr);
 		ug_free (tempstr);
 		// discard data if remote site response error.
-		ugcurl->pos = ugcurl->beg;
-		ugcurl->size[0] = 0;
+		uget_curl_reset_progress (ugcurl,
+				ug_atomic_load_int64 (&ugcurl->beg));
 		goto exit;
 	}
 
+	// header callback abort transfer if server ignore bounded Range request.
+	if (code == CURLE_WRITE_ERROR && ugcurl->range_end && ugcurl->response == 200)
+		code = CURLE_RANGE_ERROR;
+
 	switch (code) {
 	case CURLE_OK:
-		ugcurl->state = UGET_CURL_OK;
+		state = UGET_CURL_OK;
 		break;
 
 	// write error (out of disk space?) (exit)
 	case CURLE_WRITE_ERROR:
 		if (ugcurl->event_code > 0) {
-			ugcurl->state = UGET_CURL_ERROR;
+			state = UGET_CURL_ERROR;
 			ugcurl->event = uget_event_new_error (ugcurl->event_code, NULL);
 			ugcurl->test_ok = FALSE;
 			break;
 		}
+		// write callback abort transfer that paused by user
+		if (ugcurl->paused) {
+			state = UGET_CURL_ABORT;
+			break;
+		}
+		// write callback abort transfer at the end of segment
+		end = ug_atomic_load_int64 (&ugcurl->end);
+		if (ugcurl->writing && end > 0 && ugcurl->file.offset >= end) {
+			state = UGET_CURL_OK;
+			break;
+		}
 		// Don't break here
 	// out of memory (exit)
 	case CURLE_OUT_OF_MEMORY:
-		ugcurl->state = UGET_CURL_ERROR;
+		state = UGET_CURL_ERROR;
 		ugcurl->event = uget_event_new_error (
 				UGET_EVENT_ERROR_OUT_OF_RESOURCE, NULL);
 		break;
@@ -163,30 +288,30 @@ static UgThreadResult  uget_curl_thread (UgetCurl* ugcurl)
 	case CURLE_ABORTED_BY_CALLBACK:
 		// segment is completed or paused by user
 		if (ugcurl->paused == FALSE)
-			ugcurl->state = UGET_CURL_OK;
+			state = UGET_CURL_OK;
 		else
-			ugcurl->state = UGET_CURL_ABORT;
+			state = UGET_CURL_ABORT;
 		break;
 
 	// can resume (retry)
 	case CURLE_RECV_ERROR:
 	case CURLE_PARTIAL_FILE:
 	case CURLE_OPERATION_TIMEDOUT:
-		ugcurl->state = UGET_CURL_RETRY;
+		state = UGET_CURL_RETRY;
 		break;
 
 	// can't resume (retry)
 	case CURLE_RANGE_ERROR:
 	case CURLE_BAD_DOWNLOAD_RESUME:
 	case CURLE_FTP_COULDNT_USE_REST:
-		ugcurl->state = UGET_CURL_NOT_RESUMABLE;
+		state = UGET_CURL_NOT_RESUMABLE;
 		ugcurl->resumable = FALSE;
 		break;
 
 #ifdef NO_RETRY_IF_CONNECT_FAILED
 	// can't connect (error)
 	case CURLE_COULDNT_CONNECT:
-		ugcurl->state = UGET_CURL_ERROR;
+		state = UGET_CURL_ERROR;
 		ugcurl->event = uget_event_new_error (
 				UGET_EVENT_ERROR_CONNECT_FAILED, ugcurl->error_string);
 		goto exit;
@@ -198,21 +323,21 @@ static UgThreadResult  uget_curl_thread (UgetCurl* ugcurl)
 	case CURLE_SEND_ERROR:
 	case CURLE_GOT_NOTHING:
 	case CURLE_BAD_CONTENT_ENCODING:
-		ugcurl->state = UGET_CURL_RETRY;
+		state = UGET_CURL_RETRY;
 		ugcurl->event = uget_event_new_error (
 				UGET_EVENT_ERROR_CUSTOM, ugcurl->error_string);
 		break;
 
 	// too many redirection (exit)
 	case CURLE_TOO_MANY_REDIRECTS:
-		ugcurl->state = UGET_CURL_ERROR;
+		state = UGET_CURL_ERROR;
 		ugcurl->event = uget_event_new_error (
 				UGET_EVENT_ERROR_CUSTOM, ugcurl->error_string);
 		break;
 
 	// exit
 	case CURLE_UNSUPPORTED_PROTOCOL:
-		ugcurl->state = UGET_CURL_ERROR;
+		state = UGET_CURL_ERROR;
 		ugcurl->event = uget_event_new_error (
 				UGET_EVENT_ERROR_UNSUPPORTED_SCHEME, ugcurl->error_string);
 		break;
@@ -227,16 +352,36 @@ static UgThreadResult  uget_curl_thread (UgetCurl* ugcurl)
 	case CURLE_FTP_WEIRD_SERVER_REPLY:
 	case CURLE_REMOTE_ACCESS_DENIED:
 	default:
-		ugcurl->state = UGET_CURL_ERROR;
+		state = UGET_CURL_ERROR;
 		ugcurl->event = uget_event_new_error (
 				UGET_EVENT_ERROR_CUSTOM, ugcurl->error_string);
 		break;
 	}
 
 exit:
-	if (ugcurl->state == UGET_CURL_ERROR)
+	if (state == UGET_CURL_ERROR)
 		ugcurl->test_ok = FALSE;
+	ug_seq_write_begin (&ugcurl->progress.seq);
+	ugcurl->progress.stopped = TRUE;
+	ug_seq_write_end (&ugcurl->progress.seq);
 	ugcurl->stopped = TRUE;
+	uget_curl_set_state (ugcurl, state);
+}
+
+static UgThreadResult  uget_curl_thread (UgetCurl* ugcurl)
+{
+	CURLcode  code;
+
+	// perform
+	do {
+		ugcurl->restart = FALSE;
+		code = curl_easy_perform (ugcurl->curl);
+		curl_easy_getinfo (ugcurl->curl, CURLINFO_RESPONSE_CODE,
+				&ugcurl->response);
+		ugcurl->tested = TRUE;
+	} while (ugcurl->restart);
+
+	uget_curl_finish (ugcurl, code);
 	return UG_THREAD_RESULT;
 }
 
@@ -248,23 +393,36 @@ void  uget_curl_run (UgetCurl* ugcurl, int joinable)
 	uget_curl_decide_login (ugcurl);
 
 	ugcurl->pos = ugcurl->beg;
+	ugcurl->file.offset = ugcurl->beg;
+	ugcurl->writing = FALSE;
 	ugcurl->state = UGET_CURL_READY;
 	ugcurl->paused = FALSE;
 	ugcurl->stopped = FALSE;    // if thread stop, this value will be TRUE.
 	ugcurl->response = 0;
 	ugcurl->event_code = 0;
-	ugcurl->progress_count = PROGRESS_COUNT_LIMIT;
 	// reset download/upload speed
 	ugcurl->speed[0] = 0;
 	ugcurl->speed[1] = 0;
 	// reset downloaded/uploaded size
 	ugcurl->size[0] = 0;
 	ugcurl->size[1] = 0;
+	// thread doesn't run yet, reset published progress directly.
+	ugcurl->progress.pos = ugcurl->beg;
+	ugcurl->progress.upload = 0;
+	ugcurl->progress.speed[0] = 0;
+	ugcurl->progress.speed[1] = 0;
+	ugcurl->progress.stopped = FALSE;
+	ugcurl->progress_loaded = FALSE;
+	uget_rate_init (&ugcurl->rate[0], UGET_RATE_WINDOW);
+	uget_rate_init (&ugcurl->rate[1], UGET_RATE_WINDOW);
+	ugcurl->written = 0;
 
 	ug_free (ugcurl->header.uri);
 	ug_free (ugcurl->header.filename);
 	ugcurl->header.uri = NULL;
 	ugcurl->header.filename = NULL;
+	ugcurl->header.size = 0;
+	ugcurl->wasted = 0;
 
 	// Others -----------------------------------------------------------------
 	curl_easy_setopt (curl, CURLOPT_NOSIGNAL, 1L);
@@ -284,12 +442,32 @@ void  uget_curl_run (UgetCurl* ugcurl, int joinable)
 	curl_easy_setopt (curl, CURLOPT_LOW_SPEED_TIME,  LOW_SPEED_TIME);
 
 	// resume
-	curl_easy_setopt (ugcurl->curl, CURLOPT_RESUME_FROM_LARGE,
-			(curl_off_t) ugcurl->beg);
+	// request bounded Range if end of segment is known. Transfer will stop
+	// at the end of segment and connection can be reused by next segment.
+	if (ugcurl->end > ugcurl->beg && ugcurl->scheme_type == SCHEME_HTTP) {
+		char  range[48];
+		snprintf (range, sizeof (range), "%lld-%lld",
+				(long long) ugcurl->beg, (long long) ugcurl->end - 1);
+		curl_easy_setopt (curl, CURLOPT_RANGE, range);
+		curl_easy_setopt (curl, CURLOPT_RESUME_FROM_LARGE, (curl_off_t) 0);
+		ugcurl->range_end = ugcurl->end;
+	}
+	else {
+		curl_easy_setopt (curl, CURLOPT_RANGE, NULL);
+		curl_easy_setopt (curl, CURLOPT_RESUME_FROM_LARGE,
+				(curl_off_t) ugcurl->beg);
+		ugcurl->range_end = 0;
+	}
 	// Progress  --------------------------------------------------------------
+#if LIBCURL_VERSION_NUM >= 0x072000    // 7.32.0
+	curl_easy_setopt (curl, CURLOPT_XFERINFOFUNCTION,
+			(curl_xferinfo_callback) uget_curl_progress);
+	curl_easy_setopt (curl, CURLOPT_XFERINFODATA, ugcurl);
+#else
 	curl_easy_setopt (curl, CURLOPT_PROGRESSFUNCTION,
-			(curl_progress_callback) uget_curl_progress);
+			(curl_progress_callback) uget_curl_progress_double);
 	curl_easy_setopt (curl, CURLOPT_PROGRESSDATA, ugcurl);
+#endif
 	curl_easy_setopt (curl, CURLOPT_NOPROGRESS, FALSE);
 
 	// Header -----------------------------------------------------------------
@@ -333,20 +511,20 @@ void  uget_curl_run (UgetCurl* ugcurl, int joinable)
 	}
 
 	// Speed limit ------------------------------------------------------------
-	if (ugcurl->limit_changed) {
-		curl_easy_setopt (ugcurl->curl, CURLOPT_MAX_RECV_SPEED_LARGE,
-				(curl_off_t) ugcurl->limit[0]);
-		curl_easy_setopt (ugcurl->curl, CURLOPT_MAX_SEND_SPEED_LARGE,
-				(curl_off_t) ugcurl->limit[1]);
-		ugcurl->limit_changed = FALSE;
-	}
+	uget_curl_apply_speed (ugcurl);
 
 	// Output -----------------------------------------------------------------
+	if (ugcurl->buffer_size > 0)
+		curl_easy_setopt (curl, CURLOPT_BUFFERSIZE, (long) ugcurl->buffer_size);
 	curl_easy_setopt (curl, CURLOPT_NOBODY, 0L);
 	curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION,
 	                        uget_curl_output_default);
 	curl_easy_setopt (curl, CURLOPT_WRITEDATA, ugcurl);
 
+	// curl_multi engine
+	if (joinable == FALSE && uget_curl_engine_add (ugcurl))
+		return;
+
 	ug_thread_create (&ugcurl->thread, (UgThreadFunc)uget_curl_thread, ugcurl);
 	if (joinable == FALSE)
 		ug_thread_unjoin (&ugcurl->thread);
@@ -354,26 +532,44 @@ void  uget_curl_run (UgetCurl* ugcurl, int joinable)
 
 int  uget_curl_open_file (UgetCurl* ugcurl, const char* file_path)
 {
-	FILE*  output_file;
+	UgetCurlOutput*  output;
 
-	if (ugcurl->file.output)
+	if (ugcurl->opened || file_path == NULL)
 		return TRUE;
-
-	if (file_path) {
-		output_file = ug_fopen (file_path, "rb+");
-		if (output_file == NULL)
-			return FALSE;
-		ugcurl->file.output = output_file;
+	output = ugcurl->file.output;
+	if (output == NULL)
+		return FALSE;
+
+	ug_mutex_lock (&output->mutex);
+	if (output->fd == -1) {
+		output->fd = ug_open (file_path, UG_O_WRONLY | UG_O_BINARY, 0);
+		// write through page cache if O_DIRECT is not supported.
+		if (output->fd != -1 && output->writer && output->direct)
+			uget_writer_file_open_direct (output->writer, file_path);
+		// use pwrite() if file can't be mapped.
+		if (output->fd != -1 && output->mapped)
+			uget_curl_output_map (output, file_path);
 	}
-	return TRUE;
+	if (output->fd != -1) {
+		output->ref_count++;
+		ugcurl->opened = TRUE;
+	}
+	ug_mutex_unlock (&output->mutex);
+	return ugcurl->opened;
 }
 
 void  uget_curl_close_file (UgetCurl* ugcurl)
 {
-	if (ugcurl->file.output) {
-		ug_fclose (ugcurl->file.output);
-		ugcurl->file.output = NULL;
-	}
+	UgetCurlOutput*  output;
+
+	if (ugcurl->opened == FALSE)
+		return;
+	ugcurl->opened = FALSE;
+	output = ugcurl->file.output;
+
+	ug_mutex_lock (&output->mutex);
+	uget_curl_output_unref (output);
+	ug_mutex_unlock (&output->mutex);
 }
 
 void  uget_curl_set_url (UgetCurl* ugcurl, const char* uri)
@@ -386,9 +582,23 @@ void  uget_curl_set_url (UgetCurl* ugcurl, const char* uri)
 
 void  uget_curl_set_speed (UgetCurl* ugcurl, int64_t dlspeed, int64_t ulspeed)
 {
-	ugcurl->limit[0] = dlspeed;
-	ugcurl->limit[1] = ulspeed;
-	ugcurl->limit_changed = TRUE;
+	ug_atomic_store_int64 (&ugcurl->limit[0], dlspeed);
+	ug_atomic_store_int64 (&ugcurl->limit[1], ulspeed);
+	ug_atomic_store_int (&ugcurl->limit_changed, TRUE);
+}
+
+// curl thread apply speed limit that changed by uget_curl_set_speed()
+static void  uget_curl_apply_speed (UgetCurl* ugcurl)
+{
+	if (ug_atomic_load_int (&ugcurl->limit_changed) == FALSE)
+		return;
+	// clear flag before reading limit, new change will set it again.
+	ug_atomic_store_int (&ugcurl->limit_changed, FALSE);
+	ug_atomic_fence ();
+	curl_easy_setopt (ugcurl->curl, CURLOPT_MAX_RECV_SPEED_LARGE,
+			(curl_off_t) ug_atomic_load_int64 (&ugcurl->limit[0]));
+	curl_easy_setopt (ugcurl->curl, CURLOPT_MAX_SEND_SPEED_LARGE,
+			(curl_off_t) ug_atomic_load_int64 (&ugcurl->limit[1]));
 }
 
 void  uget_curl_set_common (UgetCurl* ugcurl, UgetCommon* common)
@@ -671,24 +881,41 @@ void  ug_curl_set_proxy (CURL* curl, UgetProxy* proxy)
 // ----------------------------------------------------------------------------
 // static functions
 
-static size_t uget_curl_header_http (char *buffer, size_t size,
-                                     size_t nmemb, UgetCurl* ugcurl)
+// handle HTTP status line and "Content-Range:" for bounded Range request.
+// return FALSE to abort the transfer.
+static int  uget_curl_header_range (UgetCurl* ugcurl, char* buffer, size_t length)
 {
-	long  response;
-
-	curl_easy_getinfo (ugcurl->curl, CURLINFO_RESPONSE_CODE, &response);
+	long   response;
+	char*  total;
 
-	// This will abort the transfer and return CURL_WRITE_ERROR.
-	if (response >= 400) {
+	if (length > 5 && strncmp (buffer, "HTTP/", 5) == 0) {
+		curl_easy_getinfo (ugcurl->curl, CURLINFO_RESPONSE_CODE, &response);
 		ugcurl->response = response;
-		return 0;
+		if (response >= 400)
+			return FALSE;
+		// server ignore Range request and send whole file.
+		if (response == 200 && ugcurl->range_end) {
+			if (ug_atomic_load_int64 (&ugcurl->beg) > 0)
+				return FALSE;
+			// data begin at 0, it is the same as open-ended Range request.
+			ugcurl->range_end = 0;
+		}
 	}
-	else {
-		// It doesn't need to parse HTTP header now.
-		curl_easy_setopt (ugcurl->curl, CURLOPT_HEADERFUNCTION,
-				(curl_write_callback) NULL);
-		curl_easy_setopt (ugcurl->curl, CURLOPT_HEADERDATA, NULL);
+	else if (length > 15 && strncasecmp (buffer, "Content-Range: ", 15) == 0) {
+		// Content-Range: bytes 0-1023/4096
+		total = memchr (buffer, '/', length);
+		if (total && total[1] != '*')
+			ugcurl->header.size = strtoll (total + 1, NULL, 10);
 	}
+	return TRUE;
+}
+
+static size_t uget_curl_header_http (char *buffer, size_t size,
+                                     size_t nmemb, UgetCurl* ugcurl)
+{
+	// This will abort the transfer and return CURL_WRITE_ERROR.
+	if (uget_curl_header_range (ugcurl, buffer, size * nmemb) == FALSE)
+		return 0;
 	return (size_t)(size * nmemb);
 }
 
@@ -702,13 +929,9 @@ static size_t uget_curl_header_http0 (char *buffer, size_t size,
 	file   = NULL;
 	length = strlen (buffer);
 
-	if (ugcurl->response == 0) {
-		curl_easy_getinfo (ugcurl->curl, CURLINFO_RESPONSE_CODE,
-				&ugcurl->response);
-		// This will abort the transfer and return CURL_WRITE_ERROR.
-		if (ugcurl->response >= 400)
-			return 0;
-	}
+	// This will abort the transfer and return CURL_WRITE_ERROR.
+	if (uget_curl_header_range (ugcurl, buffer, size * nmemb) == FALSE)
+		return 0;
 
 	if (length > 15 && strncasecmp (buffer, "Accept-Ranges: ", 15) == 0) {
 		buffer += 15;
@@ -815,11 +1038,134 @@ static size_t uget_curl_output_none (char *buffer, size_t size,
 	return nmemb * size;
 }
 
+// return TRUE if transfer reached end of segment must be aborted.
+// bounded Range request will complete by itself. If the rest of it is small,
+// write callback discard it and connection is kept.
+static int  uget_curl_range_is_large (UgetCurl* ugcurl, int64_t end)
+{
+	if (ugcurl->range_end < end || ugcurl->range_end - end > RANGE_DRAIN_SIZE)
+		return TRUE;
+	return FALSE;
+}
+
+// write data by position, it doesn't need seek and FILE buffer.
+static size_t uget_curl_output_pwrite (char *buffer, size_t size,
+                                       size_t nmemb, void* data)
+{
+	UgetCurl*  ugcurl = data;
+	size_t     length;
+	size_t     done;
+	int64_t    end;
+	int64_t    offset;
+	int        written;
+
+	length = size * nmemb;
+	// discard data beyond the end of segment, it belongs to next segment.
+	end = ug_atomic_load_int64 (&ugcurl->end);
+	if (end > 0 && ugcurl->file.offset + (int64_t) length > end) {
+		if (ugcurl->file.offset >= end)
+			done = length;
+		else
+			done = (size_t) (ugcurl->file.offset + length - end);
+		ugcurl->wasted += done;
+		length -= done;
+		// abort transfer if the rest of Range is large. Throttled transfer
+		// may not reach progress callback soon.
+		if (length == 0 && uget_curl_range_is_large (ugcurl, end))
+			return 0;
+	}
+
+	offset = ugcurl->file.offset;
+	// copy data to memory-mapped file, kernel write dirty pages later.
+	if (ugcurl->file.output->map.addr &&
+	    offset + (int64_t) length <= ugcurl->file.output->map.size)
+	{
+		memcpy (ugcurl->file.output->map.addr + offset, buffer, length);
+		ugcurl->file.offset += length;
+		done = length;
+	}
+	// io_uring copy data and write it later.
+	else if (ugcurl->file.output->uring) {
+		if (uget_uring_write (ugcurl->file.output->uring,
+		                      ugcurl->file.output->fd, buffer, length, offset))
+			ugcurl->file.offset += length;
+		done = (size_t) (ugcurl->file.offset - offset);
+	}
+	// disk writer threads write copied data later.
+	else if (ugcurl->file.output->writer) {
+		if (uget_writer_file_write (ugcurl->file.output->writer,
+		                            ugcurl->file.output->fd, buffer, length, offset))
+			ugcurl->file.offset += length;
+		done = (size_t) (ugcurl->file.offset - offset);
+	}
+	else {
+		for (done = 0;  done < length;  done += written) {
+			written = ug_pwrite (ugcurl->file.output->fd, buffer + done,
+			                     (unsigned int) (length - done),
+			                     ugcurl->file.offset);
+			if (written <= 0)
+				break;
+			ugcurl->file.offset += written;
+		}
+	}
+	ugcurl->written += done;
+	// hash data while it is still in memory.
+	if (ugcurl->file.output->checksum && done > 0)
+		uget_curl_output_digest (ugcurl->file.output, buffer, offset, done);
+	// If it return size that is not equal to length,
+	// the transfer will be aborted and return CURL_WRITE_ERROR.
+	if (done < length)
+		return done;
+	return size * nmemb;
+}
+
+// return TRUE if transfer must be paused until ugcurl->engine.resume.
+static int  uget_curl_throttle (UgetCurl* ugcurl)
+{
+	int  wait;
+	int  interval;
+
+	wait = uget_bucket_wait (ugcurl->bucket);
+	if (wait == 0 || ugcurl->paused)
+		return FALSE;
+	// curl_multi engine: worker will resume it later.
+	if (ugcurl->engine.worker) {
+		uget_curl_engine_pause (ugcurl, wait);
+		return TRUE;
+	}
+	// own thread: sleep, but don't block user's pause request too long.
+	// libcurl doesn't call progress callback until it's buffer is empty,
+	// update progress here.
+	for (;  wait > 0 && ugcurl->paused == FALSE;  wait -= interval) {
+		interval = (wait > 100) ? 100 : wait;
+		ug_sleep (interval);
+		uget_curl_progress (ugcurl, 0, (curl_off_t) ugcurl->written,
+				0, (curl_off_t) ugcurl->progress.upload);
+	}
+	return FALSE;
+}
+
 static size_t uget_curl_output_default (char *buffer, size_t size,
 										size_t nmemb, void* data)
 {
 	UgetCurl*  ugcurl = data;
-	FILE*      file;
+	size_t     written;
+
+	// file has been prepared in previous call.
+	if (ugcurl->writing) {
+		if (ugcurl->bucket == NULL)
+			return uget_curl_output_pwrite (buffer, size, nmemb, data);
+		// libcurl will pass the same data again after unpausing.
+		if (uget_curl_throttle (ugcurl))
+			return CURL_WRITEFUNC_PAUSE;
+		// paused by user, don't write data without limit until
+		// progress callback abort transfer.
+		if (ugcurl->paused)
+			return 0;
+		written = uget_curl_output_pwrite (buffer, size, nmemb, data);
+		uget_bucket_take (ugcurl->bucket, written);
+		return written;
+	}
 
 	ugcurl->tested = TRUE;    // This URL was tested.
 	// prepare
@@ -830,67 +1176,562 @@ static size_t uget_curl_output_default (char *buffer, size_t size,
 	}
 	ugcurl->test_ok = TRUE;   // This URL is OK.
 
-	file = ugcurl->file.output;
-	if (file == NULL) {
+	if (ugcurl->opened == FALSE) {
 		ugcurl->event_code = UGET_EVENT_ERROR_NO_OUTPUT_FILE;
 		// This will abort the transfer and return CURL_WRITE_ERROR.
 		return 0;
 	}
-	// file offset
-	ug_fseek (file, ugcurl->pos, SEEK_SET);
+	// file offset. Don't use ugcurl->pos here, libcurl may count received
+	// data in progress callback before it was passed to write callback.
+	// Changing CURLOPT_WRITEFUNCTION here doesn't take effect immediately,
+	// use flag to skip preparing in next call.
+	ugcurl->file.offset = ug_atomic_load_int64 (&ugcurl->beg);
+	ugcurl->writing = TRUE;
+
+	return uget_curl_output_pwrite (buffer, size, nmemb, data);
+}
 
-#if defined(_MSC_VER) && !defined(__MINGW32__)	// for MS VC only
-	curl_easy_setopt (ugcurl->curl, CURLOPT_WRITEFUNCTION, fwrite);
+static int    uget_curl_progress (UgetCurl* ugcurl,
+                                  curl_off_t  dltotal, curl_off_t  dlnow,
+                                  curl_off_t  ultotal, curl_off_t  ulnow)
+{
+	int64_t   pos;
+	int64_t   end;
+	int64_t   speed[2];
+	uint64_t  now;
+	int       aborted = FALSE;
+
+	// current position is the position of written data. Before the first
+	// write callback, libcurl may count received data that isn't written.
+	if (ugcurl->writing)
+		pos = ugcurl->file.offset;
+	else
+		pos = ug_atomic_load_int64 (&ugcurl->beg);
+
+	// Returning a non-zero value from this callback will cause libcurl
+	// to abort the transfer and return CURLE_ABORTED_BY_CALLBACK.
+	end = ug_atomic_load_int64 (&ugcurl->end);
+	if (end > 0 && pos >= end) {
+		pos = end;
+		if (ugcurl->paused || uget_curl_range_is_large (ugcurl, end))
+			aborted = TRUE;
+	}
+	else if (ugcurl->paused)
+		aborted = TRUE;
+
+	// CURLINFO_SPEED_xxx is average of whole transfer, it lags behind
+	// rate changes. Estimate current speed from written bytes, libcurl's
+	// dlnow may count data that isn't passed to write callback yet.
+	now = ug_get_time_count ();
+	speed[0] = uget_rate_update (&ugcurl->rate[0], ugcurl->written, now);
+	speed[1] = uget_rate_update (&ugcurl->rate[1], ulnow, now);
+
+	ug_seq_write_begin (&ugcurl->progress.seq);
+	ugcurl->progress.pos = pos;
+	ugcurl->progress.upload = ulnow;
+	ugcurl->progress.speed[0] = speed[0];
+	ugcurl->progress.speed[1] = speed[1];
+	ug_seq_write_end (&ugcurl->progress.seq);
+	// publish position before state, plug-in split running segment by it.
+	if (ugcurl->state != UGET_CURL_RUN && (dlnow > 0 || ulnow > 0))
+		uget_curl_set_state (ugcurl, UGET_CURL_RUN);
+
+	// speed limit changed
+	uget_curl_apply_speed (ugcurl);
+
+	return aborted;
+}
+
+#if LIBCURL_VERSION_NUM < 0x072000    // 7.32.0
+static int    uget_curl_progress_double (UgetCurl* ugcurl,
+                                         double  dltotal, double  dlnow,
+                                         double  ultotal, double  ulnow)
+{
+	return uget_curl_progress (ugcurl,
+			(curl_off_t) dltotal, (curl_off_t) dlnow,
+			(curl_off_t) ultotal, (curl_off_t) ulnow);
+}
+#endif
+
+void  uget_curl_load_progress (UgetCurl* ugcurl)
+{
+	UgSeq  seq;
+	int    stopped;
+
+	if (ugcurl->progress_loaded)
+		return;
+	do {
+		seq = ug_seq_read_begin (&ugcurl->progress.seq);
+		ugcurl->pos      = ugcurl->progress.pos;
+		ugcurl->size[1]  = ugcurl->progress.upload;
+		ugcurl->speed[0] = ugcurl->progress.speed[0];
+		ugcurl->speed[1] = ugcurl->progress.speed[1];
+		stopped = ugcurl->progress.stopped;
+	} while (ug_seq_read_retry (&ugcurl->progress.seq, seq));
+	ugcurl->progress_loaded = stopped;
+	// plug-in may cut range of this segment after it published progress.
+	if (ugcurl->end > 0 && ugcurl->pos > ugcurl->end)
+		ugcurl->pos = ugcurl->end;
+	// plug-in may move beg forward after it published progress.
+	if (ugcurl->pos < ugcurl->beg)
+		ugcurl->pos = ugcurl->beg;
+	// data before beg has been counted by plug-in (see erase_piece).
+	ugcurl->size[0] = ugcurl->pos - ugcurl->beg;
+}
+
+void  uget_curl_reset_progress (UgetCurl* ugcurl, int64_t pos)
+{
+	ug_seq_write_begin (&ugcurl->progress.seq);
+	ugcurl->progress.pos = pos;
+	ug_seq_write_end (&ugcurl->progress.seq);
+}
+
+// ----------------------------------------------------------------------------
+// UgetCurlOutput
+
+void  uget_curl_output_init (UgetCurlOutput* output)
+{
+	ug_mutex_init (&output->mutex);
+	output->fd = -1;
+	output->ref_count = 0;
+	output->checksum = NULL;
+	output->uring = NULL;
+	output->writer = NULL;
+	output->direct = FALSE;
+	output->mapped = FALSE;
+	output->map.addr = NULL;
+	output->map.size = 0;
+}
+
+void  uget_curl_output_clear (UgetCurlOutput* output)
+{
+	uget_curl_output_unmap (output);
+	if (output->uring) {
+		uget_uring_free (output->uring);
+		output->uring = NULL;
+	}
+	if (output->fd != -1) {
+		ug_close (output->fd);
+		output->fd = -1;
+	}
+	ug_mutex_clear (&output->mutex);
+}
+
+int   uget_curl_output_flush (UgetCurlOutput* output)
+{
+	if (output->writer)
+		return uget_writer_file_flush (output->writer);
+	if (output->uring)
+		return uget_uring_flush (output->uring);
+	return 0;
+}
+
+void  uget_curl_output_unref (UgetCurlOutput* output)
+{
+	if (--output->ref_count > 0)
+		return;
+	// io_uring or disk writer may still write to this file descriptor
+	uget_curl_output_flush (output);
+	if (output->writer)
+		uget_writer_file_close_direct (output->writer);
+	uget_curl_output_unmap (output);
+	ug_close (output->fd);
+	output->fd = -1;
+}
+
+static void  uget_curl_output_map (UgetCurlOutput* output, const char* path)
+{
+#ifdef OUTPUT_MMAP
+	struct stat  st;
+	void*        addr;
+	int          fd;
+
+	// mmap() need file that opened for reading and writing.
+	fd = ug_open (path, UG_O_RDWR | UG_O_BINARY, 0);
+	if (fd == -1)
+		return;
+	// all blocks must be allocated, see UgetCommon::preallocate
+	if (fstat (fd, &st) == 0 && st.st_size > 0 &&
+	    (uint64_t) st.st_size <= SIZE_MAX &&
+	    (int64_t) st.st_blocks * 512 >= (int64_t) st.st_size)
+	{
+		addr = mmap (NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE,
+		             MAP_SHARED, fd, 0);
+		if (addr != MAP_FAILED) {
+			output->map.addr = addr;
+			output->map.size = st.st_size;
+		}
+	}
+	// mapping is still valid after closing file descriptor.
+	ug_close (fd);
+#endif  // OUTPUT_MMAP
+}
+
+static void  uget_curl_output_unmap (UgetCurlOutput* output)
+{
+#ifdef OUTPUT_MMAP
+	if (output->map.addr) {
+		munmap (output->map.addr, (size_t) output->map.size);
+		output->map.addr = NULL;
+		output->map.size = 0;
+	}
+#endif  // OUTPUT_MMAP
+}
+
+void  uget_curl_output_sync (UgetCurlOutput* output)
+{
+#ifdef OUTPUT_MMAP
+	// segment may unmap file while closing it.
+	ug_mutex_lock (&output->mutex);
+	if (output->map.addr)
+		msync (output->map.addr, (size_t) output->map.size, MS_ASYNC);
+	ug_mutex_unlock (&output->mutex);
+#endif  // OUTPUT_MMAP
+}
+
+void  uget_curl_output_digest (UgetCurlOutput* output, const char* data,
+                               int64_t offset, size_t length)
+{
+	UgetChecksum*  checksum;
+	int64_t        skip;
+
+	ug_mutex_lock (&output->mutex);
+	checksum = output->checksum;
+	if (checksum) {
+		skip = checksum->pos - offset;
+		if (skip >= 0 && skip < (int64_t) length)
+			uget_checksum_update (checksum, data + skip, length - (size_t) skip);
+	}
+	ug_mutex_unlock (&output->mutex);
+}
+
+// ----------------------------------------------------------------------------
+// UgetCurlNotify
+
+void  uget_curl_notify_init (UgetCurlNotify* notify)
+{
+	ug_mutex_init (&notify->mutex);
+	ug_cond_init (&notify->cond);
+	notify->count = 0;
+}
+
+void  uget_curl_notify_clear (UgetCurlNotify* notify)
+{
+	ug_cond_clear (&notify->cond);
+	ug_mutex_clear (&notify->mutex);
+}
+
+void  uget_curl_notify_post (UgetCurlNotify* notify)
+{
+	ug_mutex_lock (&notify->mutex);
+	notify->count++;
+	ug_cond_signal (&notify->cond);
+	ug_mutex_unlock (&notify->mutex);
+}
+
+int   uget_curl_notify_wait (UgetCurlNotify* notify, int milliseconds)
+{
+	int  count;
+
+	ug_mutex_lock (&notify->mutex);
+	if (notify->count == 0 && milliseconds != 0)
+		ug_cond_wait (&notify->cond, &notify->mutex, milliseconds);
+	count = notify->count;
+	notify->count = 0;
+	ug_mutex_unlock (&notify->mutex);
+	return count;
+}
+
+// ----------------------------------------------------------------------------
+// curl_multi engine
+//
+// uget_curl_run() -> uget_curl_engine_add() -> worker->pending
+//                                                   |
+// uget_curl_finish() <- curl_multi_info_read() <- curl_multi_perform()
+
+#define ENGINE_THREADS_MAX     64
+#define ENGINE_WAIT_MS         1000
+
+typedef struct UgetCurlWorker     UgetCurlWorker;
+
+struct UgetCurlWorker
+{
+	UgThread   thread;
+	UgMutex    mutex;      // lock pending and n_handles
+	CURLM*     multi;
+	UgetCurl*  pending;    // UgetCurl that wait for adding to multi handle
+	UgetCurl*  paused;     // UgetCurl that paused by UgetBucket
+	int        n_handles;  // number of UgetCurl in pending and multi handle
+	uint8_t    quit;
+};
+
+static struct
+{
+	UgetCurlWorker*  workers;
+	int              n_workers;
+	int              enabled;
+} engine = {NULL, 0, FALSE};
+
+static void  uget_curl_worker_wakeup (UgetCurlWorker* worker)
+{
+#if LIBCURL_VERSION_NUM >= 0x074400    // 7.68.0
+	curl_multi_wakeup (worker->multi);
+#endif
+}
+
+// resume UgetCurl in paused queue if it's time is up or user paused it.
+// return milliseconds to wait before resuming next one.
+static int  uget_curl_worker_resume (UgetCurlWorker* worker)
+{
+	UgetCurl*  ugcurl;
+	UgetCurl*  next;
+	uint64_t   now;
+	int        wait = ENGINE_WAIT_MS;
+
+	now = ug_get_time_count ();
+	ugcurl = worker->paused;
+	worker->paused = NULL;
+	for (;  ugcurl;  ugcurl = next) {
+		next = ugcurl->engine.next;
+		if (ugcurl->engine.resume > now && ugcurl->paused == FALSE) {
+			if (wait > (int) (ugcurl->engine.resume - now))
+				wait = (int) (ugcurl->engine.resume - now);
+			ugcurl->engine.next = worker->paused;
+			worker->paused = ugcurl;
+			continue;
+		}
+		// write callback may pause it again in curl_easy_pause()
+		ugcurl->engine.next = NULL;
+		ugcurl->engine.resume = 0;
+		curl_easy_pause (ugcurl->curl, CURLPAUSE_CONT);
+	}
+	return wait;
+}
+
+static void  uget_curl_worker_unpause (UgetCurlWorker* worker, UgetCurl* ugcurl)
+{
+	UgetCurl** link;
+
+	if (ugcurl->engine.resume == 0)
+		return;
+	for (link = &worker->paused;  *link;  link = &(*link)->engine.next) {
+		if (*link == ugcurl) {
+			*link = ugcurl->engine.next;
+			break;
+		}
+	}
+	ugcurl->engine.next = NULL;
+	ugcurl->engine.resume = 0;
+}
+
+static void  uget_curl_worker_wait (UgetCurlWorker* worker, int n_running,
+                                    int timeout)
+{
+#if LIBCURL_VERSION_NUM >= 0x074400    // 7.68.0
+	curl_multi_poll (worker->multi, NULL, 0, timeout, NULL);
 #else
-	curl_easy_setopt (ugcurl->curl, CURLOPT_WRITEFUNCTION, NULL);
+	int  n_fds = 0;
+
+	// curl_multi_wait() can't be waked up, use shorter timeout.
+	if (timeout > 100)
+		timeout = 100;
+	curl_multi_wait (worker->multi, NULL, 0, timeout, &n_fds);
+	if (n_fds == 0 && n_running == 0)
+		ug_sleep (timeout);
 #endif
-	curl_easy_setopt (ugcurl->curl, CURLOPT_WRITEDATA, file);
+}
+
+static UgThreadResult  uget_curl_worker_thread (UgetCurlWorker* worker)
+{
+	UgetCurl*  ugcurl;
+	UgetCurl*  next;
+	CURLMsg*   msg;
+	CURLcode   code;
+	int        n_running = 0;
+	int        n_msgs;
+
+	while (worker->quit == FALSE) {
+		// take pending UgetCurl and add them to multi handle
+		ug_mutex_lock (&worker->mutex);
+		ugcurl = worker->pending;
+		worker->pending = NULL;
+		ug_mutex_unlock (&worker->mutex);
+		for (;  ugcurl;  ugcurl = next) {
+			next = ugcurl->engine.next;
+			ugcurl->engine.next = NULL;
+			curl_multi_add_handle (worker->multi, ugcurl->curl);
+		}
+
+		curl_multi_perform (worker->multi, &n_running);
+
+		// handle completed transfers
+		while ((msg = curl_multi_info_read (worker->multi, &n_msgs))) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			code = msg->data.result;
+			ugcurl = NULL;
+			curl_easy_getinfo (msg->easy_handle, CURLINFO_PRIVATE,
+					(char**) &ugcurl);
+			curl_multi_remove_handle (worker->multi, msg->easy_handle);
+			if (ugcurl == NULL)
+				continue;
+			uget_curl_worker_unpause (worker, ugcurl);
+			curl_easy_getinfo (ugcurl->curl, CURLINFO_RESPONSE_CODE,
+					&ugcurl->response);
+			ugcurl->tested = TRUE;
+			// prepare.func request to perform again (see uget_curl_thread)
+			if (ugcurl->restart) {
+				ugcurl->restart = FALSE;
+				curl_multi_add_handle (worker->multi, ugcurl->curl);
+				continue;
+			}
+			ug_mutex_lock (&worker->mutex);
+			worker->n_handles--;
+			ug_mutex_unlock (&worker->mutex);
+			ugcurl->engine.worker = NULL;
+			// UgetCurl may be freed after this line.
+			uget_curl_finish (ugcurl, code);
+		}
+
+		uget_curl_worker_wait (worker, n_running,
+				uget_curl_worker_resume (worker));
+	}
 
-	return fwrite (buffer, size, nmemb, file);
+	return UG_THREAD_RESULT;
 }
 
-static int    uget_curl_progress (UgetCurl* ugcurl,
-                                  double  dltotal, double  dlnow,
-                                  double  ultotal, double  ulnow)
+// called by write callback in worker thread, it doesn't need lock.
+static void  uget_curl_engine_pause (UgetCurl* ugcurl, int milliseconds)
 {
-	int64_t  dlsize, ulsize;
+	UgetCurlWorker*  worker = ugcurl->engine.worker;
 
-	dlsize = (int64_t) dlnow;
-	ulsize = (int64_t) ulnow;
-	ugcurl->pos = ugcurl->beg + dlsize;
-	ugcurl->size[1] = ulsize;
-	if (dlsize > 0 || ulsize > 0)
-		ugcurl->state = UGET_CURL_RUN;
+	ugcurl->engine.resume = ug_get_time_count () + milliseconds;
+	ugcurl->engine.next = worker->paused;
+	worker->paused = ugcurl;
+}
 
-	ugcurl->progress_count++;
-	if (ugcurl->progress_count > PROGRESS_COUNT_LIMIT) {
-		ugcurl->progress_count = 0;
-		curl_easy_getinfo (ugcurl->curl, CURLINFO_SPEED_UPLOAD, &ulnow);
-		curl_easy_getinfo (ugcurl->curl, CURLINFO_SPEED_DOWNLOAD, &dlnow);
-		ugcurl->speed[0] = (int64_t) dlnow;
-		ugcurl->speed[1] = (int64_t) ulnow;
+static int  uget_curl_engine_add (UgetCurl* ugcurl)
+{
+	UgetCurlWorker*  worker;
+	UgetCurlWorker*  cur;
+	int              n_handles;
+	int              n_least = 0;
+	int              index;
+
+	if (engine.enabled == FALSE || engine.n_workers == 0)
+		return FALSE;
+
+	// choose worker that has the least transfers.
+	// worker thread decrease n_handles, read it under lock.
+	worker = NULL;
+	for (index = 0;  index < engine.n_workers;  index++) {
+		cur = engine.workers + index;
+		ug_mutex_lock (&cur->mutex);
+		n_handles = cur->n_handles;
+		ug_mutex_unlock (&cur->mutex);
+		if (worker == NULL || n_least > n_handles) {
+			worker = cur;
+			n_least = n_handles;
+		}
 	}
 
-	// speed limit changed
-	if (ugcurl->limit_changed) {
-		curl_easy_setopt (ugcurl->curl, CURLOPT_MAX_RECV_SPEED_LARGE,
-				(curl_off_t) ugcurl->limit[0]);
-		curl_easy_setopt (ugcurl->curl, CURLOPT_MAX_SEND_SPEED_LARGE,
-				(curl_off_t) ugcurl->limit[1]);
-		ugcurl->limit_changed = FALSE;
+	ugcurl->restart = FALSE;
+	ugcurl->engine.worker = worker;
+	ug_mutex_lock (&worker->mutex);
+	ugcurl->engine.next = worker->pending;
+	worker->pending = ugcurl;
+	worker->n_handles++;
+	ug_mutex_unlock (&worker->mutex);
+	uget_curl_worker_wakeup (worker);
+	return TRUE;
+}
+
+static int  get_n_processors (void)
+{
+#if defined _WIN32 || defined _WIN64
+	SYSTEM_INFO  info;
+
+	GetSystemInfo (&info);
+	return (int) info.dwNumberOfProcessors;
+#elif defined _SC_NPROCESSORS_ONLN
+	return (int) sysconf (_SC_NPROCESSORS_ONLN);
+#else
+	return 1;
+#endif
+}
+
+int   uget_curl_engine_start (int n_threads)
+{
+	UgetCurlWorker*  worker;
+	int              index;
+
+	if (n_threads == 0) {
+		// running threads will be stopped by uget_curl_engine_stop()
+		engine.enabled = FALSE;
+		return TRUE;
+	}
+	// engine is running. number of threads can't be changed before stopping.
+	if (engine.n_workers > 0) {
+		engine.enabled = TRUE;
+		return TRUE;
 	}
 
-	// Returning a non-zero value from this callback will cause libcurl
-	// to abort the transfer and return CURLE_ABORTED_BY_CALLBACK.
-	if (ugcurl->end > 0 && ugcurl->pos >= ugcurl->end) {
-		ugcurl->pos = ugcurl->end;
-		ugcurl->size[0] = ugcurl->pos - ugcurl->beg;
-		return 1;
+	if (n_threads < 0)
+		n_threads = get_n_processors ();
+	if (n_threads < 1)
+		n_threads = 1;
+	else if (n_threads > ENGINE_THREADS_MAX)
+		n_threads = ENGINE_THREADS_MAX;
+
+	engine.workers = ug_malloc0 (sizeof (UgetCurlWorker) * n_threads);
+	for (index = 0;  index < n_threads;  index++) {
+		worker = engine.workers + index;
+		ug_mutex_init (&worker->mutex);
+		worker->multi = curl_multi_init ();
+		if (ug_thread_create (&worker->thread,
+				(UgThreadFunc) uget_curl_worker_thread, worker) != UG_THREAD_OK)
+		{
+			curl_multi_cleanup (worker->multi);
+			ug_mutex_clear (&worker->mutex);
+			break;
+		}
+	}
+	engine.n_workers = index;
+	if (index == 0) {
+		ug_free (engine.workers);
+		engine.workers = NULL;
+		return FALSE;
 	}
+	engine.enabled = TRUE;
+	return TRUE;
+}
 
-	ugcurl->size[0] = ugcurl->pos - ugcurl->beg;
-	if (ugcurl->paused)
-		return 1;
+void  uget_curl_engine_stop (void)
+{
+	UgetCurlWorker*  worker;
+	int              index;
+
+	engine.enabled = FALSE;
+	for (index = 0;  index < engine.n_workers;  index++) {
+		worker = engine.workers + index;
+		worker->quit = TRUE;
+		uget_curl_worker_wakeup (worker);
+	}
+	for (index = 0;  index < engine.n_workers;  index++) {
+		worker = engine.workers + index;
+		ug_thread_join (&worker->thread);
+		curl_multi_cleanup (worker->multi);
+		ug_mutex_clear (&worker->mutex);
+	}
+	ug_free (engine.workers);
+	engine.workers = NULL;
+	engine.n_workers = 0;
+}
+
+int   uget_curl_engine_get_threads (void)
+{
+	if (engine.enabled)
+		return engine.n_workers;
 	return 0;
 }
 
@@ -50,13 +50,20 @@
 #include <UgUri.h>
 #include <UgetData.h>
 #include <UgetEvent.h>
+#include <UgetBucket.h>
+#include <UgetRate.h>
+#include <UgetUring.h>
+#include <UgetWriter.h>
+#include <UgetChecksum.h>
 #include <curl/curl.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-typedef struct UgetCurl     UgetCurl;
+typedef struct UgetCurl         UgetCurl;
+typedef struct UgetCurlNotify   UgetCurlNotify;
+typedef struct UgetCurlOutput   UgetCurlOutput;
 
 typedef int (*UgetCurlFunc) (UgetCurl* ugcurl, void* data);
 
@@ -86,6 +93,71 @@ enum UgetCurlState
 	UGET_CURL_NOT_RESUMABLE,    // redownload + retry
 };
 
+// ----------------------------------------------------------------------------
+// UgetCurlNotify: UgetCurl signal it when UgetCurl::state changed.
+//                 UgetPluginCurl wait it instead of polling UgetCurl.
+
+struct UgetCurlNotify
+{
+	UgMutex    mutex;
+	UgCond     cond;
+	int        count;    // number of notifications that haven't been handled
+};
+
+void  uget_curl_notify_init (UgetCurlNotify* notify);
+void  uget_curl_notify_clear (UgetCurlNotify* notify);
+void  uget_curl_notify_post (UgetCurlNotify* notify);
+// milliseconds < 0 : wait until it was notified.
+// return number of notifications and reset it.
+int   uget_curl_notify_wait (UgetCurlNotify* notify, int milliseconds);
+
+// ----------------------------------------------------------------------------
+// UgetCurlOutput: output file shared by all segments of a download.
+//                 File is opened once, UgetCurl write data by position.
+
+struct UgetCurlOutput
+{
+	UgMutex    mutex;       // protect fd, ref_count and checksum
+	int        fd;
+	int        ref_count;   // number of UgetCurl that open this file
+
+	// written data is added to checksum if it is at checksum->pos.
+	// NULL if download doesn't need to be verified.
+	UgetChecksum*  checksum;
+
+	// If uring is not NULL, data is written asynchronously by io_uring.
+	// Call uget_curl_output_flush() before reading back written data.
+	UgetUring*     uring;
+	// If writer is not NULL, data is copied to write-behind buffer pool
+	// and written by disk writer threads.
+	UgetWriterFile*  writer;
+	// writer open file with O_DIRECT to bypass page cache.
+	int            direct;
+
+	// If 'mapped' is TRUE, file is mapped to memory when it is opened and
+	// segments copy data to it. File that isn't fully allocated is not
+	// mapped, writing to hole may raise SIGBUS if disk is full.
+	// Data beyond map.size is written by pwrite().
+	int            mapped;
+	struct {
+		char*      addr;    // NULL if file is not mapped
+		int64_t    size;
+	} map;
+};
+
+void  uget_curl_output_init (UgetCurlOutput* output);
+void  uget_curl_output_clear (UgetCurlOutput* output);
+// wait for io_uring or write-behind writes. return 0 or errno of failed write.
+int   uget_curl_output_flush (UgetCurlOutput* output);
+// decrease ref_count and close file if it reach 0. Caller must lock mutex.
+void  uget_curl_output_unref (UgetCurlOutput* output);
+// start writing dirty pages of memory-mapped file, it doesn't wait for them.
+void  uget_curl_output_sync (UgetCurlOutput* output);
+// add data at file offset to output->checksum. Data before checksum->pos is
+// skipped, data after checksum->pos must be read back from file later.
+void  uget_curl_output_digest (UgetCurlOutput* output, const char* data,
+                               int64_t offset, size_t length);
+
 // ----------------------------------------------------------------------------
 // UgetCurl: used by UgetPluginCurl
 
@@ -98,34 +170,77 @@ struct UgetCurl
 
 	UgThread     thread;
 	CURL*        curl;
+
+	// used by curl_multi engine. see uget_curl_engine_start()
+	struct {
+		void*      worker;
+		UgetCurl*  next;     // next one in pending or paused queue
+		uint64_t   resume;   // time to resume paused transfer, 0 = running
+	} engine;
+
+	// Plug-in thread may move beg or cut end while transfer is running.
+	// Write them by uget_curl_set_beg() and uget_curl_set_end(), curl thread
+	// read them by ug_atomic_load_int64().
 	int64_t      beg;
 	int64_t      end;
 	int64_t      pos;  // current position
+	// If end of segment is known, UgetCurl request bounded Range "beg-end"
+	// and transfer can complete without aborting the connection.
+	int64_t      range_end;  // end of requested Range, 0 = open-ended
+	int64_t      wasted;     // received data beyond end (discarded)
 
 	UgetCommon*  common;
 	UgetHttp*    http;
 	UgetFtp*     ftp;
 	UgetEvent*   event;
+	// size of receive buffer, it is also size of each write. 0 = default
+	int          buffer_size;
+	// if user specify notify, UgetCurl will post it when state changed to
+	// UGET_CURL_RUN or stopped state (UGET_CURL_OK, UGET_CURL_ERROR...etc)
+	UgetCurlNotify*  notify;
 
 //	struct curl_slist*  ftp_command;
 	struct {
 		UgUri    part;
 		void*    link;
+		void*    host;    // plug-in acquired connection from it (UgetHost)
 	} uri;
 
+	// pos, size[] and speed[] are owned by plug-in thread,
+	// uget_curl_load_progress() copy them from progress.
+	// size[0] is always pos - beg, plug-in may move beg of running segment.
 	// size[0]  = downloaded size
 	// size[1]  = uploaded size
 	// speed[0] = downloading speed
 	// speed[1] = uploading speed
 	// limit[0] = download speed limit
-	// limit[1] = upload speed limit
+	// limit[1] = upload speed limit, set them by uget_curl_set_speed()
 	int64_t      size[2];
 	int64_t      speed[2];
 	int64_t      limit[2];
 
+	// curl thread publish progress here by seqlock,
+	// so other thread never read torn 64-bit value.
+	struct {
+		UgSeq    seq;
+		int64_t  pos;
+		int64_t  upload;     // size[1]
+		int64_t  speed[2];
+		int      stopped;    // the last progress has been published
+	} progress;
+	// curl thread estimate progress.speed[] by these. rate[0] is fed by
+	// written, it counts data written since uget_curl_run().
+	UgetRate     rate[2];
+	int64_t      written;
+	// If bucket is not NULL, received data take tokens from it.
+	// Transfer will be paused when bucket has no tokens.
+	UgetBucket*  bucket;
+
 	// file stream
+	// output must be set before calling uget_curl_open_file()
 	struct {
-		FILE*    output;
+		UgetCurlOutput*  output;
+		int64_t  offset;     // write position of output
 		FILE*    post;
 	} file;
 
@@ -141,39 +256,68 @@ struct UgetCurl
 	struct {
 		char*   uri;
 		char*   filename;
+		int64_t size;    // total size in "Content-Range:", 0 if unknown
 	} header;
 
 	long        response;    // from HTTP or FTP
 	int         event_code;  // for CURLE_WRITE_ERROR (UGET_CURL_ERROR)
+	// plug-in thread set it, curl thread clear it. use ug_atomic_*_int()
+	int         limit_changed;   // speed limit changed
 	uint8_t     state;       // UgetCurlState
-	uint8_t     progress_count;
+
+	// flags written by curl thread while transfer is running.
+	// Plug-in thread may write them only before running transfer.
 	uint8_t     scheme_type:4;
 	uint8_t     restart:1;
-
-	// flags
-	uint8_t     limit_changed:1; // speed limit changed
+	uint8_t     opened:1;    // file.output has been opened by this UgetCurl
+	uint8_t     writing:1;   // file.output has been prepared for writing
 	uint8_t     header_store:1;  // save uri and filename from header.
 	uint8_t     resumable:1;     // get resumable in header callback
 	uint8_t     stopped:1;       // downloading thread is stopped
-	uint8_t     paused:1;        // paused by user
 	uint8_t     tested:1;        // URI tested
 	uint8_t     test_ok:1;       // URI test ok
-	uint8_t     split:1;         // split previous segment
 	uint8_t     html:1;          // "Content-Type: text/html"
 
+	// flags written by plug-in thread while transfer is running.
+	// They are not bit-fields, writing one never rewrites flags above.
+	uint8_t     paused;          // paused by user
+	uint8_t     split;           // split previous segment
+	uint8_t     endgame;         // duplicate tail of previous segment
+	uint8_t     progress_loaded; // the last progress has been loaded
+
 	char        error_string[CURL_ERROR_SIZE];
 };
 
 UgetCurl*  uget_curl_new (void);
 void       uget_curl_free (UgetCurl* ugcurl);
+// reset UgetCurl for next transfer. Easy handle is kept, so it's cached
+// connection can be used again. If 'all' is FALSE, options and settings
+// (common, http, notify...etc) are kept for next segment of the same download.
+// If 'all' is TRUE, they are cleared and UgetCurl can be used by other one.
+void       uget_curl_reset (UgetCurl* ugcurl, int all);
 
 void  uget_curl_run (UgetCurl* ugcurl, int joinable);
 
+// void uget_curl_set_beg (UgetCurl* ugcurl, int64_t beg);
+#define uget_curl_set_beg(ugcurl, value)  \
+		ug_atomic_store_int64 (&(ugcurl)->beg, (int64_t) (value))
+// void uget_curl_set_end (UgetCurl* ugcurl, int64_t end);
+#define uget_curl_set_end(ugcurl, value)  \
+		ug_atomic_store_int64 (&(ugcurl)->end, (int64_t) (value))
+
 int   uget_curl_open_file (UgetCurl* ugcurl, const char* filename);
 void  uget_curl_close_file (UgetCurl* ugcurl);
 void  uget_curl_set_url (UgetCurl* ugcurl, const char* uri);
 void  uget_curl_set_speed (UgetCurl* ugcurl, int64_t dlspeed, int64_t ulspeed);
 
+// copy progress that published by curl thread to pos, size[] and speed[].
+// size[0] is computed from beg of plug-in, not from beg of curl thread.
+// It does nothing after the last progress has been loaded, caller can
+// modify pos and size[] of stopped UgetCurl.
+void  uget_curl_load_progress (UgetCurl* ugcurl);
+// curl thread only: discard downloaded data and set current position.
+void  uget_curl_reset_progress (UgetCurl* ugcurl, int64_t pos);
+
 void  uget_curl_set_common (UgetCurl* ugcurl, UgetCommon* common);
 void  uget_curl_set_proxy (UgetCurl* ugcurl, UgetProxy* proxy);
 int   uget_curl_set_http (UgetCurl* ugcurl, UgetHttp* http);
@@ -184,6 +328,18 @@ void  uget_curl_decide_login (UgetCurl* ugcurl);
 
 #define uget_curl_join_thread(ugcurl)   ug_thread_join (&(ugcurl)->thread)
 
+// ----------------------------------------------------------------------------
+// curl_multi engine: drive all UgetCurl by a few curl_multi threads.
+// If engine is running, uget_curl_run(ugcurl, FALSE) will not create thread.
+// n_threads > 0  : number of curl_multi threads.
+// n_threads < 0  : use number of processors.
+// n_threads == 0 : disable engine, new transfer will run in it's own thread.
+int   uget_curl_engine_start (int n_threads);
+// call this only if no UgetCurl is running.
+void  uget_curl_engine_stop (void);
+// return number of curl_multi threads. return 0 if engine is disabled.
+int   uget_curl_engine_get_threads (void);
+
 void  ug_curl_set_proxy (CURL* curl, UgetProxy* proxy);
 
 #ifdef __cplusplus
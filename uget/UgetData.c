@@ -63,6 +63,10 @@ static const UgEntry  UgetCommonEntry[] =
 			NULL, UG_ENTRY_NO_NULL},
 	{"password", offsetof(UgetCommon, password), UG_ENTRY_STRING,
 			NULL, UG_ENTRY_NO_NULL},
+	{"checksum", offsetof(UgetCommon, checksum), UG_ENTRY_STRING,
+			NULL, UG_ENTRY_NO_NULL},
+	{"piece-hashes", offsetof(UgetCommon, piece_hashes), UG_ENTRY_STRING,
+			NULL, UG_ENTRY_NO_NULL},
 	{"connect-timeout",    offsetof(UgetCommon, connect_timeout),
 			UG_ENTRY_UINT,  NULL, NULL},
 	{"transmit-timeout",   offsetof(UgetCommon, transmit_timeout),
@@ -81,6 +85,10 @@ static const UgEntry  UgetCommonEntry[] =
 			UG_ENTRY_INT,   NULL, NULL},
 	{"timestamp",          offsetof(UgetCommon, timestamp),
 			UG_ENTRY_INT,   NULL, NULL},
+	{"preallocate",        offsetof(UgetCommon, preallocate),
+			UG_ENTRY_INT,   NULL, NULL},
+	{"output",             offsetof(UgetCommon, output),
+			UG_ENTRY_INT,   NULL, NULL},
 	{NULL}    // null-terminated
 };
 
@@ -104,6 +112,7 @@ static void uget_common_init(UgetCommon* common)
 	common->retry_limit = 99;
 	common->max_connections = 1;
 	common->timestamp = TRUE;
+	common->preallocate = UGET_PREALLOCATE_SPARSE;
 #ifndef NDEBUG
 	common->debug_level = 1;
 #endif
@@ -118,6 +127,8 @@ static void uget_common_final(UgetCommon* common)
 	ug_free(common->folder);
 	ug_free(common->user);
 	ug_free(common->password);
+	ug_free(common->checksum);
+	ug_free(common->piece_hashes);
 }
 
 static int  uget_common_assign(UgetCommon* common, UgetCommon* src)
@@ -159,6 +170,16 @@ static int  uget_common_assign(UgetCommon* common, UgetCommon* src)
 		common->password = (src->password) ? ug_strdup(src->password) : NULL;
 		common->keeping.password = src->keeping.password;
 	}
+	if (common->keeping.enable == FALSE || common->keeping.checksum == FALSE) {
+		ug_free(common->checksum);
+		common->checksum = (src->checksum) ? ug_strdup(src->checksum) : NULL;
+		common->keeping.checksum = src->keeping.checksum;
+	}
+	if (common->keeping.enable == FALSE || common->keeping.piece_hashes == FALSE) {
+		ug_free(common->piece_hashes);
+		common->piece_hashes = (src->piece_hashes) ? ug_strdup(src->piece_hashes) : NULL;
+		common->keeping.piece_hashes = src->keeping.piece_hashes;
+	}
 	// timeout
 	if (common->keeping.enable == FALSE || common->keeping.connect_timeout == FALSE) {
 		common->connect_timeout = src->connect_timeout;
@@ -196,6 +217,16 @@ static int  uget_common_assign(UgetCommon* common, UgetCommon* src)
 		common->timestamp = src->timestamp;
 		common->keeping.timestamp = src->keeping.timestamp;
 	}
+	// preallocate
+	if (common->keeping.enable == FALSE || common->keeping.preallocate == FALSE) {
+		common->preallocate = src->preallocate;
+		common->keeping.preallocate = src->keeping.preallocate;
+	}
+	// output
+	if (common->keeping.enable == FALSE || common->keeping.output == FALSE) {
+		common->output = src->output;
+		common->keeping.output = src->keeping.output;
+	}
 
 	if (common->keeping.enable == FALSE || common->keeping.debug_level == FALSE) {
 		common->debug_level = src->debug_level;
@@ -708,6 +739,8 @@ static const UgEntry  UgetCategoryEntry[] =
 			NULL, NULL},
 	{"recycled-limit", offsetof(UgetCategory, recycled_limit), UG_ENTRY_INT,
 			NULL, NULL},
+	{"speed-limit",    offsetof(UgetCategory, speed_limit),    UG_ENTRY_INT,
+			NULL, NULL},
 	{NULL}		// null-terminated
 };
 
@@ -748,6 +781,7 @@ static int   uget_category_assign(UgetCategory* category, UgetCategory* src)
 	category->active_limit = src->active_limit;
 	category->finished_limit = src->finished_limit;
 	category->recycled_limit = src->recycled_limit;
+	category->speed_limit = src->speed_limit;
 
 	ug_array_str_copy(&category->schemes, &src->schemes);
 	ug_array_str_copy(&category->hosts, &src->hosts);
@@ -42,6 +42,7 @@
 #include <UgData.h>
 #include <UgetFiles.h>
 #include <UgetPlugin.h>
+#include <UgetBucket.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -88,6 +89,10 @@ struct UgetCommon
 	char*   folder;
 	char*   user;
 	char*   password;
+	// expected digest, "md5=hex", "sha-1=hex", "sha-256=hex" or bare hex
+	char*   checksum;
+	// expected digest of each piece, "TYPE:LENGTH:HEX,HEX,..."
+	char*   piece_hashes;
 
 	// timeout
 	unsigned int  connect_timeout;    // second
@@ -103,6 +108,8 @@ struct UgetCommon
 
 	// retrieve timestamp of the remote file if it is available.
 	int           timestamp;          // retrieve file timestamp
+	int           preallocate;        // UgetPreallocate
+	int           output;             // UgetOutput
 	// debug
 	int           debug_level;
 
@@ -118,7 +125,11 @@ struct UgetCommon
 		uint8_t   folder:1;
 		uint8_t   user:1;
 		uint8_t   password:1;
+		uint8_t   checksum:1;
+		uint8_t   piece_hashes:1;
 		uint8_t   timestamp:1;
+		uint8_t   preallocate:1;
+		uint8_t   output:1;
 		uint8_t   connect_timeout:1;
 		uint8_t   transmit_timeout:1;
 		uint8_t   retry_delay:1;
@@ -133,6 +144,19 @@ struct UgetCommon
 	} keeping;
 };
 
+// UgetCommon::preallocate: how to allocate disk space for new file
+typedef enum {
+	UGET_PREALLOCATE_NONE,      // file grows while downloading
+	UGET_PREALLOCATE_SPARSE,    // set file size only (sparse file)
+	UGET_PREALLOCATE_FULL,      // reserve all blocks (fallocate)
+} UgetPreallocate;
+
+// UgetCommon::output: how plug-in write downloaded data to file
+typedef enum {
+	UGET_OUTPUT_DEFAULT,        // decided by plug-in setting
+	UGET_OUTPUT_MMAP,           // copy data to memory-mapped file (allocate all blocks)
+} UgetOutput;
+
 // helper functions for UgetCommon::name
 char* uget_name_from_uri(UgUri* uri);
 char* uget_name_from_uri_str(const char* uri);
@@ -156,6 +180,7 @@ struct UgetProgress
 	int64_t      left;        // remain time  (seconds)
 	int64_t      complete;    // complete size
 	int64_t      total;       // total size
+	int64_t      wasted;      // received data that was discarded
 	// torrent - upload
 	int64_t      uploaded;
 	double       ratio;
@@ -355,6 +380,8 @@ struct UgetRelation
 		// speed control
 		int          speed[2];   // current speed
 		int          limit[2];   // current speed limit
+		// download speed is limited by bucket if plug-in accept it.
+		UgetBucket*  bucket;
 	}* task;
 };
 
@@ -382,6 +409,7 @@ struct UgetCategory
 	int        active_limit;
 	int        finished_limit;   // finished: completed and stopped
 	int        recycled_limit;
+	int        speed_limit;      // download speed of all downloads, bytes per seconds
 
 	// subcategory in UgetNode::fake
 	UgetNode*  active;
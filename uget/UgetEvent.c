@@ -63,6 +63,8 @@ static const char*	normal_msg[] =
 	// resumable
 	N_("Resumable"),                                            // UGET_EVENT_NORMAL_RESUMABLE,
 	N_("Not Resumable"),                                        // UGET_EVENT_NORMAL_NOT_RESUMABLE,
+	N_("Disk space allocated"),                                 // UGET_EVENT_NORMAL_PREALLOCATED,
+	N_("Checksum verified"),                                    // UGET_EVENT_NORMAL_CHECKSUM_OK,
 };
 static const int  n_normal_msg = sizeof (normal_msg) / sizeof (char*);
 
@@ -71,6 +73,7 @@ static const char* warning_msg[] =
 {
 	NULL,                                                       // UGET_EVENT_WARNING_CUSTOM
 	N_("Output file can't be renamed."),                        // UGET_EVENT_WARNING_FILE_RENAME_FAILED
+	N_("Output file can't be memory-mapped, write it directly."), // UGET_EVENT_WARNING_FILE_MAP_FAILED
 };
 static const int  n_warning_msg = sizeof (warning_msg) / sizeof (char*);
 
@@ -92,6 +95,7 @@ static const char*  error_msg[] =
 	N_("Unsupported file."),                                    // UGET_EVENT_ERROR_UNSUPPORTED_FILE
 	N_("post file not found."),                                 // UGET_EVENT_ERROR_POST_FILE_NOT_FOUND
 	N_("cookie file not found."),                               // UGET_EVENT_ERROR_COOKIE_FILE_NOT_FOUND
+	N_("Checksum mismatch (file is corrupted)."),               // UGET_EVENT_ERROR_CHECKSUM_MISMATCH
 };
 static const int  n_error_msg = sizeof (error_msg) / sizeof (char*);
 
@@ -81,12 +81,17 @@ typedef enum
 	// resumable
 	UGET_EVENT_NORMAL_RESUMABLE,
 	UGET_EVENT_NORMAL_NOT_RESUMABLE,
+	// disk space has been allocated (string contain consumed time)
+	UGET_EVENT_NORMAL_PREALLOCATED,
+	// downloaded data match UgetCommon::checksum
+	UGET_EVENT_NORMAL_CHECKSUM_OK,
 } UgetEventNormal;
 
 typedef enum {
 	UGET_EVENT_WARNING_CUSTOM  = 0,  // must be 0
 
 	UGET_EVENT_WARNING_FILE_RENAME_FAILED,
+	UGET_EVENT_WARNING_FILE_MAP_FAILED,
 } UgetEventWarning;
 
 typedef enum {
@@ -107,6 +112,7 @@ typedef enum {
 	UGET_EVENT_ERROR_UNSUPPORTED_FILE,
 	UGET_EVENT_ERROR_POST_FILE_NOT_FOUND,
 	UGET_EVENT_ERROR_COOKIE_FILE_NOT_FOUND,
+	UGET_EVENT_ERROR_CHECKSUM_MISMATCH,
 
 	// plug-in error code
 //	UGET_EVENT_ERROR_PLUGIN_INITIALIZE_FAILED = 10000,
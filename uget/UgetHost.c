@@ -0,0 +1,259 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+
+#include <string.h>
+#include <UgDefine.h>
+#include <UgString.h>
+#include <UgUri.h>
+#include <UgetHost.h>
+
+static UgetHost*  host_root (UgetHost* host)
+{
+	while (host->parent)
+		host = host->parent;
+	return host;
+}
+
+static int  host_limit (UgetHost* host)
+{
+	if (host->parent)
+		return host_root (host)->limit_host;
+	return host->limit;
+}
+
+// caller must lock root.
+// Download that hold it's share can get more only if spare connections are
+// enough for other users and waiting downloads to get one more.
+static int  host_is_busy (UgetHost* host, int n_held)
+{
+	int  limit;
+	int  spare;
+	int  share;
+
+	limit = host_limit (host);
+	if (limit <= 0)
+		return FALSE;
+	spare = limit - host->n_connections;
+	if (spare <= 0)
+		return TRUE;
+	if (n_held == 0)
+		return FALSE;
+	share = host->n_users + host->n_waiting;
+	share = (limit + share - 1) / share;
+	if (n_held >= share && spare <= host->n_users - 1 + host->n_waiting)
+		return TRUE;
+	return FALSE;
+}
+
+// ----------------------------------------------------------------------------
+// UgetHost
+
+UgetHost*  uget_host_new (void)
+{
+	UgetHost*  host;
+
+	host = ug_malloc0 (sizeof (UgetHost));
+	host->ref_count = 1;
+	ug_mutex_init (&host->mutex);
+	return host;
+}
+
+void  uget_host_ref (UgetHost* host)
+{
+	UgetHost*  root;
+
+	root = host_root (host);
+	ug_mutex_lock (&root->mutex);
+	host->ref_count++;
+	ug_mutex_unlock (&root->mutex);
+}
+
+void  uget_host_unref (UgetHost* host)
+{
+	UgetHost*   root;
+	UgetHost*   parent;
+	UgetHost**  link;
+	int         ref_count;
+
+	root = host_root (host);
+	ug_mutex_lock (&root->mutex);
+	ref_count = --host->ref_count;
+	if (ref_count == 0 && host->parent) {
+		// remove from parent's children
+		for (link = &host->parent->children;  *link;  link = &(*link)->next) {
+			if (*link == host) {
+				*link = host->next;
+				break;
+			}
+		}
+	}
+	ug_mutex_unlock (&root->mutex);
+
+	if (ref_count == 0) {
+		parent = host->parent;
+		if (parent == NULL)
+			ug_mutex_clear (&host->mutex);
+		ug_free (host->name);
+		ug_free (host);
+		if (parent)
+			uget_host_unref (parent);
+	}
+}
+
+void  uget_host_set_limit (UgetHost* root, int per_host, int total)
+{
+	ug_mutex_lock (&root->mutex);
+	root->limit_host = (per_host > 0) ? per_host : 0;
+	root->limit = (total > 0) ? total : 0;
+	ug_mutex_unlock (&root->mutex);
+}
+
+UgetHost*  uget_host_find (UgetHost* root, const char* uri)
+{
+	UgetHost*  host;
+	UgUri      uuri;
+	const char* name;
+	int         length;
+
+	ug_uri_init (&uuri, uri);
+	length = ug_uri_host (&uuri, &name);
+	if (length <= 0)
+		return NULL;
+
+	ug_mutex_lock (&root->mutex);
+	for (host = root->children;  host;  host = host->next) {
+		if (strncasecmp (host->name, name, length) == 0 &&
+		    host->name[length] == 0)
+		{
+			host->ref_count++;
+			break;
+		}
+	}
+	if (host == NULL) {
+		host = ug_malloc0 (sizeof (UgetHost));
+		host->name = ug_strndup (name, length);
+		host->ref_count = 1;
+		host->parent = root;
+		host->next = root->children;
+		root->children = host;
+		root->ref_count++;
+	}
+	ug_mutex_unlock (&root->mutex);
+	return host;
+}
+
+int   uget_host_spare (UgetHost* host)
+{
+	UgetHost*  root;
+	int        spare = -1;
+	int        limit;
+
+	root = host_root (host);
+	ug_mutex_lock (&root->mutex);
+	for (;  host;  host = host->parent) {
+		limit = host_limit (host);
+		if (limit <= 0)
+			continue;
+		limit -= host->n_connections;
+		if (limit < 0)
+			limit = 0;
+		if (spare == -1 || spare > limit)
+			spare = limit;
+	}
+	ug_mutex_unlock (&root->mutex);
+	return spare;
+}
+
+void  uget_host_wait (UgetHost* host)
+{
+	UgetHost*  root;
+
+	root = host_root (host);
+	ug_mutex_lock (&root->mutex);
+	for (;  host;  host = host->parent)
+		host->n_waiting++;
+	ug_mutex_unlock (&root->mutex);
+}
+
+void  uget_host_clear_waiting (UgetHost* root)
+{
+	UgetHost*  host;
+
+	ug_mutex_lock (&root->mutex);
+	root->n_waiting = 0;
+	for (host = root->children;  host;  host = host->next)
+		host->n_waiting = 0;
+	ug_mutex_unlock (&root->mutex);
+}
+
+int   uget_host_acquire (UgetHost* host, int n_held, int force)
+{
+	UgetHost*  root;
+	UgetHost*  temp;
+
+	root = host_root (host);
+	ug_mutex_lock (&root->mutex);
+	if (force == FALSE) {
+		for (temp = host;  temp;  temp = temp->parent) {
+			if (host_is_busy (temp, n_held)) {
+				ug_mutex_unlock (&root->mutex);
+				return FALSE;
+			}
+		}
+	}
+	for (temp = host;  temp;  temp = temp->parent) {
+		temp->n_connections++;
+		if (n_held == 0)
+			temp->n_users++;
+	}
+	ug_mutex_unlock (&root->mutex);
+	return TRUE;
+}
+
+void  uget_host_release (UgetHost* host, int n_held)
+{
+	UgetHost*  root;
+
+	root = host_root (host);
+	ug_mutex_lock (&root->mutex);
+	for (;  host;  host = host->parent) {
+		host->n_connections--;
+		if (n_held == 0)
+			host->n_users--;
+	}
+	ug_mutex_unlock (&root->mutex);
+}
@@ -0,0 +1,108 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+// Connection budget of hosts, shared by all downloads (global -> host)
+#ifndef UGET_HOST_H
+#define UGET_HOST_H
+
+#include <UgThread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct UgetHost        UgetHost;
+
+/* ----------------------------------------------------------------------------
+   UgetHost: Root counts connections of all hosts, it's children count
+             connections of each host. Download must acquire connection from
+             host (and root) before connecting to server.
+
+   If host is busy, download that hold more than it's share of connections
+   can't get more. Spare connections are left for downloads that are waiting
+   in queue or hold less than their share.
+   All hosts in the same tree are locked by mutex of root.
+ */
+
+struct UgetHost
+{
+	UgetHost*    parent;
+	UgetHost*    children;   // first child
+	UgetHost*    next;       // next sibling
+
+	UgMutex      mutex;      // only root use this
+	char*        name;       // host name, NULL in root
+
+	int          limit;      // max connections, 0 = unlimited
+	int          limit_host; // root only, max connections of each host
+	int          n_connections;
+	int          n_users;    // number of downloads that hold connections
+	int          n_waiting;  // number of queuing downloads wait for host
+	int          ref_count;
+};
+
+// create root
+UgetHost*  uget_host_new (void);
+void  uget_host_ref (UgetHost* host);
+void  uget_host_unref (UgetHost* host);
+
+// per_host, total: max connections, 0 = unlimited
+void  uget_host_set_limit (UgetHost* root, int per_host, int total);
+
+// find or create child by host of URI. caller must unref returned host.
+// return NULL if URI has no host.
+UgetHost*  uget_host_find (UgetHost* root, const char* uri);
+
+// return number of connections that can be acquired, -1 = unlimited.
+int   uget_host_spare (UgetHost* host);
+
+// queuing download wait for host. uget_host_clear_waiting() reset counter
+// before scanning queue again.
+void  uget_host_wait (UgetHost* host);
+void  uget_host_clear_waiting (UgetHost* root);
+
+// n_held: number of connections that download hold in this host.
+// If 'force' is TRUE, it always success. e.g. first connection of download.
+// return TRUE if connection was acquired.
+int   uget_host_acquire (UgetHost* host, int n_held, int force);
+// n_held: number of connections that download hold after releasing.
+void  uget_host_release (UgetHost* host, int n_held);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // End of UGET_HOST_H
@@ -60,6 +60,8 @@ void  uget_option_value_clear (UgetOptionValue* value)
 	ug_free (value->common.file);
 	ug_free (value->common.user);
 	ug_free (value->common.password);
+	ug_free (value->common.checksum);
+	ug_free (value->common.piece_hashes);
 
 	ug_free (value->proxy.host);
 	ug_free (value->proxy.user);
@@ -135,6 +137,18 @@ int  uget_option_value_to_info (UgetOptionValue* ivalue, UgInfo* info)
 			temp.common->keeping.password = TRUE;
 			ivalue->common.password = NULL;
 		}
+		if (ivalue->common.checksum) {
+			ug_free(temp.common->checksum);
+			temp.common->checksum = ivalue->common.checksum;
+			temp.common->keeping.checksum = TRUE;
+			ivalue->common.checksum = NULL;
+		}
+		if (ivalue->common.piece_hashes) {
+			ug_free(temp.common->piece_hashes);
+			temp.common->piece_hashes = ivalue->common.piece_hashes;
+			temp.common->keeping.piece_hashes = TRUE;
+			ivalue->common.piece_hashes = NULL;
+		}
 	}
 
 	if (mem_is_zero((char*) &ivalue->proxy, sizeof(ivalue->proxy)) == FALSE) {
@@ -269,6 +283,10 @@ UgOptionEntry  uget_option_entry[] =
 		"set both ftp and http user to USER.", "USER", NULL},
 	{"password",       NULL, offsetof (UgetOptionValue, common.password), UG_ENTRY_STRING,
 		"set both ftp and http password to PASS.", "PASS", NULL},
+	{"checksum",       NULL, offsetof (UgetOptionValue, common.checksum), UG_ENTRY_STRING,
+		"verify file with TYPE=DIGEST. (md5, sha-1, sha-256)", "TYPE=DIGEST", NULL},
+	{"piece-hashes",   NULL, offsetof (UgetOptionValue, common.piece_hashes), UG_ENTRY_STRING,
+		"verify each LENGTH bytes piece with DIGESTs.", "TYPE:LENGTH:DIGEST,...", NULL},
 
 	{"proxy-type",     NULL, offsetof (UgetOptionValue, proxy.type), UG_ENTRY_INT,
 		"set proxy type to N. (0=Don't use)", "N", NULL},
@@ -67,6 +67,8 @@ struct UgetOptionValue
 		char* file;
 		char* user;
 		char* password;
+		char* checksum;
+		char* piece_hashes;
 	} common;
 
 	struct
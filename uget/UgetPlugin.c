@@ -179,37 +179,40 @@ int  uget_plugin_get_state(UgetPlugin* plugin)
 	return is_active;
 }
 
+// Plug-in threads push events to lock-free stack. uget_plugin_pop() takes
+// all of them at once and reverts order, so it doesn't need mutex too.
 void  uget_plugin_post(UgetPlugin* plugin, UgetEvent* message)
 {
-	ug_mutex_lock(&plugin->mutex);
-	if (plugin->events)
-		plugin->events->prev = message;
-	message->next = plugin->events;
-	plugin->events = message;
-	ug_mutex_unlock(&plugin->mutex);
+	UgetEvent*  head;
+
+	message->prev = NULL;
+	do {
+		head = ug_atomic_load_ptr(&plugin->events);
+		message->next = head;
+	} while (ug_atomic_cas_ptr(&plugin->events, head, message) == FALSE);
 }
 
 UgetEvent* uget_plugin_pop(UgetPlugin* plugin)
 {
 	UgetEvent*  curr;
 	UgetEvent*  next;
+	UgetEvent*  prev;
 
-	ug_mutex_lock(&plugin->mutex);
-	curr = plugin->events;
-	plugin->events = NULL;
-	ug_mutex_unlock(&plugin->mutex);
+	// avoid atomic swap if there is no event.
+	if (ug_atomic_load_ptr(&plugin->events) == NULL)
+		return NULL;
+	curr = ug_atomic_swap_ptr(&plugin->events, NULL);
 
 	// revert
-	while (curr) {
+	for (prev = NULL;  curr;  curr = next) {
 		next = curr->next;
-		curr->next = curr->prev;
-		curr->prev = next;
-		if (next == NULL)
-			break;
-		curr = next;
+		curr->next = prev;
+		if (prev)
+			prev->prev = curr;
+		prev = curr;
 	}
+	if (prev)
+		prev->prev = NULL;
 
-	return curr;
+	return prev;
 }
-
-
@@ -60,6 +60,11 @@ typedef enum {
 	// state ----------------
 	UGET_PLUGIN_SET_STATE,     // int*, TRUE or FALSE  (unused)
 	UGET_PLUGIN_GET_STATE,     // int*, TRUE or FALSE
+
+	// input ----------------
+	// append new code here, plug-ins built with old header use the values above.
+	UGET_PLUGIN_CTRL_BUCKET,   // UgetBucket*, limit download speed by token bucket
+	UGET_PLUGIN_CTRL_HOST,     // UgetHost*, root of connection budget
 } UgetPluginCtrlCode;
 
 // global
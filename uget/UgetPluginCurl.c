@@ -38,6 +38,10 @@
 #define _CRT_SECURE_NO_WARNINGS
 #endif
 
+#if defined __linux__ && !defined _GNU_SOURCE
+#define _GNU_SOURCE      // fallocate()
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include <config.h>
 #endif
@@ -60,8 +64,12 @@
 #include <winsock2.h>
 #define  ug_sleep       Sleep
 #else
-#include <fcntl.h>   // posix_fallocate()
+#include <fcntl.h>   // posix_fallocate(), fallocate()
 #include <unistd.h>  // sleep(), usleep()
+#if defined __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>    // FS_IOC_FSSETXATTR
+#endif
 #define  ug_sleep(millisecond)    usleep(millisecond * 1000)
 #endif // _WIN32 || _WIN64
 
@@ -70,9 +78,26 @@
 #endif
 
 #define MIN_SPLIT_SIZE       (10 * 1024 * 1024)  // can't less than 16384 x 2
+#define MIN_STEAL_SIZE       (1024 * 1024)       // can't less than 16384
+#define MIN_STEAL_TIME       5       // seconds, remaining time of slowest segment
 #define MIN_SPEED_LIMIT      256     // speed control
+#define EXTENT_SIZE_HINT     (16 * 1024 * 1024)  // for UGET_PREALLOCATE_xxx
+#define SPEED_INTERVAL       1000    // milliseconds, adjust speed limit
+#define SAVE_INTERVAL        2000    // milliseconds, save aria2 control file
 #define MAX_REPEAT_DIGITS    5       //  + '.' + digits
 #define MAX_REPEAT_COUNTS    10000   // <= 9999
+#define MAX_URI_ERRORS       3       // URI is unhealthy if it failed too many times
+#define CHECKSUM_BUFFER_SIZE 65536   // bytes, read back data for checksum
+#define CHECKSUM_READ_LIMIT  (8 * 1024 * 1024)  // read back at most in each loop
+#define POOL_SIZE            16      // max idle UgetCurl in global pool
+
+// state of piece (UgetPluginCurl::pieces.state)
+enum {
+	PIECE_UNVERIFIED,
+	PIECE_PENDING,       // segment may complete it, verify it in next loop
+	PIECE_VERIFIED,
+	PIECE_CORRUPTED,     // erased, waiting for split_download()
+};
 
 typedef struct UriLink      UriLink;
 
@@ -82,6 +107,10 @@ struct UriLink {
 //	UriLink* next;
 //	UriLink* prev;
 
+	int64_t  speed;      // rolling throughput per connection, see score_uris()
+	int      errors;     // number of failed segments (decreased if completed)
+	UgetHost* host;      // connection budget, NULL if it is unlimited
+
 	uint8_t  scheme_type;
 	uint8_t  resumable:1;
 	uint8_t  tested:1;
@@ -127,7 +156,114 @@ static struct
 {
 	int  initialized;
 	int  ref_count;
-} global = {0, 0};
+	int  engine_threads;    // UGET_PLUGIN_CURL_GLOBAL_ENGINE
+	int  buffer_size;       // UGET_PLUGIN_CURL_GLOBAL_BUFFER_SIZE
+	int  split;             // UGET_PLUGIN_CURL_GLOBAL_SPLIT
+	int  control;           // UGET_PLUGIN_CURL_GLOBAL_CONTROL
+	int  save_interval;     // UGET_PLUGIN_CURL_GLOBAL_SAVE_INTERVAL
+	int  output;            // UGET_PLUGIN_CURL_GLOBAL_OUTPUT
+
+	// DNS cache and TLS sessions are shared by all segments and downloads.
+	// Connection cache is not shared: segments run on different threads at
+	// the same time. Cookies are not shared: downloads have different
+	// cookie settings.
+	CURLSH*  share;
+	UgMutex  share_mutex[CURL_LOCK_DATA_LAST];
+
+	// idle UgetCurl that left by stopped downloads. They keep easy handle,
+	// new download take them instead of creating new one.
+	struct {
+		UgMutex    mutex;
+		UgetCurl*  head;     // singly linked by UgetCurl::next
+		int        size;
+	} pool;
+
+	// write-behind buffer pool and disk writer threads,
+	// UGET_PLUGIN_CURL_OUTPUT_WRITE_BEHIND create it.
+	UgetWriter*  writer;
+} global = {0, 0, -1, 0, UGET_PLUGIN_CURL_SPLIT_THROUGHPUT,
+              UGET_PLUGIN_CURL_CONTROL_REWRITE, SAVE_INTERVAL,
+              UGET_PLUGIN_CURL_OUTPUT_PWRITE, NULL};
+
+static void  share_lock(CURL* curl, curl_lock_data data,
+                        curl_lock_access access, void* user)
+{
+	ug_mutex_lock(&global.share_mutex[data]);
+}
+
+static void  share_unlock(CURL* curl, curl_lock_data data, void* user)
+{
+	ug_mutex_unlock(&global.share_mutex[data]);
+}
+
+static void  share_init(void)
+{
+	int  index;
+
+	global.share = curl_share_init();
+	if (global.share == NULL)
+		return;
+	for (index = 0;  index < CURL_LOCK_DATA_LAST;  index++)
+		ug_mutex_init(&global.share_mutex[index]);
+	curl_share_setopt(global.share, CURLSHOPT_LOCKFUNC, share_lock);
+	curl_share_setopt(global.share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+	curl_share_setopt(global.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(global.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+static void  share_cleanup(void)
+{
+	int  index;
+
+	if (global.share == NULL)
+		return;
+	curl_share_cleanup(global.share);
+	global.share = NULL;
+	for (index = 0;  index < CURL_LOCK_DATA_LAST;  index++)
+		ug_mutex_clear(&global.share_mutex[index]);
+}
+
+// add idle UgetCurl to pool, it will be freed if pool is full.
+// Pool saves allocation and option setup, connections of easy handle may be
+// reused only if the next download use the same host.
+static void  pool_push(UgetCurl* ugcurl)
+{
+	uget_curl_reset(ugcurl, TRUE);
+	ug_mutex_lock(&global.pool.mutex);
+	if (global.pool.size < POOL_SIZE) {
+		ugcurl->next = global.pool.head;
+		global.pool.head = ugcurl;
+		global.pool.size++;
+		ugcurl = NULL;
+	}
+	ug_mutex_unlock(&global.pool.mutex);
+	if (ugcurl)
+		uget_curl_free(ugcurl);
+}
+
+// return NULL if pool is empty.
+static UgetCurl*  pool_pop(void)
+{
+	UgetCurl*  ugcurl;
+
+	ug_mutex_lock(&global.pool.mutex);
+	ugcurl = global.pool.head;
+	if (ugcurl) {
+		global.pool.head = ugcurl->next;
+		global.pool.size--;
+		ugcurl->next = NULL;
+	}
+	ug_mutex_unlock(&global.pool.mutex);
+	return ugcurl;
+}
+
+static void  pool_clear(void)
+{
+	UgetCurl*  ugcurl;
+
+	while ((ugcurl = pool_pop()))
+		uget_curl_free(ugcurl);
+}
 
 static UgetResult  global_init(void)
 {
@@ -144,6 +280,15 @@ static UgetResult  global_init(void)
 			return UGET_RESULT_ERROR;
 		}
 		global.initialized = TRUE;
+		ug_mutex_init(&global.pool.mutex);
+		share_init();
+		if (global.engine_threads)
+			uget_curl_engine_start(global.engine_threads);
+		if (global.output == UGET_PLUGIN_CURL_OUTPUT_WRITE_BEHIND ||
+		    global.output == UGET_PLUGIN_CURL_OUTPUT_DIRECT)
+		{
+			global.writer = uget_writer_new(0, 0, 0);
+		}
 	}
 	global.ref_count++;
 
@@ -163,6 +308,18 @@ static void  global_unref(void)
 	global.ref_count--;
 	if (global.ref_count == 0) {
 		global.initialized  = FALSE;
+		// no plug-in is running, stop curl_multi threads.
+		uget_curl_engine_stop();
+		// all files have been flushed and closed.
+		if (global.writer) {
+			uget_writer_free(global.writer);
+			global.writer = NULL;
+		}
+		// easy handles in pool use share handle, free them first.
+		pool_clear();
+		ug_mutex_clear(&global.pool.mutex);
+		// all easy handles have been freed, share handle is not in use.
+		share_cleanup();
 		curl_global_cleanup();
 #if defined _WIN32 || defined _WIN64
 		WSACleanup();
@@ -181,6 +338,41 @@ static UgetResult  global_set(int option, void* parameter)
 			global_unref();
 		break;
 
+	case UGET_PLUGIN_CURL_GLOBAL_ENGINE:
+		global.engine_threads = (int)(intptr_t) parameter;
+		if (global.initialized)
+			uget_curl_engine_start(global.engine_threads);
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_BUFFER_SIZE:
+		global.buffer_size = (int)(intptr_t) parameter;
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_SPLIT:
+		global.split = (int)(intptr_t) parameter;
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_CONTROL:
+		global.control = (int)(intptr_t) parameter;
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_SAVE_INTERVAL:
+		global.save_interval = (int)(intptr_t) parameter;
+		if (global.save_interval <= 0)
+			global.save_interval = SAVE_INTERVAL;
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_OUTPUT:
+		global.output = (int)(intptr_t) parameter;
+		// running downloads may use writer, it is freed by global_unref()
+		if (global.initialized && global.writer == NULL &&
+		    (global.output == UGET_PLUGIN_CURL_OUTPUT_WRITE_BEHIND ||
+		     global.output == UGET_PLUGIN_CURL_OUTPUT_DIRECT))
+		{
+			global.writer = uget_writer_new(0, 0, 0);
+		}
+		break;
+
 	default:
 		return UGET_RESULT_UNSUPPORT;
 	}
@@ -196,6 +388,45 @@ static UgetResult  global_get(int option, void* parameter)
 			*(int*)parameter = global.initialized;
 		break;
 
+	case UGET_PLUGIN_CURL_GLOBAL_ENGINE:
+		if (parameter)
+			*(int*)parameter = uget_curl_engine_get_threads();
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_BUFFER_SIZE:
+		if (parameter)
+			*(int*)parameter = global.buffer_size;
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_SPLIT:
+		if (parameter)
+			*(int*)parameter = global.split;
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_CONTROL:
+		if (parameter)
+			*(int*)parameter = global.control;
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_SAVE_INTERVAL:
+		if (parameter)
+			*(int*)parameter = global.save_interval;
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_OUTPUT:
+		if (parameter)
+			*(int*)parameter = global.output;
+		break;
+
+	case UGET_PLUGIN_CURL_GLOBAL_WRITER_STATS:
+		if (parameter == NULL)
+			break;
+		if (global.writer)
+			uget_writer_get_stats(global.writer, parameter);
+		else
+			memset(parameter, 0, sizeof(UgetWriterStats));
+		break;
+
 	default:
 		return UGET_RESULT_UNSUPPORT;
 	}
@@ -214,12 +445,25 @@ static void plugin_init(UgetPluginCurl* plugin)
 		global_ref();
 
 	ug_list_init(&plugin->segment.list);
+	ug_list_init(&plugin->segment.idle);
+	uget_curl_notify_init(&plugin->notify);
+	uget_curl_output_init(&plugin->output);
+	uget_writer_file_init(&plugin->writer, NULL);
+	plugin->checksum.fd = -1;
+	plugin->pieces.fd = -1;
 	plugin->file.time = -1;
 	plugin->synced = TRUE;
 	plugin->paused = TRUE;
 	plugin->stopped = TRUE;
 }
 
+static void uri_link_free(UriLink* uri_link)
+{
+	if (uri_link->host)
+		uget_host_unref(uri_link->host);
+	ug_free(uri_link);
+}
+
 static void plugin_final(UgetPluginCurl* plugin)
 {
 	if (plugin->common)
@@ -233,13 +477,19 @@ static void plugin_final(UgetPluginCurl* plugin)
 	if (plugin->ftp)
 		ug_data_free(plugin->ftp);
 	// free uri.list (UriLink), all link will be freed.
-	ug_list_foreach(&plugin->uri.list, (UgForeachFunc) ug_free, NULL);
+	ug_list_foreach(&plugin->uri.list, (UgForeachFunc) uri_link_free, NULL);
 
 //	curl_slist_free_all(plugin->ftp_command);
 	ug_free(plugin->folder.path);
 	ug_free(plugin->file.name_fmt);
 	ug_free(plugin->file.path);
 	ug_free(plugin->aria2.path);
+	uget_curl_notify_clear(&plugin->notify);
+	uget_curl_output_clear(&plugin->output);
+	if (plugin->bucket)
+		uget_bucket_unref(plugin->bucket);
+	if (plugin->host.root)
+		uget_host_unref(plugin->host.root);
 
 	global_unref();
 }
@@ -249,6 +499,7 @@ static void plugin_final(UgetPluginCurl* plugin)
 
 static int  plugin_ctrl_speed(UgetPluginCurl* plugin, int* speed);
 static int  plugin_start(UgetPluginCurl* plugin);
+static void release_reserved(UgetPluginCurl* plugin);
 
 static int  plugin_ctrl(UgetPluginCurl* plugin, int code, void* data)
 {
@@ -260,12 +511,35 @@ static int  plugin_ctrl(UgetPluginCurl* plugin, int code, void* data)
 
 	case UGET_PLUGIN_CTRL_STOP:
 		plugin->paused = TRUE;
+		uget_curl_notify_post(&plugin->notify);
 		return TRUE;
 
 	case UGET_PLUGIN_CTRL_SPEED:
 		// speed control
 		return plugin_ctrl_speed(plugin, data);
 
+	case UGET_PLUGIN_CTRL_BUCKET:
+		// segments are using bucket, it can't be replaced now.
+		if (plugin->stopped == FALSE)
+			break;
+		if (data)
+			uget_bucket_ref(data);
+		if (plugin->bucket)
+			uget_bucket_unref(plugin->bucket);
+		plugin->bucket = data;
+		return TRUE;
+
+	case UGET_PLUGIN_CTRL_HOST:
+		// segments are holding connections, it can't be replaced now.
+		if (plugin->stopped == FALSE)
+			break;
+		if (data)
+			uget_host_ref(data);
+		if (plugin->host.root)
+			uget_host_unref(plugin->host.root);
+		plugin->host.root = data;
+		return TRUE;
+
 	// state ----------------
 	case UGET_PLUGIN_GET_STATE:
 		*(int*)data = (plugin->stopped) ? FALSE : TRUE;
@@ -312,6 +586,8 @@ static int  plugin_ctrl_speed(UgetPluginCurl* plugin, int* speed)
 		}
 		plugin->limit.upload = value;
 	}
+	if (plugin->limit_changed && plugin->stopped == FALSE)
+		uget_curl_notify_post(&plugin->notify);
 	return plugin->limit_changed;
 }
 
@@ -323,6 +599,7 @@ static int  plugin_sync(UgetPluginCurl* plugin, UgInfo* node_info)
 	UgetCommon*    common;
 	UgetFiles*     files;
 	UgetProgress*  progress;
+	UgSeq          seq;
 	char*          name;
 	int            speed[2];
 
@@ -353,17 +630,22 @@ static int  plugin_sync(UgetPluginCurl* plugin, UgInfo* node_info)
 	plugin->common->retry_limit = common->retry_limit;
 	if (common->max_connections > 0)
 		plugin->segment.n_max = common->max_connections;
+	// wake up plugin_thread() to count progress for next sync
+	if (plugin->stopped == FALSE)
+		uget_curl_notify_post(&plugin->notify);
 
 	progress = ug_info_realloc(node_info, UgetProgressInfo);
-	progress->upload_speed   = plugin->speed.upload;
-	progress->download_speed = plugin->speed.download;
-
-	progress->uploaded   = plugin->size.upload;
-	progress->complete   = plugin->size.download;
-
-	if (plugin->file.size > 0)
-		progress->total = plugin->file.size;
-	else
+	do {
+		seq = ug_seq_read_begin(&plugin->snapshot.seq);
+		progress->upload_speed   = (int) plugin->snapshot.upload_speed;
+		progress->download_speed = (int) plugin->snapshot.download_speed;
+		progress->uploaded   = plugin->snapshot.upload;
+		progress->complete   = plugin->snapshot.download;
+		progress->total      = plugin->snapshot.total;
+		progress->wasted     = plugin->snapshot.wasted;
+	} while (ug_seq_read_retry(&plugin->snapshot.seq, seq));
+
+	if (progress->total == 0)
 		progress->total = progress->complete;
 
 	if (progress->total > 0)
@@ -379,11 +661,13 @@ static int  plugin_sync(UgetPluginCurl* plugin, UgInfo* node_info)
 	// consume time
 	progress->elapsed = time(NULL) - plugin->start_time;
 
-	// update UgetFiles
+	// update UgetFiles if plug-in changed it.
 	files = ug_info_realloc(node_info, UgetFilesInfo);
-	uget_plugin_lock(plugin);
-	uget_files_sync(files, plugin->files);
-	uget_plugin_unlock(plugin);
+	if (ug_atomic_load_int(&plugin->files->sync_count) != files->sync_count) {
+		uget_plugin_lock(plugin);
+		uget_files_sync(files, plugin->files);
+		uget_plugin_unlock(plugin);
+	}
 	// set name
 	if (plugin->file_renamed && plugin->file.path) {
 		plugin->file_renamed = FALSE;
@@ -424,6 +708,7 @@ static int  plugin_accept(UgetPluginCurl* plugin, UgInfo* node_info)
 		UgetProxy*   proxy;
 		UgetHttp*    http;
 		UgetFtp*     ftp;
+		UgetProgress* progress;
 	} temp;
 	int  speed[2];
 
@@ -475,15 +760,41 @@ static int  plugin_accept(UgetPluginCurl* plugin, UgInfo* node_info)
 	if (temp.ftp)
 		plugin->ftp = ug_data_copy(temp.ftp);
 
+	// recover_file_info() need it if aria2 control file is lost.
+	temp.progress = ug_info_get(node_info, UgetProgressInfo);
+	if (temp.progress)
+		plugin->file.size_last = temp.progress->total;
+
 	return TRUE;
 }
 
 static int  plugin_start(UgetPluginCurl* plugin)
 {
 	UgThread    thread;
+	UriLink*    uri_link;
 	int         ok;
 
 	plugin->start_time = time(NULL);
+	// standalone plug-in has it's own bucket to limit download speed.
+	if (plugin->bucket == NULL)
+		plugin->bucket = uget_bucket_new(NULL);
+	uget_bucket_set_rate(plugin->bucket, plugin->limit.download);
+	// URIs were added before UgetTask set host.root
+	if (plugin->host.root) {
+		uri_link = (UriLink*) plugin->uri.list.head;
+		for (;  uri_link;  uri_link = uri_link->next) {
+			if (uri_link->host == NULL)
+				uri_link->host = uget_host_find(plugin->host.root, uri_link->uri);
+		}
+		// reserve the first connection before uget_app_queuing() check
+		// spare connections of host again.
+		uri_link = (UriLink*) plugin->uri.link;
+		if (uri_link && uri_link->host) {
+			uget_host_acquire(uri_link->host, 0, TRUE);
+			uget_host_ref(uri_link->host);
+			plugin->host.reserved = uri_link->host;
+		}
+	}
 	// try to start thread
 	plugin->paused = FALSE;
 	plugin->stopped = FALSE;
@@ -495,6 +806,7 @@ static int  plugin_start(UgetPluginCurl* plugin)
 		// failed to start thread -----------------
 		plugin->paused = TRUE;
 		plugin->stopped = TRUE;
+		release_reserved(plugin);
 		// post error message and decreases the reference count
 		uget_plugin_post((UgetPlugin*) plugin,
 				uget_event_new_error(UGET_EVENT_ERROR_THREAD_CREATE_FAILED,
@@ -522,11 +834,22 @@ static UriLink* plugin_replace_uri(UgetPluginCurl* plugin, UriLink* old_link,
 	uri_link->resumable = FALSE;
 	uri_link->tested = FALSE;
 	uri_link->ok = FALSE;
+	uri_link->speed = 0;
+	uri_link->errors = 0;
+	uri_link->host = NULL;
 
 	// add to list
-	if (old_link == NULL)
+	if (old_link == NULL) {
+		if (plugin->host.root)
+			uri_link->host = uget_host_find(plugin->host.root, uri_link->uri);
 		ug_list_append(&plugin->uri.list, (void*) uri_link);
+	}
 	else {
+		uri_link->speed = old_link->speed;
+		uri_link->errors = old_link->errors;
+		// redirected connections are counted in host of original URI.
+		uri_link->host = old_link->host;
+		old_link->host = NULL;
 		ug_list_insert(&plugin->uri.list, (void*) old_link,
 				(void*) uri_link);
 		ug_list_remove(&plugin->uri.list, (void*) old_link);
@@ -612,26 +935,57 @@ static void  plugin_decide_files(UgetPluginCurl* plugin)
 // plugin_thread
 
 #define N_THREAD(plugin)   ((plugin)->segment.list.size)
+// speed of segment is unreliable until it downloaded 2 seconds of data.
+#define SPEED_KNOWN(ugcurl)  \
+		((ugcurl)->speed[0] > 0 && (ugcurl)->size[0] >= (ugcurl)->speed[0] * 2)
 
 static void delay_ms(UgetPluginCurl* plugin, int  milliseconds);
-static int  switch_uri(UgetPluginCurl* plugin, UgetCurl* ugcurl, int is_resumable);
+static int  switch_uri(UgetPluginCurl* plugin, UgetCurl* ugcurl, int skip_current);
+static int  acquire_host(UgetPluginCurl* plugin, UgetHost* host, int force);
+static void release_host(UgetPluginCurl* plugin, UgetCurl* ugcurl);
+static void score_uris(UgetPluginCurl* plugin);
 static int  prepare_file(UgetCurl* ugcurl, UgetPluginCurl* plugin);
+static int  preallocate_file(UgetPluginCurl* plugin, int fd);
+static int  preallocate_mode(UgetPluginCurl* plugin);
+static void check_mapped(UgetPluginCurl* plugin);
 static char* get_repeating_fmt_string(char* filename);
 static void complete_file(UgetPluginCurl* plugin);
+static void save_control_file(UgetPluginCurl* plugin);
+static void publish_progress(UgetPluginCurl* plugin);
 static int  load_file_info(UgetPluginCurl* plugin);
+static int  recover_file_info(UgetPluginCurl* plugin, char* path, int length);
 static void clear_file_info(UgetPluginCurl* plugin);
 static int  reuse_download(UgetPluginCurl* plugin, UgetCurl* ugcurl, int next_uri);
 static int  split_download(UgetPluginCurl* plugin, UgetCurl* ugcurl);
+static void resolve_endgame(UgetPluginCurl* plugin);
 static void adjust_speed_limit(UgetPluginCurl* plugin);
-static UgetCurl* create_segment(UgetPluginCurl* plugin);
+static UgetCurl* create_segment(UgetPluginCurl* plugin, int force);
+static void free_segment(UgetPluginCurl* plugin, UgetCurl* ugcurl);
+static UgetCurl* take_idle(UgetPluginCurl* plugin, UriLink* uri_link);
+static void start_checksum(UgetPluginCurl* plugin);
+static int  update_checksum(UgetPluginCurl* plugin);
+static void stop_checksum(UgetPluginCurl* plugin);
+static int  verify_checksum(UgetPluginCurl* plugin);
+static void start_pieces(UgetPluginCurl* plugin);
+static void stop_pieces(UgetPluginCurl* plugin);
+static int  pieces_usable(UgetPluginCurl* plugin);
+static void mark_pieces(UgetPluginCurl* plugin, int64_t beg, int64_t end);
+static int  check_pieces(UgetPluginCurl* plugin, int all);
+static int  requeue_piece(UgetPluginCurl* plugin, uint64_t* beg, uint64_t* end);
 
 static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 {
 	UgetCommon* common;
 	UgetCurl*   ugcurl;
 	UgetCurl*   ugnext;
-	int         counter;
+	UriLink*    uri_link;
+	uint64_t    time_now;
+	uint64_t    time_speed;    // next time to adjust speed limit
+	uint64_t    time_save;     // next time to save aria2 control file
+	int         timeout;
 	int         n_active_last = 0;
+	int         checksum_behind = FALSE;
+	int         lacking = TRUE;
 	struct {
 		int64_t upload;
 		int64_t download;
@@ -642,15 +996,43 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 	plugin->segment.n_max = common->max_connections;
 	if (plugin->segment.n_max == 0)
 		plugin->segment.n_max = 1;
+	plugin->segment.endgame = FALSE;
+	start_checksum(plugin);
+	start_pieces(plugin);
+	// UgetCommon::output override plug-in setting.
+	if (common->output == UGET_OUTPUT_MMAP)
+		plugin->output.mapped = TRUE;
+	// fall back to pwrite() if io_uring is not available.
+	else if (global.output == UGET_PLUGIN_CURL_OUTPUT_IO_URING)
+		plugin->output.uring = uget_uring_new(0, 0);
+	else if ((global.output == UGET_PLUGIN_CURL_OUTPUT_WRITE_BEHIND ||
+	          global.output == UGET_PLUGIN_CURL_OUTPUT_DIRECT) &&
+	         global.writer)
+	{
+		uget_writer_file_init(&plugin->writer, global.writer);
+		plugin->output.writer = &plugin->writer;
+		plugin->output.direct = (global.output == UGET_PLUGIN_CURL_OUTPUT_DIRECT);
+	}
 
 	// create new segment and add it to segment.list
-	ugcurl = create_segment(plugin);
+	ugcurl = create_segment(plugin, TRUE);
+	release_reserved(plugin);
 	if (load_file_info(plugin)) {
-		uget_curl_open_file(ugcurl, plugin->file.path);
+		plugin->writer.size = plugin->file.size;
+		if (uget_curl_open_file(ugcurl, plugin->file.path))
+			check_mapped(plugin);
 		ugcurl->beg = plugin->segment.beg;
-		uget_a2cf_lack(&plugin->aria2.ctrl,
-		               (uint64_t*) &ugcurl->beg,
-		               (uint64_t*) &ugcurl->end);
+		lacking = uget_a2cf_lack(&plugin->aria2.ctrl,
+		                         (uint64_t*) &ugcurl->beg,
+		                         (uint64_t*) &ugcurl->end);
+		// all data was downloaded in previous run, but checksum didn't match.
+		// corrupted pieces will be erased and downloaded again.
+		if (lacking == FALSE && check_pieces(plugin, TRUE) == FALSE &&
+		    plugin->paused == FALSE)
+		{
+			lacking = requeue_piece(plugin, (uint64_t*) &ugcurl->beg,
+			                        (uint64_t*) &ugcurl->end);
+		}
 		plugin->segment.beg = ugcurl->end;
 		// plugin_sync() will set foreign UgetCommon::name
 		plugin->file_renamed = TRUE;
@@ -662,21 +1044,46 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 		ugcurl->prepare.data = plugin;
 		ugcurl->header_store = TRUE;
 	}
-	ug_list_append(&plugin->segment.list, (void*) ugcurl);
-
-	// start curl
-	uget_curl_run(ugcurl, FALSE);
+	if (lacking) {
+		ug_list_append(&plugin->segment.list, (void*) ugcurl);
+		publish_progress(plugin);
+		// start curl
+		uget_curl_run(ugcurl, FALSE);
+	}
+	else {
+		// nothing to download, verify checksum again.
+		free_segment(plugin, ugcurl);
+		if (plugin->paused == FALSE)
+			complete_file(plugin);
+	}
+	time_now = ug_get_time_count();
+	uget_rate_init(&plugin->rate, UGET_RATE_WINDOW);
+	uget_rate_update(&plugin->rate, plugin->size.download, time_now);
+	time_speed = time_now + SPEED_INTERVAL;
+	time_save  = time_now + global.save_interval;
+	timeout = -1;
 
 	// main loop
-	for (counter = 0;  N_THREAD(plugin) > 0;  counter++) {
-		// sleep 0.5 second
-		ug_sleep(500);
+	while (N_THREAD(plugin) > 0) {
+		// wait until UgetCurl state changed, user control or timer expired.
+		uget_curl_notify_wait(&plugin->notify, timeout);
+		time_now = ug_get_time_count();
+		// copy progress of all segments, plug-in use it in this loop.
+		ugcurl = (UgetCurl*) plugin->segment.list.head;
+		for (;  ugcurl;  ugcurl = ugcurl->next)
+			uget_curl_load_progress(ugcurl);
+		// cancel the loser of duplicated tail ranges before counting them
+		if (plugin->segment.endgame)
+			resolve_endgame(plugin);
+		// verify pieces before counting, corrupted one will be erased.
+		if (plugin->pieces.n_pending)
+			check_pieces(plugin, FALSE);
+
 		// reset data, plug-in will count them (in segment loop) later
 		plugin->segment.n_active = 0;
 		size.upload = 0;
 		size.download = 0;
 		speed.upload = 0;
-		speed.download = 0;
 
 		// segment loop
 		ugcurl = (UgetCurl*) plugin->segment.list.head;
@@ -684,6 +1091,7 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 			ugnext = ugcurl->next;
 
 			// split download, use these code with split_download()
+			// split_download() has cut the end of previous segment.
 			if (ugcurl->split) {
 				if (ugcurl->prev == NULL || ugcurl->prev->end < ugcurl->beg)
 					ugcurl->split = FALSE;
@@ -691,7 +1099,7 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 					// if previous segment overwrite current one.
 					ugcurl->split = FALSE;
 					ugcurl->paused = TRUE;
-					ugcurl->end = ugcurl->beg;
+					uget_curl_set_end(ugcurl, ugcurl->beg);
 					ugcurl->pos = ugcurl->beg;
 					ugcurl->size[0] = 0;
 #ifndef NDEBUG
@@ -703,15 +1111,9 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 #endif
 				}
 				else if (ugcurl->beg < ugcurl->pos) {
-					// If this segment has downloaded data,
-					// plug-in split new segment from previous one.
+					// If this segment has downloaded data, it can't give
+					// it's range back to previous one. see reuse_download()
 					ugcurl->split = FALSE;
-					ugcurl->prev->end = ugcurl->beg;
-					if (ugcurl->prev->pos > ugcurl->beg) {
-						ugcurl->prev->pos = ugcurl->beg;
-						ugcurl->prev->size[0] = ugcurl->prev->pos -
-						                        ugcurl->prev->beg;
-					}
 #ifndef NDEBUG
 					if (common->debug_level) {
 						printf("\n"
@@ -728,22 +1130,32 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 				plugin->segment.n_max = 0;
 			}
 			// update aria2 control file progress
-			if (plugin->aria2.path)
+			if (plugin->aria2.path) {
 				uget_a2cf_fill(&plugin->aria2.ctrl, ugcurl->beg, ugcurl->pos);
+				if (plugin->pieces.state)
+					mark_pieces(plugin, ugcurl->beg, ugcurl->pos);
+			}
 			// progress
 			if (ugcurl->state >= UGET_CURL_OK) {
-				// ugcurl has stopped
+				// ugcurl has stopped, it may stop after loading progress.
+				uget_curl_load_progress(ugcurl);
 				plugin->base.upload += ugcurl->size[1];
 				plugin->base.download += ugcurl->size[0];
+				plugin->wasted += ugcurl->wasted;
+				ugcurl->wasted = 0;
 			}
 			else if (ugcurl->state == UGET_CURL_RUN) {
 				size.upload += ugcurl->size[1];
-				size.download += ugcurl->size[0];
+				// count bytes that previous segment doesn't have in endgame
+				if (ugcurl->endgame == FALSE)
+					size.download += ugcurl->size[0];
+				else if (ugcurl->pos > ugcurl->prev->pos)
+					size.download += ugcurl->pos - ugcurl->prev->pos;
 				speed.upload += ugcurl->speed[1];
-				speed.download += ugcurl->speed[0];
 			}
 
 			// handle UgetCurl by state
+			uri_link = ugcurl->uri.link;
 			switch (ugcurl->state) {
 			default:
 				break;
@@ -753,23 +1165,36 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 				break;
 
 			case UGET_CURL_OK:
+				// URI recovers from errors
+				if (uri_link->errors > 0)
+					uri_link->errors--;
+				// segment stopped at the cut that split_download() made,
+				// but split segment has given that range back.
+				if (ugcurl->end > 0 && ugcurl->pos < ugcurl->end &&
+				    plugin->paused == FALSE)
+				{
+					uget_curl_set_beg(ugcurl, ugcurl->pos);
+					uget_curl_run(ugcurl, FALSE);
+					break;
+				}
 				ugcurl->state = UGET_CURL_RESPLIT;
 				// special case for unknown file size
 				if (plugin->file.size == 0 && N_THREAD (plugin) == 1) {
 					complete_file(plugin);
 					// delete download
 					ug_list_remove(&plugin->segment.list, (void*)ugcurl);
-					uget_curl_free(ugcurl);
+					free_segment(plugin, ugcurl);
 				}
 				break;
 
 			case UGET_CURL_ABORT:
 				// delete download
 				ug_list_remove(&plugin->segment.list, (void*)ugcurl);
-				uget_curl_free(ugcurl);
+				free_segment(plugin, ugcurl);
 				break;
 
 			case UGET_CURL_ERROR:
+				uri_link->errors++;
 				// if no other downloading segment, plug-in response error
 				if (N_THREAD(plugin) == 1) {
 					// post error message
@@ -779,7 +1204,7 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 					}
 					// delete download
 					ug_list_remove(&plugin->segment.list, (void*)ugcurl);
-					uget_curl_free(ugcurl);
+					free_segment(plugin, ugcurl);
 				}
 				else {
 					// try to reuse download
@@ -788,20 +1213,21 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 				break;
 
 			case UGET_CURL_RETRY:
+				uri_link->errors++;
 				// if no other downloading segment
 				if (N_THREAD(plugin) == 1) {
 					common->retry_count++;
 					if (common->retry_count < common->retry_limit ||
 					    common->retry_limit == 0)
 					{
-						ugcurl->beg = ugcurl->pos;
+						uget_curl_set_beg(ugcurl, ugcurl->pos);
 						delay_ms(plugin, common->retry_delay * 1000);
 						uget_curl_run(ugcurl, FALSE);
 					}
 					else {
 						// delete segment
 						ug_list_remove(&plugin->segment.list, (void*)ugcurl);
-						uget_curl_free(ugcurl);
+						free_segment(plugin, ugcurl);
 					}
 				}
 				else {
@@ -811,6 +1237,7 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 				break;
 
 			case UGET_CURL_NOT_RESUMABLE:
+				uri_link->errors++;
 				// if no other downloading segment
 				if (N_THREAD(plugin) == 1) {
 					uget_plugin_post((UgetPlugin*) plugin,
@@ -822,8 +1249,8 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 					{
 						plugin->base.download = 0;
 						plugin->size.download = 0;
-						ugcurl->beg = 0;
-						ugcurl->end = plugin->file.size;
+						uget_curl_set_beg(ugcurl, 0);
+						uget_curl_set_end(ugcurl, plugin->file.size);
 						delay_ms(plugin, common->retry_delay * 1000);
 						switch_uri(plugin, ugcurl, TRUE);
 						uget_curl_run(ugcurl, FALSE);
@@ -831,7 +1258,7 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 					else {
 						// delete download
 						ug_list_remove(&plugin->segment.list, (void*)ugcurl);
-						uget_curl_free(ugcurl);
+						free_segment(plugin, ugcurl);
 					}
 				}
 				else {
@@ -850,19 +1277,27 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 				if (split_download(plugin, ugcurl) == FALSE) {
 					// delete download
 					ug_list_remove(&plugin->segment.list, (void*)ugcurl);
-					uget_curl_free(ugcurl);
+					free_segment(plugin, ugcurl);
 				}
 			}
 		}
+		// checksum ---------------------
+		// read back data that segments wrote ahead of checksum position.
+		if (plugin->output.checksum && plugin->aria2.path)
+			checksum_behind = update_checksum(plugin);
 		// progress ---------------------
 		plugin->size.upload = plugin->base.upload + size.upload;
 		plugin->size.download = plugin->base.download + size.download;
 		// Don't update speed when stopping
 		if (plugin->segment.list.size) {
 			plugin->speed.upload = speed.upload;
-			plugin->speed.download = speed.download;
+			// sum of segment speeds jumps when segments start or stop,
+			// estimate download speed from total downloaded size.
+			plugin->speed.download = uget_rate_update(&plugin->rate,
+					plugin->size.download, time_now);
 		}
 		plugin->synced = FALSE;
+		publish_progress(plugin);
 		// check file size --------------
 		if (plugin->file.size) {
 			// response error if file size is different
@@ -897,7 +1332,8 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 			if (plugin->file.size == plugin->size.download) {
 				if (N_THREAD(plugin) > 0)
 					continue;    // wait other thread
-				else {
+				// corrupted pieces will be downloaded again.
+				else if (check_pieces(plugin, TRUE)) {
 					complete_file(plugin);
 					plugin->synced = FALSE;
 					break;
@@ -905,24 +1341,28 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 			}
 		}
 		// timer ------------------------
-		// adjust speed every 0.5 x 2 = 1 second.
-		if ((counter & 1) == 1 || n_active_last != plugin->segment.n_active) {
+		// adjust speed every 1 second or number of active segments changed.
+		if (time_now >= time_speed || plugin->limit_changed ||
+		    n_active_last != plugin->segment.n_active)
+		{
 			n_active_last = plugin->segment.n_active;
 			adjust_speed_limit(plugin);
+			score_uris(plugin);
+			time_speed = time_now + SPEED_INTERVAL;
 		}
-		// save aria2 control file every 0.5 x 4 = 2 seconds.
-		if ((counter & 3) == 3 || N_THREAD(plugin) == 0) {
+		// save aria2 control file every 2 seconds (by default).
+		if (time_now >= time_save || N_THREAD(plugin) == 0) {
 			if (plugin->aria2.path)
-				uget_a2cf_save(&plugin->aria2.ctrl, plugin->aria2.path);
+				save_control_file(plugin);
+			time_save = time_now + global.save_interval;
 		}
-		// split download every 0.5 x 8 = 4 seconds.
-		if ((counter & 7) == 7 && plugin->file.size) {
-			// If some threads are connecting, It doesn't split new segment.
-			if (N_THREAD(plugin) <  plugin->segment.n_max &&
-			    N_THREAD(plugin) == plugin->segment.n_active)
-			{
-				split_download(plugin, NULL);
-			}
+		// split download as soon as all segments are downloading.
+		// If some threads are connecting, It doesn't split new segment.
+		if (plugin->file.size && plugin->paused == FALSE &&
+		    N_THREAD(plugin) <  plugin->segment.n_max &&
+		    N_THREAD(plugin) == plugin->segment.n_active)
+		{
+			split_download(plugin, NULL);
 		}
 		// retry ------------------------
 		if (common->retry_count >= common->retry_limit && common->retry_limit != 0) {
@@ -932,6 +1372,22 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 			plugin->synced = FALSE;
 			plugin->paused = TRUE;
 		}
+		// timeout ----------------------
+		// Timer is useless if no segment is downloading.
+		// UgetCurl will notify plug-in when it's state changed.
+		if (plugin->segment.n_active == 0)
+			timeout = -1;
+		else {
+			timeout = (int) (time_save - time_now);
+			// download speed is limited by bucket, it doesn't need timer.
+			if (plugin->limit.upload) {
+				if (timeout > (int) (time_speed - time_now))
+					timeout = (int) (time_speed - time_now);
+			}
+		}
+		// continue reading back data for checksum
+		if (checksum_behind)
+			timeout = 0;
 	}
 
 	// count the latest downloaded size if download doesn't complete
@@ -939,12 +1395,35 @@ static UgThreadResult  plugin_thread(UgetPluginCurl* plugin)
 		plugin->size.download = uget_a2cf_completed(&plugin->aria2.ctrl);
 		plugin->synced = FALSE;
 	}
+	publish_progress(plugin);
 
 	// free segment list
-	ug_list_foreach(&plugin->segment.list, (UgForeachFunc) uget_curl_free, NULL);
-	ug_list_clear(&plugin->segment.list, FALSE);
+	while (plugin->segment.list.head) {
+		ugcurl = (UgetCurl*) plugin->segment.list.head;
+		ug_list_remove(&plugin->segment.list, (void*) ugcurl);
+		free_segment(plugin, ugcurl);
+	}
+	// give idle segments to other downloads
+	while (plugin->segment.idle.head) {
+		ugcurl = (UgetCurl*) plugin->segment.idle.head;
+		ug_list_remove(&plugin->segment.idle, (void*) ugcurl);
+		pool_push(ugcurl);
+	}
+	// all segments closed file, no data in flight.
+	if (plugin->output.uring) {
+		uget_uring_free(plugin->output.uring);
+		plugin->output.uring = NULL;
+	}
+	plugin->output.writer = NULL;
+	plugin->output.direct = FALSE;
+	plugin->output.mapped = FALSE;
 	//
 	uget_a2cf_clear(&plugin->aria2.ctrl);
+	stop_checksum(plugin);
+	stop_pieces(plugin);
+	// UgetCurl may still hold notify->mutex after it's state changed.
+	// wait for it before releasing plug-in.
+	uget_curl_notify_wait(&plugin->notify, 0);
 	plugin->stopped = TRUE;
 	uget_plugin_unref((UgetPlugin*) plugin);
 	return UG_THREAD_RESULT;
@@ -959,6 +1438,9 @@ static int prepare_existed(UgetCurl* ugcurl, UgetPluginCurl* plugin)
 	if (plugin->file.size) {
 		curl_easy_getinfo(ugcurl->curl,
 				CURLINFO_CONTENT_LENGTH_DOWNLOAD, &fsize);
+		// Content-Length is size of Range if UgetCurl request bounded Range.
+		if (ugcurl->header.size > 0)
+			fsize = (double) (ugcurl->header.size - ugcurl->beg);
 		if (plugin->file.size != ugcurl->beg + (int64_t) fsize) {
 			// if remote file size and local file size are not the same,
 			// plug-in will create new download file.
@@ -971,7 +1453,7 @@ static int prepare_existed(UgetCurl* ugcurl, UgetPluginCurl* plugin)
 			}
 			// don't write INCORRECT data to existed file.
 			ugcurl->event_code = UGET_EVENT_ERROR_INCORRECT_SOURCE;
-			ugcurl->size[0] = 0;
+			uget_curl_reset_progress(ugcurl, ugcurl->beg);
 			return FALSE;
 		}
 	}
@@ -982,6 +1464,7 @@ static int prepare_existed(UgetCurl* ugcurl, UgetPluginCurl* plugin)
 	}
 
 	if (uget_curl_open_file(ugcurl, plugin->file.path)) {
+		check_mapped(plugin);
 		plugin->prepared = TRUE;
 		return TRUE;
 	}
@@ -994,6 +1477,7 @@ static int prepare_existed(UgetCurl* ugcurl, UgetPluginCurl* plugin)
 static int prepare_file(UgetCurl* ugcurl, UgetPluginCurl* plugin)
 {
 	UgetCommon*  common;
+	uint64_t     end;
 	int    length;
 	int    counts;
 	int    value;
@@ -1013,6 +1497,8 @@ static int prepare_file(UgetCurl* ugcurl, UgetPluginCurl* plugin)
 	plugin->file.size = (int64_t) temp.fsize + ugcurl->beg;
 	if (plugin->file.size == -1)
 		plugin->file.size = 0;
+	// disk writer pad the last block of O_DIRECT file
+	plugin->writer.size = plugin->file.size;
 
 	common = plugin->common;
 	length = plugin->folder.length;
@@ -1079,37 +1565,7 @@ static int prepare_file(UgetCurl* ugcurl, UgetPluginCurl* plugin)
 			plugin->size.download = 0;
 			// allocate disk space if plug-in known file size
 			if (plugin->file.size) {
-				// preallocate space for a file.
-#if defined _WIN32 || defined _WIN64
-				LARGE_INTEGER size;
-				HANDLE        handle;
-				handle = (HANDLE) _get_osfhandle(value);
-				size.QuadPart = plugin->file.size;
-				if(SetFilePointerEx(handle ,size, 0, FILE_BEGIN) == FALSE)
-					ugcurl->event_code = UGET_EVENT_ERROR_OUT_OF_RESOURCE;
-				if(SetEndOfFile(handle) == FALSE)
-					ugcurl->event_code = UGET_EVENT_ERROR_OUT_OF_RESOURCE;
-				SetFilePointer(handle, 0, 0, FILE_BEGIN);
-#elif defined HAVE_FTRUNCATE
-				if (ftruncate(value, plugin->file.size) == -1)
-					ugcurl->event_code = UGET_EVENT_ERROR_OUT_OF_RESOURCE;
-#elif defined __ANDROID__ && __ANDROID_API__ >= 12
-				if (ftruncate64(value, plugin->file.size) == -1)
-					ugcurl->event_code = UGET_EVENT_ERROR_OUT_OF_RESOURCE;
-#elif defined HAVE_POSIX_FALLOCATE
-				if (posix_fallocate(value, 0, plugin->file.size) != 0)
-					ugcurl->event_code = UGET_EVENT_ERROR_OUT_OF_RESOURCE;
-#elif defined __ANDROID__ && __ANDROID_API__ >= 20
-				if (posix_fallocate64(value, 0, plugin->file.size) != 0)
-					ugcurl->event_code = UGET_EVENT_ERROR_OUT_OF_RESOURCE;
-#else
-				if (ug_write(value, "O", 1) == -1)  // begin of file
-					ugcurl->event_code = UGET_EVENT_ERROR_OUT_OF_RESOURCE;
-				if (ug_seek(value, plugin->file.size - 1, SEEK_SET) == -1)
-					ugcurl->event_code = UGET_EVENT_ERROR_OUT_OF_RESOURCE;
-				if (ug_write(value, "X", 1) == -1)  // end of file
-					ugcurl->event_code = UGET_EVENT_ERROR_OUT_OF_RESOURCE;
-#endif // _WIN32 || _WIN64
+				ugcurl->event_code = preallocate_file(plugin, value);
 				// create aria2 control file if no error
 				if (ugcurl->event_code == 0) {
 					plugin->aria2.path = ug_strdup(plugin->file.path);
@@ -1187,28 +1643,177 @@ static int prepare_file(UgetCurl* ugcurl, UgetPluginCurl* plugin)
 	plugin->prepared = TRUE;
 	// file and it's offset
 	temp.val64 = 0;
-	uget_a2cf_lack(&plugin->aria2.ctrl,
-	               (uint64_t*) &temp.val64,
-	               (uint64_t*) &ugcurl->end);
-	plugin->segment.beg = ugcurl->end;
+	if (uget_a2cf_lack(&plugin->aria2.ctrl, (uint64_t*) &temp.val64, &end) == FALSE) {
+		// all data was downloaded in previous run, but checksum didn't match.
+		// discard received data, plug-in thread verify pieces after it stop.
+		uget_curl_set_beg(ugcurl, plugin->file.size);
+		uget_curl_reset_progress(ugcurl, plugin->file.size);
+		temp.val64 = plugin->file.size;
+		end = plugin->file.size;
+	}
+	uget_curl_set_end(ugcurl, end);
+	plugin->segment.beg = end;
 	if (ugcurl->beg == temp.val64) {
 		if (uget_curl_open_file(ugcurl, plugin->file.path) == FALSE) {
 			ugcurl->event_code = UGET_EVENT_ERROR_FILE_OPEN_FAILED;
 			return FALSE;
 		}
+		check_mapped(plugin);
 		return TRUE;
 	}
 	else {
-		ugcurl->beg = temp.val64;
-		ugcurl->pos = temp.val64;
+		uget_curl_set_beg(ugcurl, temp.val64);
+		uget_curl_reset_progress(ugcurl, temp.val64);
 		curl_easy_setopt(ugcurl->curl, CURLOPT_RESUME_FROM_LARGE,
 				(curl_off_t) temp.val64);
-		if (uget_curl_open_file(ugcurl, plugin->file.path))
+		if (uget_curl_open_file(ugcurl, plugin->file.path)) {
+			check_mapped(plugin);
 			ugcurl->restart = TRUE;
+		}
 		return FALSE;
 	}
 }
 
+// memory-mapped file fall back to pwrite() if it isn't fully allocated.
+// Post warning once, segments don't try to map it again.
+static void check_mapped(UgetPluginCurl* plugin)
+{
+	UgetCurlOutput*  output;
+	int              failed;
+
+	output = &plugin->output;
+	ug_mutex_lock(&output->mutex);
+	failed = (output->mapped && output->map.addr == NULL);
+	if (failed)
+		output->mapped = FALSE;
+	ug_mutex_unlock(&output->mutex);
+	if (failed) {
+		uget_plugin_post((UgetPlugin*) plugin,
+				uget_event_new_warning(UGET_EVENT_WARNING_FILE_MAP_FAILED, NULL));
+	}
+}
+
+// set extent size hint before file has any data.
+// It reduces fragmentation when segments write at scattered offsets.
+static void set_extent_hint(int fd)
+{
+#if defined __linux__ && defined FS_IOC_FSSETXATTR
+	struct fsxattr  fsx;
+
+	if (ioctl(fd, FS_IOC_FSGETXATTR, &fsx) == 0) {
+		fsx.fsx_xflags |= FS_XFLAG_EXTSIZE;
+		fsx.fsx_extsize = EXTENT_SIZE_HINT;
+		ioctl(fd, FS_IOC_FSSETXATTR, &fsx);    // not all file systems support it
+	}
+#endif
+}
+
+// reserve all blocks of file. return FALSE if it is not supported.
+static int  allocate_full(int fd, int64_t size)
+{
+#if defined _WIN32 || defined _WIN64
+	FILE_ALLOCATION_INFO  info;
+
+	info.AllocationSize.QuadPart = size;
+	return SetFileInformationByHandle((HANDLE) _get_osfhandle(fd),
+			FileAllocationInfo, &info, sizeof(info));
+#elif defined __linux__
+	// Unlike posix_fallocate(), it doesn't write zero to file if
+	// file system doesn't support it.
+	return (fallocate(fd, 0, 0, size) == 0);
+#elif defined HAVE_POSIX_FALLOCATE
+	return (posix_fallocate(fd, 0, size) == 0);
+#else
+	return FALSE;
+#endif
+}
+
+// allocate disk space for new file by UgetCommon::preallocate
+// return 0 if no error, otherwise return UgetEventError
+static int  preallocate_file(UgetPluginCurl* plugin, int fd)
+{
+	UgetEvent*  event;
+	uint64_t    time_beg;
+	int64_t     space;
+	char*       string;
+	int         mode;
+
+	mode = preallocate_mode(plugin);
+	if (mode == UGET_PREALLOCATE_NONE)
+		return 0;
+	// fail fast if disk space is not enough to reserve.
+	space = ug_get_free_space((plugin->folder.path) ? plugin->folder.path : ".");
+	if (space != -1 && space < plugin->file.size)
+		return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+
+	switch (mode) {
+	case UGET_PREALLOCATE_FULL:
+		set_extent_hint(fd);
+		time_beg = ug_get_time_count();
+		if (allocate_full(fd, plugin->file.size)) {
+			string = ug_strdup_printf("Disk space allocated in %.3f seconds",
+					(double) (ug_get_time_count() - time_beg) / 1000.0);
+			event = uget_event_new_normal(UGET_EVENT_NORMAL_PREALLOCATED, string);
+			uget_plugin_post((UgetPlugin*) plugin, event);
+			ug_free(string);
+			break;
+		}
+#if defined __linux__
+		if (errno == ENOSPC)
+			return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+#endif
+		// file system doesn't support it, use sparse file.
+		// Don't break here
+
+	default:
+	case UGET_PREALLOCATE_SPARSE:
+		set_extent_hint(fd);
+#if defined _WIN32 || defined _WIN64
+		{
+			LARGE_INTEGER size;
+			HANDLE        handle;
+			handle = (HANDLE) _get_osfhandle(fd);
+			size.QuadPart = plugin->file.size;
+			if(SetFilePointerEx(handle ,size, 0, FILE_BEGIN) == FALSE)
+				return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+			if(SetEndOfFile(handle) == FALSE)
+				return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+			SetFilePointer(handle, 0, 0, FILE_BEGIN);
+		}
+#elif defined HAVE_FTRUNCATE
+		if (ftruncate(fd, plugin->file.size) == -1)
+			return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+#elif defined __ANDROID__ && __ANDROID_API__ >= 12
+		if (ftruncate64(fd, plugin->file.size) == -1)
+			return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+#elif defined HAVE_POSIX_FALLOCATE
+		if (posix_fallocate(fd, 0, plugin->file.size) != 0)
+			return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+#elif defined __ANDROID__ && __ANDROID_API__ >= 20
+		if (posix_fallocate64(fd, 0, plugin->file.size) != 0)
+			return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+#else
+		if (ug_write(fd, "O", 1) == -1)  // begin of file
+			return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+		if (ug_seek(fd, plugin->file.size - 1, SEEK_SET) == -1)
+			return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+		if (ug_write(fd, "X", 1) == -1)  // end of file
+			return UGET_EVENT_ERROR_OUT_OF_RESOURCE;
+#endif // _WIN32 || _WIN64
+		break;
+	}
+
+	return 0;
+}
+
+// memory-mapped file must be fully allocated, see uget_curl_open_file()
+static int  preallocate_mode(UgetPluginCurl* plugin)
+{
+	if (plugin->output.mapped)
+		return UGET_PREALLOCATE_FULL;
+	return plugin->common->preallocate;
+}
+
 // used by get_repeating_fmt_string()
 enum {
 	EXT_NUMBER = 0x01,
@@ -1333,11 +1938,113 @@ static int  load_file_info(UgetPluginCurl* plugin)
 	}
 	else {
 		uget_a2cf_clear(&plugin->aria2.ctrl);
+		// control file is lost or corrupted, rebuild it from data file.
+		if (recover_file_info(plugin, path, length))
+			return TRUE;
 		ug_free(path);
 		return FALSE;
 	}
 }
 
+// Rebuild aria2 control file from data regions of sparse file.
+// Only 16 KiB blocks inside data regions are counted. The last block of each
+// region is dropped because segment may write part of it only.
+// path = folder + filename + ".aria2", length = strlen(folder + filename)
+static int  recover_file_info(UgetPluginCurl* plugin, char* path, int length)
+{
+#if defined SEEK_DATA && defined SEEK_HOLE
+	UgetA2cf*  a2cf;
+	int64_t    file_size;
+	int64_t    data_beg, data_end;
+	int64_t    beg, end;
+	int64_t    pos;
+	int64_t    size;
+	int        fd;
+	int        n_holes = 0;
+
+	size = plugin->file.size_last;
+	// file system may report unwritten extents as data after full allocation.
+	if (size <= 0 || preallocate_mode(plugin) == UGET_PREALLOCATE_FULL)
+		return FALSE;
+
+	path[length] = 0;
+	fd = ug_open(path, UG_O_RDONLY | UG_O_BINARY, 0);
+	path[length] = '.';
+	if (fd == -1)
+		return FALSE;
+	file_size = ug_seek(fd, 0, SEEK_END);
+	if (file_size <= 0 || file_size > size) {
+		ug_close(fd);
+		return FALSE;
+	}
+
+	a2cf = &plugin->aria2.ctrl;
+	uget_a2cf_init(a2cf, size);
+	plugin->file.size = size;
+	plugin->file.path = ug_strndup(path, length);
+	plugin->aria2.path = path;
+
+	for (pos = 0;  pos < file_size;  pos = data_end) {
+		data_beg = ug_seek(fd, pos, SEEK_DATA);
+		if (data_beg == -1)
+			break;    // ENXIO: no more data
+		data_end = ug_seek(fd, data_beg, SEEK_HOLE);
+		if (data_end == -1)
+			break;
+		// end of file is not a hole, file system may not support sparse file.
+		if (data_beg > pos || data_end < file_size)
+			n_holes++;
+		// whole file is data. Accept it if all pieces can be verified later.
+		if (n_holes == 0 && pieces_usable(plugin) == FALSE)
+			break;
+
+		beg = (data_beg + 16383) & ~(int64_t)16383;
+		if (data_end < size)
+			end = (data_end & ~(int64_t)16383) - 16384;
+		else
+			end = size;
+		if (end <= beg)
+			continue;
+		uget_a2cf_fill(a2cf, beg, end);
+		// verify pieces on the boundary of region before others.
+		if (pieces_usable(plugin)) {
+			if (n_holes == 0)
+				mark_pieces(plugin, beg, end);
+			else {
+				mark_pieces(plugin, beg, beg + 1);
+				mark_pieces(plugin, end - 1, end);
+			}
+		}
+	}
+	ug_close(fd);
+
+	plugin->base.download = uget_a2cf_completed(a2cf);
+	if (plugin->base.download == 0 || uget_a2cf_save(a2cf, path) == FALSE) {
+		uget_a2cf_clear(a2cf);
+		// caller will free path
+		plugin->aria2.path = NULL;
+		ug_free(plugin->file.path);
+		plugin->file.path = NULL;
+		plugin->file.size = 0;
+		plugin->base.download = 0;
+		return FALSE;
+	}
+	plugin->size.download = plugin->base.download;
+	// update UgetFiles
+	plugin_decide_files(plugin);
+
+#ifndef NDEBUG
+	if (plugin->common->debug_level) {
+		printf("\n" "recover control file, %u KiB completed\n",
+		       (unsigned) (plugin->base.download / 1024));
+	}
+#endif
+	return TRUE;
+#else
+	return FALSE;
+#endif  // SEEK_DATA && SEEK_HOLE
+}
+
 static void  clear_file_info(UgetPluginCurl* plugin)
 {
 	// update UgetFiles
@@ -1356,13 +2063,99 @@ static void  clear_file_info(UgetPluginCurl* plugin)
 	plugin->size.download = 0;
 }
 
-static int  switch_uri(UgetPluginCurl* plugin, UgetCurl* ugcurl, int is_resumable)
+// score of URI, higher is better.
+static int64_t  score_uri(UgetPluginCurl* plugin, UriLink* uri_link)
+{
+	UgetCurl*  ugcurl;
+	int64_t    n_segments = 0;
+
+	// unhealthy URI is used only if all URIs are unhealthy.
+	if (uri_link->errors >= MAX_URI_ERRORS)
+		return -uri_link->errors;
+	// try untested URI first, so segments are spread across all mirrors.
+	if (uri_link->speed == 0 && uri_link->errors == 0) {
+		ugcurl = (UgetCurl*) plugin->segment.list.head;
+		for (;  ugcurl;  ugcurl = ugcurl->next) {
+			if (ugcurl->uri.link == uri_link)
+				n_segments++;
+		}
+		return INT64_MAX - n_segments;
+	}
+	// URI failed before it was measured, rank it below measured ones.
+	if (uri_link->speed == 0)
+		return -uri_link->errors;
+	return uri_link->speed / (uri_link->errors + 1);
+}
+
+// update rolling throughput per connection of each URI.
+// plugin_thread() call this every SPEED_INTERVAL.
+static void  score_uris(UgetPluginCurl* plugin)
+{
+	UriLink*   uri_link;
+	UgetCurl*  ugcurl;
+	int64_t    speed;
+	int        count;
+
+	uri_link = (UriLink*) plugin->uri.list.head;
+	for (;  uri_link;  uri_link = uri_link->next) {
+		speed = 0;
+		count = 0;
+		ugcurl = (UgetCurl*) plugin->segment.list.head;
+		for (;  ugcurl;  ugcurl = ugcurl->next) {
+			if (ugcurl->uri.link != uri_link ||
+			    ugcurl->state != UGET_CURL_RUN || SPEED_KNOWN(ugcurl) == FALSE)
+				continue;
+			speed += ugcurl->speed[0];
+			count++;
+		}
+		if (count == 0)
+			continue;
+		speed /= count;
+		if (uri_link->speed == 0)
+			uri_link->speed = speed;
+		else
+			uri_link->speed = (uri_link->speed + speed) / 2;
+	}
+}
+
+// select URI that has the best score, skip 'current' if possible.
+// 'current' can be NULL.
+static UriLink*  select_uri(UgetPluginCurl* plugin, UriLink* current)
+{
+	UriLink*  uri_link = NULL;
+	UriLink*  temp;
+	int64_t   score;
+	int64_t   score_max = 0;
+
+	temp = (UriLink*) plugin->uri.list.head;
+	for (;  temp;  temp = temp->next) {
+		if (temp == current && plugin->uri.list.size > 1)
+			continue;
+		score = score_uri(plugin, temp);
+		if (uri_link == NULL || score_max < score) {
+			score_max = score;
+			uri_link = temp;
+		}
+	}
+	return uri_link;
+}
+
+// select URI that has the best score.
+// If 'skip_current' is TRUE, it will switch to another one if possible.
+static int  switch_uri(UgetPluginCurl* plugin, UgetCurl* ugcurl, int skip_current)
 {
 	UriLink*  uri_link;
 
-	uri_link = (UriLink*) plugin->uri.link;
-	if (uri_link == NULL)
-		uri_link = (UriLink*) plugin->uri.list.head;
+	if (skip_current)
+		uri_link = select_uri(plugin, ugcurl->uri.link);
+	else
+		uri_link = select_uri(plugin, NULL);
+	// move connection to host of new URI
+	if (ugcurl->uri.host != uri_link->host) {
+		release_host(plugin, ugcurl);
+		if (acquire_host(plugin, uri_link->host, TRUE))
+			ugcurl->uri.host = uri_link->host;
+	}
 
 	// set URI and decide it's scheme
 	uget_curl_set_url(ugcurl, uri_link->uri);
@@ -1372,29 +2165,91 @@ static int  switch_uri(UgetPluginCurl* plugin, UgetCurl* ugcurl, int is_resumabl
 	ugcurl->resumable = uri_link->resumable;
 	ugcurl->tested = uri_link->tested;
 	ugcurl->test_ok = uri_link->ok;
-	// pointer current URI to next one
-	plugin->uri.link = (void*) uri_link->next;
+	// current URI
+	plugin->uri.link = (void*) uri_link;
+
+	return TRUE;
+}
 
+// disk writer padded the last block of O_DIRECT file, remove padding.
+// Padding may be left by previous run that used O_DIRECT.
+static int  truncate_padding(UgetPluginCurl* plugin)
+{
+	int64_t  size;
+	int      fd;
+
+	if (plugin->file.size == 0)
+		return TRUE;
+	fd = ug_open(plugin->file.path, UG_O_WRONLY | UG_O_BINARY, 0);
+	if (fd == -1)
+		return (plugin->writer.padded == FALSE);
+	size = ug_seek(fd, 0, SEEK_END);
+	if (size > plugin->file.size && ug_truncate(fd, plugin->file.size) == -1)
+		size = -1;
+	ug_close(fd);
+	if (size == -1)
+		return FALSE;
+	plugin->writer.padded = FALSE;
 	return TRUE;
 }
 
 static void complete_file(UgetPluginCurl* plugin)
 {
-	if (plugin->aria2.path) {
-		// update UgetFiles
-		uget_plugin_lock(plugin);
-		uget_files_replace(plugin->files,
-		                   plugin->file.path,
-		                   UGET_FILE_REGULAR, UGET_FILE_STATE_COMPLETED);
-		uget_files_replace(plugin->files,
-		                   plugin->aria2.path,
-		                   UGET_FILE_ATTACHMENT, UGET_FILE_STATE_DELETED);
-		uget_plugin_unlock(plugin);
+	int  verified = TRUE;
+
+	// keep aria2 control file if data failed to be written.
+	if (uget_curl_output_flush(&plugin->output) != 0 ||
+	    truncate_padding(plugin) == FALSE)
+	{
+		uget_plugin_post((UgetPlugin*)plugin,
+				uget_event_new_error(UGET_EVENT_ERROR_OUT_OF_RESOURCE, NULL));
+		uget_plugin_post((UgetPlugin*)plugin,
+				uget_event_new(UGET_EVENT_STOP));
+		return;
+	}
+	// verify data before deleting aria2 control file.
+	if (plugin->output.checksum) {
+		verified = verify_checksum(plugin);
+		// stopped by user, data will be read back again in next run.
+		if (verified == -1) {
+			if (plugin->aria2.path)
+				save_control_file(plugin);
+			return;
+		}
+	}
+	// keep aria2 control file if data is corrupted,
+	// pieces will be verified again in next run.
+	if (verified == FALSE && plugin->aria2.path) {
+		save_control_file(plugin);
+		uget_plugin_lock(plugin);
+		uget_files_replace(plugin->files,
+		                   plugin->file.path, UGET_FILE_REGULAR, 0);
+		uget_plugin_unlock(plugin);
+	}
+	else if (plugin->aria2.path) {
+		// update UgetFiles
+		uget_plugin_lock(plugin);
+		uget_files_replace(plugin->files,
+		                   plugin->file.path, UGET_FILE_REGULAR,
+		                   UGET_FILE_STATE_COMPLETED);
+		uget_files_replace(plugin->files,
+		                   plugin->aria2.path,
+		                   UGET_FILE_ATTACHMENT, UGET_FILE_STATE_DELETED);
+		uget_plugin_unlock(plugin);
 		// delete aria2 control file
+		uget_a2cf_unmap(&plugin->aria2.ctrl);
 		ug_unlink(plugin->aria2.path);
 		ug_free(plugin->aria2.path);
 		plugin->aria2.path = NULL;
 	}
+	// corrupted file can't be completed
+	if (verified == FALSE) {
+		uget_plugin_post((UgetPlugin*)plugin,
+				uget_event_new_error(UGET_EVENT_ERROR_CHECKSUM_MISMATCH, NULL));
+		uget_plugin_post((UgetPlugin*)plugin,
+				uget_event_new(UGET_EVENT_STOP));
+		return;
+	}
 	// modify file time
 	if (plugin->common->timestamp == TRUE && plugin->file.time != -1)
 		ug_modify_file_time(plugin->file.path, plugin->file.time);
@@ -1405,37 +2260,340 @@ static void complete_file(UgetPluginCurl* plugin)
 			uget_event_new(UGET_EVENT_STOP));
 }
 
+// only plugin_thread() call this. plugin_sync() read snapshot by seqlock.
+static void publish_progress(UgetPluginCurl* plugin)
+{
+	ug_seq_write_begin(&plugin->snapshot.seq);
+	plugin->snapshot.total    = plugin->file.size;
+	plugin->snapshot.upload   = plugin->size.upload;
+	plugin->snapshot.download = plugin->size.download;
+	plugin->snapshot.upload_speed   = plugin->speed.upload;
+	plugin->snapshot.download_speed = plugin->speed.download;
+	plugin->snapshot.wasted   = plugin->wasted;
+	ug_seq_write_end(&plugin->snapshot.seq);
+}
+
+// flush written data to disk before control file marks it as completed.
+static void sync_output(UgetPluginCurl* plugin)
+{
+	UgetCurlOutput* output = &plugin->output;
+	int  fd;
+
+	// data must be written before it is flushed to disk.
+	uget_curl_output_flush(output);
+	ug_mutex_lock(&output->mutex);
+	fd = output->fd;
+	if (fd != -1)
+		output->ref_count++;
+	ug_mutex_unlock(&output->mutex);
+
+	if (fd != -1) {
+		ug_datasync(fd);
+		ug_mutex_lock(&output->mutex);
+		uget_curl_output_unref(output);
+		ug_mutex_unlock(&output->mutex);
+	}
+	else {
+		// all segments closed file, data may still be in page cache.
+		fd = ug_open(plugin->file.path, UG_O_WRONLY | UG_O_BINARY, 0);
+		if (fd != -1) {
+			ug_datasync(fd);
+			ug_close(fd);
+		}
+	}
+}
+
+static void save_control_file(UgetPluginCurl* plugin)
+{
+	UgetA2cf*  a2cf = &plugin->aria2.ctrl;
+
+	// don't mark blocks as completed if their data failed to be written.
+	if (uget_curl_output_flush(&plugin->output) != 0)
+		return;
+	// memory-mapped output file start writing dirty pages.
+	uget_curl_output_sync(&plugin->output);
+	if (global.control == UGET_PLUGIN_CURL_CONTROL_MMAP) {
+		// map control file at first time
+		if (a2cf->map.addr == NULL)
+			uget_a2cf_map(a2cf, plugin->aria2.path);
+		if (a2cf->map.addr) {
+			sync_output(plugin);
+			if (uget_a2cf_sync(a2cf))
+				return;
+		}
+	}
+	// rewrite whole file if mapping is not available
+	uget_a2cf_save(a2cf, plugin->aria2.path);
+}
+
 static int  reuse_download(UgetPluginCurl* plugin, UgetCurl* ugcurl, int next_uri)
 {
-	if (ugcurl->beg == ugcurl->pos) {
-		// delete segment if no downloaded data
+	UgetCurl*  prev;
+	int        no_data;
+
+	no_data = (ugcurl->beg == ugcurl->pos);
+	// split segment that has no data give it's range back to previous
+	// segment. If previous one has stopped, try this range again.
+	if (ugcurl->split && no_data) {
+		prev = ugcurl->prev;
+		if (prev && prev->end == ugcurl->beg && prev->state < UGET_CURL_OK)
+			uget_curl_set_end(prev, ugcurl->end);
+		else
+			no_data = FALSE;
+	}
+
+	if (no_data || (ugcurl->end > 0 && ugcurl->pos >= ugcurl->end)) {
+		// delete segment if no downloaded data or nothing left
 		ug_list_remove(&plugin->segment.list, (void*)ugcurl);
-		uget_curl_free(ugcurl);
+		free_segment(plugin, ugcurl);
 		return FALSE;
 	}
 	else {
 		// reuse this segment
 		if (next_uri == TRUE)
 			switch_uri(plugin, ugcurl, TRUE);
-		ugcurl->beg = ugcurl->pos;
+		uget_curl_set_beg(ugcurl, ugcurl->pos);
 		uget_curl_run(ugcurl, FALSE);
 		return TRUE;
 	}
 }
 
-static int  split_download(UgetPluginCurl* plugin, UgetCurl* ugcurl)
+// UGET_PLUGIN_CURL_SPLIT_LARGEST: halve the segment that has the most
+// remaining bytes. return the segment and set the beginning of new segment.
+// return NULL and set beg to -1 if no segment can be split now,
+// return NULL and set beg to 0 if segments are too small to split.
+static UgetCurl*  split_largest(UgetPluginCurl* plugin, int64_t* beg)
+{
+	UgetCurl*  temp;
+	UgetCurl*  sibling = NULL;
+	int64_t    cur;
+	int64_t    largest = 0;
+
+	*beg = -1;
+	for (temp = (void*)plugin->segment.list.head;  temp;  temp = temp->next) {
+		// duplicate of endgame
+		if (temp->endgame)
+			continue;
+		// it will be split or duplicated, it's end is not cut yet.
+		if (temp->next && (temp->next->split || temp->next->endgame))
+			continue;
+		cur = temp->end - temp->pos;
+		if (largest < cur) {
+			largest = cur;
+			sibling = temp;
+		}
+	}
+	if (sibling == NULL)
+		return NULL;
+	cur = (sibling->end - sibling->pos) >> 1;
+	// if segment is too small, don't split it.
+	*beg = 0;
+	if (cur < MIN_SPLIT_SIZE)
+		return NULL;
+	*beg = sibling->end - cur;
+	return sibling;
+}
+
+// UGET_PLUGIN_CURL_SPLIT_THROUGHPUT: steal from the segment that will finish
+// last and cut at the point where both halves will finish together.
+// return NULL and set beg to -1 if speed of any segment is still unknown or
+// no running segment can be split now,
+// return NULL and set beg to 0 if segments are too small to steal from.
+static UgetCurl*  split_slowest(UgetPluginCurl* plugin, int64_t* beg)
+{
+	UgetCurl*  temp;
+	UgetCurl*  sibling = NULL;
+	double     speed_new = 0;
+	double     seconds = 0;
+	double     cur;
+	int        count = 0;
+
+	*beg = -1;
+	for (temp = (void*)plugin->segment.list.head;  temp;  temp = temp->next) {
+		if (temp->state != UGET_CURL_RUN || temp->end <= temp->pos ||
+		    temp->endgame)
+			continue;
+		// it will be split or duplicated, it's end is not cut yet.
+		if (temp->next && (temp->next->split || temp->next->endgame))
+			continue;
+		if (SPEED_KNOWN(temp) == FALSE)
+			return NULL;
+		speed_new += (double) temp->speed[0];
+		count++;
+		cur = (double) (temp->end - temp->pos) / (double) temp->speed[0];
+		if (seconds < cur) {
+			seconds = cur;
+			sibling = temp;
+		}
+	}
+	if (sibling == NULL)
+		return NULL;
+	// don't steal if slowest segment will finish soon.
+	*beg = 0;
+	if (seconds < MIN_STEAL_TIME)
+		return NULL;
+	// assume that new segment runs at average speed of active segments.
+	// (x - pos) / speed = (end - x) / speed_new
+	speed_new /= count;
+	cur = (double) sibling->speed[0];
+	cur = ((double) sibling->end * cur + (double) sibling->pos * speed_new) /
+	      (cur + speed_new);
+	// if stolen part is too small, don't split it.
+	if (sibling->end - (int64_t) cur < MIN_STEAL_SIZE)
+		return NULL;
+	*beg = (int64_t) cur;
+	return sibling;
+}
+
+// Endgame: request the remaining range of the segment that will finish last
+// again (from another mirror if possible). The first one that finishes wins.
+// Only segments that are slower than half of average speed are duplicated.
+static int  endgame_download(UgetPluginCurl* plugin, UgetCurl* ugcurl)
 {
 	UgetCurl*  temp;
+	UgetCurl*  sibling = NULL;
+	double     speed_avg = 0;
+	double     seconds = 0;
+	double     cur;
+	int        count = 0;
+
+	for (temp = (void*)plugin->segment.list.head;  temp;  temp = temp->next) {
+		if (temp->state == UGET_CURL_RUN && SPEED_KNOWN(temp)) {
+			speed_avg += (double) temp->speed[0];
+			count++;
+		}
+	}
+	if (count == 0)
+		return FALSE;
+	speed_avg /= count;
+
+	for (temp = (void*)plugin->segment.list.head;  temp;  temp = temp->next) {
+		if (temp->state != UGET_CURL_RUN || temp->endgame ||
+		    temp->end <= temp->pos || SPEED_KNOWN(temp) == FALSE)
+			continue;
+		// it has been duplicated or will be split.
+		if (temp->next && (temp->next->endgame || temp->next->split))
+			continue;
+		if (temp->speed[0] * 2 >= speed_avg)
+			continue;
+		cur = (double) (temp->end - temp->pos) / (double) temp->speed[0];
+		if (seconds < cur) {
+			seconds = cur;
+			sibling = temp;
+		}
+	}
+	if (sibling == NULL)
+		return FALSE;
+
+	// reuse UgetCurl
+	ug_list_remove(&plugin->segment.list, (UgLink*) ugcurl);
+	// use alternate mirror
+	if (plugin->uri.list.size > 1 && ugcurl->uri.link == sibling->uri.link)
+		switch_uri(plugin, ugcurl, TRUE);
+	// duplicate must be next to it's sibling, see resolve_endgame()
+	ug_list_insert(&plugin->segment.list,
+			(void*) sibling->next, (void*) ugcurl);
+	ugcurl->split = FALSE;
+	ugcurl->endgame = TRUE;
+	plugin->segment.endgame = TRUE;
+	uget_curl_set_beg(ugcurl, sibling->pos);
+	uget_curl_set_end(ugcurl, sibling->end);
+
+#ifndef NDEBUG
+	if (plugin->common->debug_level) {
+		printf("\n" "endgame %u-%u KiB\n",
+		       (unsigned) (ugcurl->beg / 1024),
+		       (unsigned) (ugcurl->end / 1024));
+	}
+#endif
+
+	uget_curl_run(ugcurl, FALSE);
+	return TRUE;
+}
+
+// cancel the loser of duplicated range, called before counting progress.
+// The duplicate (ugcurl) and it's sibling (prev) download the same tail.
+static void resolve_endgame(UgetPluginCurl* plugin)
+{
+	UgetCurl*  ugcurl;
+	UgetCurl*  prev;
+	int        n_duplicates = 0;
+
+	ugcurl = (UgetCurl*) plugin->segment.list.head;
+	for (;  ugcurl;  ugcurl = ugcurl->next) {
+		if (ugcurl->endgame == FALSE)
+			continue;
+		prev = ugcurl->prev;
+		if (prev && prev->end == ugcurl->end && prev->pos < prev->end) {
+			// both are downloading
+			if (ugcurl->pos < ugcurl->end && ugcurl->state < UGET_CURL_OK &&
+			    prev->state < UGET_CURL_OK)
+			{
+				n_duplicates++;
+				continue;
+			}
+			// duplicate wins or sibling stopped, cut sibling.
+			if (ugcurl->pos >= ugcurl->end || prev->state >= UGET_CURL_OK) {
+				ugcurl->endgame = FALSE;
+				if (prev->pos > ugcurl->beg) {
+					plugin->wasted += prev->pos - ugcurl->beg;
+					prev->pos = ugcurl->beg;
+					prev->size[0] = prev->pos - prev->beg;
+				}
+				uget_curl_set_end(prev, ugcurl->beg);
+				continue;
+			}
+		}
+		// sibling wins or duplicate stopped, cancel duplicate.
+		ugcurl->endgame = FALSE;
+		if (ugcurl->state < UGET_CURL_OK) {
+			plugin->wasted += ugcurl->pos - ugcurl->beg;
+			ugcurl->paused = TRUE;
+		}
+		uget_curl_set_end(ugcurl, ugcurl->beg);
+		ugcurl->pos = ugcurl->beg;
+		ugcurl->size[0] = 0;
+	}
+	// no duplicated range is running, resolving is not needed.
+	if (n_duplicates == 0)
+		plugin->segment.endgame = FALSE;
+}
+
+static int  split_download(UgetPluginCurl* plugin, UgetCurl* ugcurl)
+{
 	UgetCurl*  sibling = NULL;
 	uint64_t   cur;
 	uint64_t   end;
+	int64_t    beg;
 
 	if (plugin->aria2.path == NULL)
 		return FALSE;
+	// new segment must get connection from host before taking space of file.
+	if (ugcurl == NULL) {
+		ugcurl = create_segment(plugin, FALSE);
+		if (ugcurl == NULL)
+			return FALSE;
+		ug_list_append(&plugin->segment.list, (void*) ugcurl);
+		if (split_download(plugin, ugcurl))
+			return TRUE;
+		ug_list_remove(&plugin->segment.list, (void*) ugcurl);
+		free_segment(plugin, ugcurl);
+		return FALSE;
+	}
 
-	// try to find unused space
 	cur = plugin->segment.beg;
-	if (uget_a2cf_lack(&plugin->aria2.ctrl, &cur, &end)) {
+	// download corrupted piece again before unused space
+	if (plugin->pieces.n_corrupted && requeue_piece(plugin, &cur, &end)) {
+#ifndef NDEBUG
+		if (plugin->common->debug_level) {
+			printf("\n" "requeue %u-%u KiB\n",
+			       (unsigned) (cur / 1024),
+			       (unsigned) (end / 1024));
+		}
+#endif
+	}
+	// try to find unused space
+	else if (uget_a2cf_lack(&plugin->aria2.ctrl, &cur, &end)) {
 		plugin->segment.beg = end;
 #ifndef NDEBUG
 		if (plugin->common->debug_level) {
@@ -1447,26 +2605,29 @@ static int  split_download(UgetPluginCurl* plugin, UgetCurl* ugcurl)
 	}
 	// if no unused space, try to split downloading segment.
 	else {
-		// cur = segment size;  end = the largest segment size;
-		end = 0;
-		for (temp = (void*)plugin->segment.list.head;  temp;  temp = temp->next) {
-			cur = temp->end - temp->pos;
-			if (end < cur) {
-				end = cur;
-				sibling = temp;
-			}
+		// cur = begin of new segment;  end = end of new segment;
+		beg = -1;
+		if (global.split == UGET_PLUGIN_CURL_SPLIT_THROUGHPUT)
+			sibling = split_slowest(plugin, &beg);
+		// fall back to old policy if throughput is unknown.
+		if (sibling == NULL && beg == -1) {
+			sibling = split_largest(plugin, &beg);
+			// nothing can be split now, or wait for throughput
+			// before entering endgame.
+			if (sibling == NULL && (beg == -1 ||
+			    global.split == UGET_PLUGIN_CURL_SPLIT_THROUGHPUT))
+				return FALSE;
 		}
+		// segments are too small to split, duplicate their tail.
 		if (sibling == NULL)
-			return FALSE;
-		cur = (sibling->end - sibling->pos) >> 1;
-		// if segment is too small, don't split it.
-		if (cur < MIN_SPLIT_SIZE)
-			return FALSE;
-		// cur = begin of new segment;  end = end of new segment;
-		cur = sibling->end - cur;
+			return endgame_download(plugin, ugcurl);
+		cur = beg;
 		end = sibling->end;
 		if (cur & 16383)
 			cur += 16384 - (cur & 16383);
+		// cut the end now, sibling discard data beyond it instead of
+		// writing data that new segment will download again.
+		uget_curl_set_end(sibling, cur);
 
 #ifndef NDEBUG
 		if (plugin->common->debug_level) {
@@ -1477,12 +2638,8 @@ static int  split_download(UgetPluginCurl* plugin, UgetCurl* ugcurl)
 #endif
 	}
 
-	// reuse or create UgetCurl
-	// if this UgetCurl has been inserted in segment.list, remove it.
-	if (ugcurl)
-		ug_list_remove(&plugin->segment.list, (UgLink*) ugcurl);
-	else
-		ugcurl = create_segment(plugin);
+	// reuse UgetCurl, it will be inserted in segment.list again.
+	ug_list_remove(&plugin->segment.list, (UgLink*) ugcurl);
 
 	// add to segment.list
 	if (sibling == NULL)
@@ -1493,51 +2650,152 @@ static int  split_download(UgetPluginCurl* plugin, UgetCurl* ugcurl)
 				(void*) sibling->next, (void*) ugcurl);
 	}
 
-	ugcurl->beg = cur;
-	ugcurl->end = end;
+	uget_curl_set_beg(ugcurl, cur);
+	uget_curl_set_end(ugcurl, end);
 	uget_curl_run(ugcurl, FALSE);
 	return TRUE;
 }
 
+// plugin_ctrl() will wake it up if user stop plug-in.
 static void delay_ms(UgetPluginCurl* plugin, int  milliseconds)
 {
+	uint64_t  time_now;
+	uint64_t  time_end;
+
+	time_end = ug_get_time_count() + milliseconds;
 	while (plugin->paused == FALSE) {
-		if (milliseconds >  500) {
-			milliseconds -= 500;
-			ug_sleep(500);
-			continue;
-		}
-		ug_sleep(milliseconds);
-		return;
+		time_now = ug_get_time_count();
+		if (time_now >= time_end)
+			return;
+		uget_curl_notify_wait(&plugin->notify, (int) (time_end - time_now));
 	}
 }
 
-static UgetCurl* create_segment(UgetPluginCurl* plugin)
+// If 'force' is FALSE, return NULL when host has no spare connection.
+static UgetCurl* create_segment(UgetPluginCurl* plugin, int force)
 {
 	UgetCurl*  ugcurl;
-
-	ugcurl = uget_curl_new();
-	uget_curl_set_common(ugcurl, plugin->common);
-	uget_curl_set_proxy(ugcurl, plugin->proxy);
-	uget_curl_set_http(ugcurl, plugin->http);
-	uget_curl_set_ftp(ugcurl, plugin->ftp);
-	// set speed limit
-	if (plugin->limit.download)
-		ugcurl->limit[0] = plugin->limit.download / (plugin->segment.list.size + 1);
-	if (plugin->limit.upload)
-		ugcurl->limit[1] = plugin->limit.upload / (plugin->segment.list.size + 1);
+	UriLink*   uri_link;
+
+	// get connection from host of the best URI before creating segment
+	uri_link = select_uri(plugin, NULL);
+	if (acquire_host(plugin, uri_link->host, force) == FALSE)
+		return NULL;
+
+	// options of idle segment have been set by this plug-in.
+	// Share handle doesn't share connections, warm connection to the same
+	// URI comes from easy handle of idle segment in this plug-in.
+	ugcurl = take_idle(plugin, uri_link);
+	if (ugcurl == NULL) {
+		ugcurl = pool_pop();
+		if (ugcurl == NULL)
+			ugcurl = uget_curl_new();
+		uget_curl_set_common(ugcurl, plugin->common);
+		uget_curl_set_proxy(ugcurl, plugin->proxy);
+		uget_curl_set_http(ugcurl, plugin->http);
+		uget_curl_set_ftp(ugcurl, plugin->ftp);
+		ugcurl->notify = &plugin->notify;
+		ugcurl->file.output = &plugin->output;
+		ugcurl->buffer_size = global.buffer_size;
+		if (global.share)
+			curl_easy_setopt(ugcurl->curl, CURLOPT_SHARE, global.share);
+		// download speed is limited by bucket.
+		ugcurl->bucket = plugin->bucket;
+	}
+	ugcurl->uri.host = uri_link->host;
+	// set upload speed limit
+	if (plugin->limit.upload) {
+		uget_curl_set_speed(ugcurl, ugcurl->limit[0],
+				plugin->limit.upload / (plugin->segment.list.size + 1));
+	}
 	// select URL
 	switch_uri(plugin, ugcurl, FALSE);
 	// set output function
 	ugcurl->prepare.func = (UgetCurlFunc) prepare_existed;
 	ugcurl->prepare.data = plugin;
+	ugcurl->header_store = FALSE;
+	return ugcurl;
+}
+
+// segment is kept in segment.idle, create_segment() will reuse it.
+static void free_segment(UgetPluginCurl* plugin, UgetCurl* ugcurl)
+{
+	release_host(plugin, ugcurl);
+	uget_curl_reset(ugcurl, FALSE);
+	ug_list_append(&plugin->segment.idle, (void*) ugcurl);
+}
+
+// take idle segment, prefer the one that used the same URI last time.
+// Return NULL if no idle segment.
+static UgetCurl* take_idle(UgetPluginCurl* plugin, UriLink* uri_link)
+{
+	UgetCurl*  ugcurl;
+
+	ugcurl = (UgetCurl*) plugin->segment.idle.head;
+	for (;  ugcurl;  ugcurl = ugcurl->next) {
+		if (ugcurl->uri.link == uri_link)
+			break;
+	}
+	if (ugcurl == NULL)
+		ugcurl = (UgetCurl*) plugin->segment.idle.head;
+	if (ugcurl == NULL)
+		return NULL;
+	ug_list_remove(&plugin->segment.idle, (void*) ugcurl);
 	return ugcurl;
 }
 
+// number of connections that segments hold in host
+static int  count_host(UgetPluginCurl* plugin, UgetHost* host)
+{
+	UgetCurl*  ugcurl;
+	int        count = 0;
+
+	ugcurl = (UgetCurl*) plugin->segment.list.head;
+	for (;  ugcurl;  ugcurl = ugcurl->next) {
+		if (ugcurl->uri.host == host)
+			count++;
+	}
+	return count;
+}
+
+// caller must set UgetCurl::uri.host if it return TRUE.
+static int  acquire_host(UgetPluginCurl* plugin, UgetHost* host, int force)
+{
+	if (host == NULL)
+		return TRUE;
+	if (uget_host_acquire(host, count_host(plugin, host), force) == FALSE)
+		return FALSE;
+	uget_host_ref(host);
+	return TRUE;
+}
+
+static void release_host(UgetPluginCurl* plugin, UgetCurl* ugcurl)
+{
+	UgetHost*  host;
+
+	host = ugcurl->uri.host;
+	if (host == NULL)
+		return;
+	ugcurl->uri.host = NULL;
+	uget_host_release(host, count_host(plugin, host));
+	uget_host_unref(host);
+}
+
+// release connection that plugin_start() reserved for the first segment
+static void release_reserved(UgetPluginCurl* plugin)
+{
+	if (plugin->host.reserved == NULL)
+		return;
+	uget_host_release(plugin->host.reserved, 0);
+	uget_host_unref(plugin->host.reserved);
+	plugin->host.reserved = NULL;
+}
+
 // speed control
 static void  adjust_speed_limit_index(UgetPluginCurl* plugin, int idx, int64_t remain)
 {
 	UgetCurl*  ucurl;
+	int64_t    limit;
 
 	// balance speed
 	remain = remain / plugin->segment.n_active;
@@ -1545,10 +2803,12 @@ static void  adjust_speed_limit_index(UgetPluginCurl* plugin, int idx, int64_t r
 	for (ucurl = (UgetCurl*) plugin->segment.list.head; ucurl; ucurl=ucurl->next) {
 		if (ucurl->state != UGET_CURL_RUN)
 			continue;
-		ucurl->limit[idx] = ucurl->speed[idx] + remain;
-		if (ucurl->limit[idx] < MIN_SPEED_LIMIT)
-			ucurl->limit[idx] = MIN_SPEED_LIMIT;
-		ucurl->limit_changed = TRUE;
+		limit = ucurl->speed[idx] + remain;
+		if (limit < MIN_SPEED_LIMIT)
+			limit = MIN_SPEED_LIMIT;
+		// curl thread read limit[] while transfer is running.
+		ug_atomic_store_int64(&ucurl->limit[idx], limit);
+		ug_atomic_store_int(&ucurl->limit_changed, TRUE);
 	}
 }
 
@@ -1558,21 +2818,18 @@ static void  disable_speed_limit(UgetPluginCurl* plugin, int idx)
 
 	ugcurl = (UgetCurl*) plugin->segment.list.head;
 	for (;  ugcurl;  ugcurl = ugcurl->next) {
-		ugcurl->limit[idx] = 0;
-		ugcurl->limit_changed = TRUE;
+		ug_atomic_store_int64(&ugcurl->limit[idx], 0);
+		ug_atomic_store_int(&ugcurl->limit_changed, TRUE);
 	}
 }
 
 static void  adjust_speed_limit(UgetPluginCurl* plugin)
 {
+	// download: segments share bucket, it doesn't need balance.
+	uget_bucket_set_rate(plugin->bucket, plugin->limit.download);
 	if (plugin->segment.n_active == 0)
 		return;
 
-	// download
-	if (plugin->limit.download > 0)
-		adjust_speed_limit_index(plugin, 0, plugin->limit.download - plugin->speed.download);
-	else if (plugin->limit_changed)
-		disable_speed_limit(plugin, 0);
 	// upload
 	if (plugin->limit.upload > 0)
 		adjust_speed_limit_index(plugin, 1, plugin->limit.upload - plugin->speed.upload);
@@ -1582,3 +2839,406 @@ static void  adjust_speed_limit(UgetPluginCurl* plugin)
 	plugin->limit_changed = FALSE;
 }
 
+// ----------------------------------------------------------------------------
+// checksum
+
+static void start_checksum(UgetPluginCurl* plugin)
+{
+	int  type;
+
+	type = uget_checksum_parse(plugin->common->checksum, plugin->checksum.hex);
+	// checksum restart from beginning of file, existing data will be read back.
+	ug_mutex_lock(&plugin->output.mutex);
+	if (type == UGET_CHECKSUM_NONE)
+		plugin->output.checksum = NULL;
+	else {
+		uget_checksum_init(&plugin->checksum.data, type);
+		plugin->output.checksum = &plugin->checksum.data;
+	}
+	ug_mutex_unlock(&plugin->output.mutex);
+}
+
+static void stop_checksum(UgetPluginCurl* plugin)
+{
+	ug_mutex_lock(&plugin->output.mutex);
+	plugin->output.checksum = NULL;
+	ug_mutex_unlock(&plugin->output.mutex);
+	if (plugin->checksum.fd != -1) {
+		ug_close(plugin->checksum.fd);
+		plugin->checksum.fd = -1;
+	}
+}
+
+// read back data from checksum position to 'end' (or end of file).
+// return TRUE if it stopped by 'limit' and has more data to read.
+static int  read_checksum(UgetPluginCurl* plugin, int64_t end, int64_t limit)
+{
+	UgetChecksum*  checksum;
+	char*          buffer;
+	int64_t        pos;
+	int            length;
+
+	checksum = plugin->output.checksum;
+	if (plugin->checksum.fd == -1) {
+		plugin->checksum.fd = ug_open(plugin->file.path, UG_O_RDONLY | UG_O_BINARY, 0);
+		if (plugin->checksum.fd == -1)
+			return FALSE;
+		plugin->checksum.offset = 0;
+	}
+
+	buffer = NULL;
+	for (;;) {
+		// segments may move checksum position while reading.
+		ug_mutex_lock(&plugin->output.mutex);
+		pos = checksum->pos;
+		ug_mutex_unlock(&plugin->output.mutex);
+		if (pos >= end || limit <= 0)
+			break;
+
+		if (plugin->checksum.offset != pos) {
+			if (ug_seek(plugin->checksum.fd, pos, SEEK_SET) == -1)
+				break;
+			plugin->checksum.offset = pos;
+		}
+		if (buffer == NULL) {
+			// data will be read back, wait for asynchronous writes.
+			uget_curl_output_flush(&plugin->output);
+			buffer = ug_malloc(CHECKSUM_BUFFER_SIZE);
+		}
+		length = CHECKSUM_BUFFER_SIZE;
+		if (length > end - pos)
+			length = (int) (end - pos);
+		length = ug_read(plugin->checksum.fd, buffer, length);
+		if (length <= 0)
+			break;
+		plugin->checksum.offset += length;
+		limit -= length;
+		uget_curl_output_digest(&plugin->output, buffer, pos, length);
+	}
+	ug_free(buffer);
+	return (pos < end && limit <= 0);
+}
+
+// catch up with downloaded data that recorded in aria2 control file.
+// return TRUE if it has more data to read.
+static int  update_checksum(UgetPluginCurl* plugin)
+{
+	uint64_t  beg;
+	uint64_t  end;
+
+	ug_mutex_lock(&plugin->output.mutex);
+	beg = plugin->output.checksum->pos;
+	ug_mutex_unlock(&plugin->output.mutex);
+	// data before the first lacking position has been written.
+	if (uget_a2cf_lack(&plugin->aria2.ctrl, &beg, &end) == FALSE)
+		beg = plugin->file.size;
+	return read_checksum(plugin, (int64_t) beg, CHECKSUM_READ_LIMIT);
+}
+
+// return TRUE if data match expected digest, FALSE if it doesn't match.
+// return -1 if it was stopped by user before reading back the rest of file.
+static int  verify_checksum(UgetPluginCurl* plugin)
+{
+	char  hex[UGET_CHECKSUM_HEX_MAX];
+	int   matched;
+
+	// read back the rest of file, large file can be stopped between reads.
+	while (read_checksum(plugin,
+	                     (plugin->file.size) ? plugin->file.size : INT64_MAX,
+	                     CHECKSUM_READ_LIMIT))
+	{
+		if (plugin->paused)
+			return -1;
+	}
+	ug_mutex_lock(&plugin->output.mutex);
+	uget_checksum_final(&plugin->checksum.data, hex);
+	plugin->output.checksum = NULL;
+	ug_mutex_unlock(&plugin->output.mutex);
+	stop_checksum(plugin);
+
+	matched = (strcmp(hex, plugin->checksum.hex) == 0);
+	if (matched) {
+		uget_plugin_post((UgetPlugin*)plugin,
+				uget_event_new_normal(UGET_EVENT_NORMAL_CHECKSUM_OK, NULL));
+	}
+#ifndef NDEBUG
+	if (plugin->common->debug_level)
+		printf("\n" "checksum %s %s\n", hex, (matched) ? "OK" : "mismatch");
+#endif
+	return matched;
+}
+
+// ----------------------------------------------------------------------------
+// piece hashes
+
+static void start_pieces(UgetPluginCurl* plugin)
+{
+	plugin->pieces.n_pending = 0;
+	plugin->pieces.n_corrupted = 0;
+	plugin->pieces.requeue = 0;
+	// all pieces will be verified again, include existing data.
+	if (uget_checksum_pieces_parse(&plugin->pieces.hashes,
+	                               plugin->common->piece_hashes))
+	{
+		plugin->pieces.state = ug_malloc0(plugin->pieces.hashes.n_pieces);
+	}
+}
+
+static void stop_pieces(UgetPluginCurl* plugin)
+{
+	uget_checksum_pieces_clear(&plugin->pieces.hashes);
+	ug_free(plugin->pieces.state);
+	plugin->pieces.state = NULL;
+	if (plugin->pieces.fd != -1) {
+		ug_close(plugin->pieces.fd);
+		plugin->pieces.fd = -1;
+	}
+}
+
+// piece hashes can be used if file size is known and match them.
+static int  pieces_usable(UgetPluginCurl* plugin)
+{
+	UgetChecksumPieces*  hashes;
+
+	if (plugin->pieces.state == NULL || plugin->aria2.path == NULL)
+		return FALSE;
+	hashes = &plugin->pieces.hashes;
+	if ((uint64_t) hashes->length * hashes->n_pieces < (uint64_t) plugin->file.size ||
+	    (uint64_t) hashes->length * (hashes->n_pieces - 1) >= (uint64_t) plugin->file.size)
+	{
+#ifndef NDEBUG
+		if (plugin->common->debug_level)
+			printf("\n" "piece hashes don't match file size\n");
+#endif
+		stop_pieces(plugin);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// segment has written [beg, end), it may complete pieces in this range.
+static void mark_pieces(UgetPluginCurl* plugin, int64_t beg, int64_t end)
+{
+	uint8_t*  state;
+	uint32_t  index;
+	uint32_t  index_last;
+
+	if (end <= beg)
+		return;
+	state = plugin->pieces.state;
+	index = (uint32_t) (beg / plugin->pieces.hashes.length);
+	index_last = (uint32_t) (end / plugin->pieces.hashes.length);
+	if (index_last >= plugin->pieces.hashes.n_pieces)
+		index_last = plugin->pieces.hashes.n_pieces - 1;
+
+	for (;  index <= index_last;  index++) {
+		if (state[index] == PIECE_UNVERIFIED) {
+			state[index] = PIECE_PENDING;
+			plugin->pieces.n_pending++;
+		}
+	}
+}
+
+// read piece from file and compare it's digest.
+static int  verify_piece(UgetPluginCurl* plugin, uint32_t index)
+{
+	UgetChecksumPieces*  hashes;
+	UgetChecksum  checksum;
+	char          hex[UGET_CHECKSUM_HEX_MAX];
+	char*         buffer;
+	int64_t       beg, end;
+	int           length;
+
+	hashes = &plugin->pieces.hashes;
+	// data will be read back, wait for asynchronous writes.
+	uget_curl_output_flush(&plugin->output);
+	// can't verify piece if file can't be read.
+	if (plugin->pieces.fd == -1) {
+		plugin->pieces.fd = ug_open(plugin->file.path, UG_O_RDONLY | UG_O_BINARY, 0);
+		if (plugin->pieces.fd == -1)
+			return TRUE;
+	}
+	beg = (int64_t) index * hashes->length;
+	end = beg + hashes->length;
+	if (end > plugin->file.size)
+		end = plugin->file.size;
+	if (ug_seek(plugin->pieces.fd, beg, SEEK_SET) == -1)
+		return TRUE;
+
+	uget_checksum_init(&checksum, hashes->type);
+	buffer = ug_malloc(CHECKSUM_BUFFER_SIZE);
+	for (;  beg < end;  beg += length) {
+		length = CHECKSUM_BUFFER_SIZE;
+		if (length > end - beg)
+			length = (int) (end - beg);
+		length = ug_read(plugin->pieces.fd, buffer, length);
+		if (length <= 0)
+			break;
+		uget_checksum_update(&checksum, buffer, length);
+	}
+	ug_free(buffer);
+	uget_checksum_final(&checksum, hex);
+	return (memcmp(hex, hashes->hex + (size_t) index * hashes->hex_len,
+	               hashes->hex_len) == 0);
+}
+
+// erase corrupted piece from aria2 control file, requeue_piece() return it
+// to split_download() later.
+static void erase_piece(UgetPluginCurl* plugin, uint32_t index)
+{
+	UgetCurl*  ugcurl;
+	int64_t    beg, end;
+	int64_t    pos;
+	uint64_t   erased;
+
+	// aria2 control file record data by 16 KiB blocks
+	beg = ((int64_t) index * plugin->pieces.hashes.length) & ~(int64_t)16383;
+	end = ((int64_t) (index + 1) * plugin->pieces.hashes.length + 16383) & ~(int64_t)16383;
+	if (end > plugin->file.size)
+		end = plugin->file.size;
+	erased = uget_a2cf_erase(&plugin->aria2.ctrl, beg, end);
+	// neighbour pieces may share erased blocks, verify them after refilling.
+	if (index > 0 && beg < (int64_t) index * plugin->pieces.hashes.length &&
+	    plugin->pieces.state[index - 1] == PIECE_VERIFIED)
+	{
+		plugin->pieces.state[index - 1] = PIECE_UNVERIFIED;
+	}
+	if (index + 1 < plugin->pieces.hashes.n_pieces &&
+	    end > (int64_t) (index + 1) * plugin->pieces.hashes.length &&
+	    plugin->pieces.state[index + 1] == PIECE_VERIFIED)
+	{
+		plugin->pieces.state[index + 1] = PIECE_UNVERIFIED;
+	}
+
+	// segments must not fill erased blocks again,
+	// move their downloaded data before new beginning to base.
+	ugcurl = (UgetCurl*) plugin->segment.list.head;
+	for (;  ugcurl;  ugcurl = ugcurl->next) {
+		pos = ugcurl->pos;
+		if (ugcurl->beg >= end || pos <= beg)
+			continue;
+		if (pos > end)
+			pos = end;
+		plugin->base.download += pos - ugcurl->beg;
+		uget_curl_set_beg(ugcurl, pos);
+		ugcurl->size[0] = ugcurl->pos - ugcurl->beg;
+	}
+	plugin->base.download -= erased;
+	plugin->size.download -= erased;
+
+	// checksum of whole file has passed corrupted data, restart it.
+	ug_mutex_lock(&plugin->output.mutex);
+	if (plugin->output.checksum && plugin->output.checksum->pos > beg)
+		uget_checksum_init(plugin->output.checksum, plugin->output.checksum->type);
+	ug_mutex_unlock(&plugin->output.mutex);
+
+	plugin->pieces.state[index] = PIECE_CORRUPTED;
+	plugin->pieces.n_corrupted++;
+	// count it as retry, server may always send corrupted data.
+	plugin->common->retry_count++;
+
+#ifndef NDEBUG
+	if (plugin->common->debug_level) {
+		printf("\n" "piece %u corrupted, erase %u-%u KiB\n", (unsigned) index,
+		       (unsigned) (beg / 1024), (unsigned) (end / 1024));
+	}
+#endif
+}
+
+// all = FALSE: verify pieces that marked by mark_pieces().
+// all = TRUE : verify all pieces that haven't been verified.
+// return TRUE if all pieces have been verified (or no piece hashes).
+static int  check_pieces(UgetPluginCurl* plugin, int all)
+{
+	uint8_t*  state;
+	uint64_t  beg, end;
+	uint64_t  piece_end;
+	uint32_t  index;
+	int       verified = TRUE;
+
+	if (pieces_usable(plugin) == FALSE)
+		return TRUE;
+
+	state = plugin->pieces.state;
+	for (index = 0;  index < plugin->pieces.hashes.n_pieces;  index++) {
+		switch (state[index]) {
+		case PIECE_VERIFIED:
+			continue;
+
+		case PIECE_CORRUPTED:
+			verified = FALSE;
+			continue;
+
+		case PIECE_UNVERIFIED:
+			if (all == FALSE)
+				continue;
+			break;
+
+		case PIECE_PENDING:
+			state[index] = PIECE_UNVERIFIED;
+			plugin->pieces.n_pending--;
+			break;
+		}
+		// user stop plug-in while verifying all pieces
+		if (plugin->paused)
+			return FALSE;
+
+		// piece is completed if no lacking block in it.
+		beg = (uint64_t) index * plugin->pieces.hashes.length;
+		piece_end = beg + plugin->pieces.hashes.length;
+		if (piece_end > (uint64_t) plugin->file.size)
+			piece_end = plugin->file.size;
+		if (uget_a2cf_lack(&plugin->aria2.ctrl, &beg, &end) && beg < piece_end) {
+			verified = FALSE;
+			continue;
+		}
+
+		if (verify_piece(plugin, index))
+			state[index] = PIECE_VERIFIED;
+		else {
+			erase_piece(plugin, index);
+			verified = FALSE;
+		}
+	}
+	return verified;
+}
+
+// return lacking range of corrupted piece.
+static int  requeue_piece(UgetPluginCurl* plugin, uint64_t* beg, uint64_t* end)
+{
+	uint8_t*  state;
+	uint64_t  cur, limit;
+	uint32_t  index;
+
+	state = plugin->pieces.state;
+	for (index = 0;  index < plugin->pieces.hashes.n_pieces;  index++) {
+		if (state[index] != PIECE_CORRUPTED)
+			continue;
+		// range of erased blocks
+		cur = ((uint64_t) index * plugin->pieces.hashes.length) & ~(uint64_t)16383;
+		limit = ((uint64_t) (index + 1) * plugin->pieces.hashes.length + 16383) & ~(uint64_t)16383;
+		if (limit > (uint64_t) plugin->file.size)
+			limit = plugin->file.size;
+		// continue from previous requeued range in this piece
+		if (plugin->pieces.requeue > cur && plugin->pieces.requeue < limit)
+			cur = plugin->pieces.requeue;
+
+		if (uget_a2cf_lack(&plugin->aria2.ctrl, &cur, end) && cur < limit) {
+			if (end[0] < limit)
+				plugin->pieces.requeue = end[0];
+			else {
+				end[0] = limit;
+				plugin->pieces.requeue = 0;
+				state[index] = PIECE_UNVERIFIED;
+				plugin->pieces.n_corrupted--;
+			}
+			beg[0] = cur;
+			return TRUE;
+		}
+		// segments have filled it again
+		plugin->pieces.requeue = 0;
+		state[index] = PIECE_UNVERIFIED;
+		plugin->pieces.n_corrupted--;
+	}
+	return FALSE;
+}
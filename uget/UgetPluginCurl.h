@@ -42,6 +42,8 @@
 #include <UgetData.h>
 #include <UgetPlugin.h>
 #include <UgetA2cf.h>
+#include <UgetCurl.h>     // UgetCurlNotify
+#include <UgetHost.h>
 //#include <curl/curl.h>    // curl_slist
 
 #ifdef __cplusplus
@@ -52,6 +54,54 @@ typedef struct UgetPluginCurl    UgetPluginCurl;
 
 extern  const  UgetPluginInfo*   UgetPluginCurlInfo;
 
+typedef enum {
+	UGET_PLUGIN_CURL_GLOBAL = UGET_PLUGIN_GLOBAL_DERIVED,
+	// number of curl_multi threads, 0 = one thread per segment,
+	// -1 = number of processors (default)
+	UGET_PLUGIN_CURL_GLOBAL_ENGINE,     // get/set parameter = (intptr_t)
+	// size of receive buffer (bytes) for each segment, 0 = libcurl default
+	UGET_PLUGIN_CURL_GLOBAL_BUFFER_SIZE,   // get/set parameter = (intptr_t)
+	// policy of splitting segments, see UgetPluginCurlSplit
+	UGET_PLUGIN_CURL_GLOBAL_SPLIT,      // get/set parameter = (intptr_t)
+	// how to save aria2 control file, see UgetPluginCurlControl
+	UGET_PLUGIN_CURL_GLOBAL_CONTROL,    // get/set parameter = (intptr_t)
+	// interval (milliseconds) of saving aria2 control file
+	UGET_PLUGIN_CURL_GLOBAL_SAVE_INTERVAL,  // get/set parameter = (intptr_t)
+	// how to write downloaded data, see UgetPluginCurlOutput
+	UGET_PLUGIN_CURL_GLOBAL_OUTPUT,     // get/set parameter = (intptr_t)
+	// occupancy of write-behind buffer pool, all fields are 0 if not in use
+	UGET_PLUGIN_CURL_GLOBAL_WRITER_STATS,  // get parameter = (UgetWriterStats*)
+} UgetPluginCurlGlobalCode;
+
+typedef enum {
+	// steal from the segment that will finish last (by throughput)
+	UGET_PLUGIN_CURL_SPLIT_THROUGHPUT,
+	// halve the segment that has the most remaining bytes
+	UGET_PLUGIN_CURL_SPLIT_LARGEST,
+} UgetPluginCurlSplit;
+
+typedef enum {
+	// rewrite whole control file
+	UGET_PLUGIN_CURL_CONTROL_REWRITE,
+	// map control file to memory and write changed bytes only.
+	// data file is flushed before it, so completed blocks are on disk.
+	UGET_PLUGIN_CURL_CONTROL_MMAP,
+} UgetPluginCurlControl;
+
+typedef enum {
+	// write callback call pwrite() and wait for it
+	UGET_PLUGIN_CURL_OUTPUT_PWRITE,
+	// write callback submit data to io_uring (Linux only).
+	// It use pwrite() if io_uring is not available.
+	UGET_PLUGIN_CURL_OUTPUT_IO_URING,
+	// write callback copy data to shared buffer pool and return,
+	// disk writer threads merge adjacent buffers and write them.
+	UGET_PLUGIN_CURL_OUTPUT_WRITE_BEHIND,
+	// write-behind and open file with O_DIRECT, data bypass page cache.
+	// Last block is padded and file is truncated when it is completed.
+	UGET_PLUGIN_CURL_OUTPUT_DIRECT,
+} UgetPluginCurlOutput;
+
 /* ----------------------------------------------------------------------------
    UgetPluginCurl: libcurl plug-in that derived from UgetPlugin.
 
@@ -94,6 +144,7 @@ struct UgetPluginCurl
 		char*     path;        // folder + filename
 		time_t    time;        // date and time
 		int64_t   size;        // total size (0 if size unknown)
+		int64_t   size_last;   // total size of last run, from UgetProgress
 	} file;
 
 	// aria2 control file
@@ -111,11 +162,52 @@ struct UgetPluginCurl
 	// segment (split download)
 	struct {
 		UgList    list;    // list of segment (UgetCurl)
+		UgList    idle;    // freed segments, they can be reused by this one
 		int64_t   beg;     // beginning of undownloaded position
 		int       n_max;
 		int       n_active;
+		int       endgame; // duplicated tail ranges are running
 	} segment;
 
+	// all segments take tokens from this bucket, it's rate is limit.download.
+	// UgetTask can replace it by UGET_PLUGIN_CTRL_BUCKET before starting.
+	UgetBucket*   bucket;
+
+	// segment acquire connection from host of it's URI before connecting.
+	// UgetTask set root by UGET_PLUGIN_CTRL_HOST before starting.
+	struct {
+		UgetHost*   root;      // NULL if connections are unlimited
+		UgetHost*   reserved;  // plugin_start() reserve the first connection
+	} host;
+
+	// UgetCurl, plugin_ctrl() and plugin_sync() wake up plugin_thread()
+	UgetCurlNotify  notify;
+	// all segments write to the same file descriptor
+	UgetCurlOutput  output;
+	// output.writer point to it if global write-behind pool is used.
+	UgetWriterFile  writer;
+
+	// verify UgetCommon::checksum, output.checksum point to checksum.data
+	// Segments hash data inline if it is at checksum position, plug-in read
+	// back data that segments wrote ahead of it.
+	struct {
+		UgetChecksum  data;
+		char          hex[UGET_CHECKSUM_HEX_MAX];    // expected digest
+		int           fd;        // read-only, -1 if it is not opened
+		int64_t       offset;    // file offset of fd
+	} checksum;
+
+	// verify UgetCommon::piece_hashes when pieces are completed.
+	// Corrupted piece is erased from aria2 control file and downloaded again.
+	struct {
+		UgetChecksumPieces  hashes;
+		uint8_t*  state;         // state of each piece, NULL if it is disabled
+		int       n_pending;     // number of pieces that may be completed
+		int       n_corrupted;   // number of pieces waiting to download again
+		uint64_t  requeue;       // search position in corrupted piece
+		int       fd;            // read-only, -1 if it is not opened
+	} pieces;
+
 	// progress for uget_plugin_sync()
 	time_t        start_time;
 
@@ -123,14 +215,31 @@ struct UgetPluginCurl
 	// base.upload = base uploaded size      (existing uploaded size)
 	// size.download = downloaded size  (base + threads downloaded size)
 	// size.upload = uploaded size      (base + threads uploaded size)
-	// speed.download = downloading speed
-	// speed.upload = uploading speed
+	// speed.download = downloading speed (estimated by 'rate')
+	// speed.upload = uploading speed     (sum of segments)
 	// limit.download = download speed limit
 	// limit.upload = upload speed limit
 	struct {
 		int64_t   upload;
 		int64_t   download;
 	} base, size, speed, limit;
+	UgetRate      rate;    // estimate speed.download from size.download
+
+	// plugin_thread() publish progress here by seqlock,
+	// plugin_sync() copy it without waiting for plug-in.
+	struct {
+		UgSeq     seq;
+		int64_t   total;       // 0 if size unknown
+		int64_t   upload;
+		int64_t   download;
+		int64_t   upload_speed;
+		int64_t   download_speed;
+		int64_t   wasted;
+	} snapshot;
+
+	// data received beyond the end of segments and discarded.
+	// bounded Range request should keep it small.
+	int64_t       wasted;
 
 	// flags
 	uint8_t       limit_changed:1; // speed limit changed by user or program
@@ -0,0 +1,76 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#include <UgetRate.h>
+
+void  uget_rate_init (UgetRate* rate, int window)
+{
+	rate->value = 0;
+	rate->count = 0;
+	rate->time = 0;
+	rate->window = (window > 0) ? window : UGET_RATE_WINDOW;
+}
+
+int64_t  uget_rate_update (UgetRate* rate, int64_t count, uint64_t now)
+{
+	int64_t  elapsed;
+	int64_t  delta;
+	int64_t  sample;
+
+	if (rate->time == 0 || count < rate->count) {
+		// first sample or counter restarted
+		rate->count = count;
+		rate->time = now;
+		return rate->value;
+	}
+	elapsed = (int64_t) (now - rate->time);
+	if (elapsed < UGET_RATE_INTERVAL)
+		return rate->value;
+
+	delta = count - rate->count;
+	sample = delta * 1000 / elapsed;
+	// weight = 1 - exp(-elapsed / window), approximated by
+	// elapsed / (elapsed + window). First sample is used as it is.
+	if (rate->value == 0 && delta > 0)
+		rate->value = sample;
+	else {
+		rate->value += (sample - rate->value) * elapsed /
+		               (elapsed + rate->window);
+	}
+	rate->count = count;
+	rate->time = now;
+	return rate->value;
+}
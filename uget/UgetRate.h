@@ -0,0 +1,78 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+// Exponentially weighted moving average of transfer rate
+#ifndef UGET_RATE_H
+#define UGET_RATE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UGET_RATE_WINDOW      2000    // milliseconds, time constant
+#define UGET_RATE_INTERVAL    250     // milliseconds, minimum sample interval
+
+typedef struct UgetRate        UgetRate;
+
+/* ----------------------------------------------------------------------------
+   UgetRate: estimate rate from byte counter and monotonic clock.
+             Each sample is weighted by it's duration, so estimated rate
+             follows changes in about 'window' milliseconds no matter how
+             often it is updated. It decays to 0 if counter stops.
+ */
+
+struct UgetRate
+{
+	int64_t   value;     // bytes per second
+	int64_t   count;     // counter of last sample
+	uint64_t  time;      // time of last sample (milliseconds), 0 = no sample
+	int       window;    // time constant (milliseconds)
+};
+
+void     uget_rate_init (UgetRate* rate, int window);
+
+// count: total bytes, it can restart from 0.
+// now  : ug_get_time_count()
+// return estimated bytes per second.
+int64_t  uget_rate_update (UgetRate* rate, int64_t count, uint64_t now);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // End of UGET_RATE_H
@@ -41,6 +41,7 @@
 
 // static function
 static int  uget_task_dispatch1(UgetTask* task, UgetNode* node, UgetPlugin* plugin);
+static UgetBucket*  uget_task_new_bucket(UgetTask* task, UgetNode* node);
 
 void  uget_task_init(UgetTask* task)
 {
@@ -56,6 +57,8 @@ void  uget_task_init(UgetTask* task)
 	task->speed.upload   = 0;
 	task->limit.download = 0;
 	task->limit.upload   = 0;
+	task->bucket = uget_bucket_new(NULL);
+	task->host = uget_host_new();
 }
 
 void  uget_task_final(UgetTask* task)
@@ -63,6 +66,8 @@ void  uget_task_final(UgetTask* task)
 	uget_task_remove_all(task);
 //	ug_slinks_final((UgSLinks*) task);
 	ug_array_clear(task);
+	uget_bucket_unref(task->bucket);
+	uget_host_unref(task->host);
 }
 
 int   uget_task_add(UgetTask* task, UgetNode* node, const UgetPluginInfo* info)
@@ -103,6 +108,17 @@ int   uget_task_add(UgetTask* task, UgetNode* node, const UgetPluginInfo* info)
 	relation->task = ug_malloc0(sizeof(struct UgetRelationTask));
 	relation->task->plugin = uget_plugin_new(info);
 	uget_plugin_accept(relation->task->plugin, node->info);
+	// plug-in take tokens from bucket to limit download speed.
+	relation->task->bucket = uget_task_new_bucket(task, node);
+	uget_bucket_set_weight(relation->task->bucket, relation->priority + 1);
+	if (uget_plugin_ctrl(relation->task->plugin, UGET_PLUGIN_CTRL_BUCKET,
+	                     relation->task->bucket) == FALSE)
+	{
+		uget_bucket_unref(relation->task->bucket);
+		relation->task->bucket = NULL;
+	}
+	// plug-in acquire connections from host before connecting to server.
+	uget_plugin_ctrl(relation->task->plugin, UGET_PLUGIN_CTRL_HOST, task->host);
 	if (task->limit.download || task->limit.upload) {
 		// backup current speed limit
 		temp_int_array[0] = task->limit.download;
@@ -114,16 +130,21 @@ int   uget_task_add(UgetTask* task, UgetNode* node, const UgetPluginInfo* info)
 		                    temp_int_array[0] - dlul_int_array[0],
 		                    temp_int_array[1] - dlul_int_array[1]);
 		// set speed limit for new task
+		if (relation->task->bucket)
+			dlul_int_array[0] = 0;
 		uget_plugin_ctrl_speed(relation->task->plugin, dlul_int_array);
 		// restore current speed limit
 		task->limit.download = temp_int_array[0];
 		task->limit.upload   = temp_int_array[1];
+		uget_bucket_set_rate(task->bucket, task->limit.download);
 	}
 	if (uget_plugin_start(relation->task->plugin) == FALSE) {
 		// dispatch error message from plug-in
 		uget_task_dispatch1(task, node, relation->task->plugin);
 		// release plug-in
 		uget_plugin_unref(relation->task->plugin);
+		if (relation->task->bucket)
+			uget_bucket_unref(relation->task->bucket);
 		// free task runtime data
 		ug_free(relation->task);
 		relation->task = NULL;
@@ -148,6 +169,8 @@ int  uget_task_remove(UgetTask* task, UgetNode* node)
 //					uget_event_new_state(node, UGET_GROUP_QUEUING));
 			uget_plugin_stop(relation->task->plugin);
 			uget_plugin_unref(relation->task->plugin);
+			if (relation->task->bucket)
+				uget_bucket_unref(relation->task->bucket);
 			relation->group &= ~UGET_GROUP_ACTIVE;
 			// free task runtime data
 			ug_free(relation->task);
@@ -291,6 +314,29 @@ void  uget_task_add_watch(UgetTask* task, UgetWatchFunc func, void* data)
 
 #define SPEED_MIN        512
 
+// create download bucket under category bucket. Category bucket will be
+// freed when it's last download bucket was freed.
+static UgetBucket*  uget_task_new_bucket(UgetTask* task, UgetNode* node)
+{
+	UgetCategory*  category = NULL;
+	UgetBucket*    cbucket;
+	UgetBucket*    bucket;
+
+	cbucket = uget_bucket_find(task->bucket, node->parent);
+	if (cbucket == NULL) {
+		cbucket = uget_bucket_new(task->bucket);
+		cbucket->data = node->parent;
+	}
+	if (node->parent)
+		category = ug_info_get(node->parent->info, UgetCategoryInfo);
+	if (category)
+		uget_bucket_set_rate(cbucket, category->speed_limit);
+
+	bucket = uget_bucket_new(cbucket);
+	uget_bucket_unref(cbucket);
+	return bucket;
+}
+
 static void uget_task_disable_limit_index(UgetTask* task, int idx);
 static void uget_task_adjust_speed_index(UgetTask* task, int idx, int limit_new);
 
@@ -298,6 +344,7 @@ void  uget_task_set_speed(UgetTask* task, int dl_speed, int ul_speed)
 {
 	// download
 	task->limit.download = dl_speed;
+	uget_bucket_set_rate(task->bucket, dl_speed);
 	if (dl_speed == 0)
 		uget_task_disable_limit_index(task, 0);
 	else if (task->n_links > 0)
@@ -313,9 +360,28 @@ void  uget_task_set_speed(UgetTask* task, int dl_speed, int ul_speed)
 
 void  uget_task_adjust_speed(UgetTask* task)
 {
+	UgSLink*       link;
+	UgetNode*      node;
+	UgetRelation*  relation;
+	UgetCategory*  category;
+
 	if (task->n_links == 0)
 		return;
 
+	// user may change priority of download or speed limit of category.
+	for (link = task->used;  link;  link = link->next) {
+		node = (UgetNode*) link->data;
+		relation = ug_info_get(node->info, UgetRelationInfo);
+		if (relation->task->bucket == NULL)
+			continue;
+		uget_bucket_set_weight(relation->task->bucket, relation->priority + 1);
+		category = NULL;
+		if (node->parent)
+			category = ug_info_get(node->parent->info, UgetCategoryInfo);
+		if (category)
+			uget_bucket_set_rate(relation->task->bucket->parent, category->speed_limit);
+	}
+
 	if (task->limit.download > 0)
 		uget_task_adjust_speed_index(task, 0, task->limit.download - task->speed.download);
 	if (task->limit.upload > 0)
@@ -329,17 +395,24 @@ static void uget_task_adjust_speed_index(UgetTask* task, int idx, int remain)
 	UgetRelation*  relation = NULL;
 	UgetRelation*  prev = NULL;
 	int            n_piece = 0;
+	int            n_links = 0;
 
 	if (remain > 0) {
 		// increase speed by priority
 		for (link = task->used;  link;  link = link->next) {
 			node = (UgetNode*) link->data;
 			relation = ug_info_get(node->info, UgetRelationInfo);
+			// download speed of this one is limited by bucket
+			if (idx == 0 && relation->task->bucket)
+				continue;
 			relation->task->prev = prev;
 			prev = relation;
 			n_piece += relation->priority + 1;
 		}
+		relation = prev;
 
+		if (n_piece == 0)
+			return;
 		remain = remain / n_piece;
 		for (;  relation;  relation = prev) {
 			relation->task->limit[idx] = relation->task->speed[idx] +
@@ -354,10 +427,21 @@ static void uget_task_adjust_speed_index(UgetTask* task, int idx, int remain)
 	}
 	else {
 		// reduce speed
-		remain = remain / task->n_links;
 		for (link = task->used;  link;  link = link->next) {
 			node = (UgetNode*) link->data;
 			relation = ug_info_get(node->info, UgetRelationInfo);
+			if (idx == 0 && relation->task->bucket)
+				continue;
+			n_links++;
+		}
+		if (n_links == 0)
+			return;
+		remain = remain / n_links;
+		for (link = task->used;  link;  link = link->next) {
+			node = (UgetNode*) link->data;
+			relation = ug_info_get(node->info, UgetRelationInfo);
+			if (idx == 0 && relation->task->bucket)
+				continue;
 			relation->task->limit[idx] = relation->task->speed[idx] + remain;
 			if (relation->task->limit[idx] < SPEED_MIN)
 				relation->task->limit[idx] = SPEED_MIN;
@@ -376,6 +460,8 @@ static void uget_task_disable_limit_index(UgetTask* task, int idx)
 	for (link = task->used;  link;  link = link->next) {
 		node = (UgetNode*) link->data;
 		relation = ug_info_get(node->info, UgetRelationInfo);
+		if (idx == 0 && relation->task->bucket)
+			continue;
 		relation->task->limit[idx] = 0;
 		uget_plugin_ctrl_speed(relation->task->plugin,
 		                       relation->task->limit);
@@ -44,6 +44,7 @@
 #include <UgetData.h>
 #include <UgetNode.h>
 #include <UgetPlugin.h>
+#include <UgetHost.h>
 
 #define UGET_TASK_N_WATCH    4
 
@@ -105,6 +106,11 @@ struct UgetTask
 		int   download;
 	} speed, limit;
 
+	// download speed limit: global bucket -> category bucket -> download bucket
+	UgetBucket*  bucket;
+	// connection budget: all hosts -> each host
+	UgetHost*    host;
+
 #ifdef __cplusplus
 	// C++11 standard-layout
 	inline void init(void)
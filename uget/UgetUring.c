@@ -0,0 +1,384 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <UgDefine.h>
+#include <UgetUring.h>
+
+#if defined __linux__ && defined HAVE_LINUX_IO_URING_H
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#endif
+
+#if defined __linux__ && defined HAVE_LINUX_IO_URING_H && defined __NR_io_uring_setup
+
+struct UgetUringWrite
+{
+	int64_t  offset;
+	int      fd;
+	int      length;
+	int      done;       // written bytes
+};
+
+static int  uring_setup (unsigned entries, struct io_uring_params* params)
+{
+	return (int) syscall (__NR_io_uring_setup, entries, params);
+}
+
+static int  uring_enter (int fd, unsigned to_submit, unsigned min_complete,
+                         unsigned flags)
+{
+	return (int) syscall (__NR_io_uring_enter, fd, to_submit, min_complete,
+	                      flags, NULL, 0);
+}
+
+static int  uring_register (int fd, unsigned opcode, void* arg, unsigned n_args)
+{
+	return (int) syscall (__NR_io_uring_register, fd, opcode, arg, n_args);
+}
+
+static int  uring_map (UgetUring* uring, struct io_uring_params* params)
+{
+	char*  ring;
+
+	// submission queue
+	uring->sq.ring_size = params->sq_off.array +
+	                      params->sq_entries * sizeof (unsigned);
+	ring = mmap (NULL, uring->sq.ring_size, PROT_READ | PROT_WRITE,
+	             MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQ_RING);
+	if (ring == MAP_FAILED)
+		return FALSE;
+	uring->sq.ring  = ring;
+	uring->sq.head  = (unsigned*) (ring + params->sq_off.head);
+	uring->sq.tail  = (unsigned*) (ring + params->sq_off.tail);
+	uring->sq.mask  = (unsigned*) (ring + params->sq_off.ring_mask);
+	uring->sq.array = (unsigned*) (ring + params->sq_off.array);
+
+	uring->sq.sqes_size = params->sq_entries * sizeof (struct io_uring_sqe);
+	uring->sq.sqes = mmap (NULL, uring->sq.sqes_size, PROT_READ | PROT_WRITE,
+	                       MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_SQES);
+	if (uring->sq.sqes == MAP_FAILED) {
+		uring->sq.sqes = NULL;
+		return FALSE;
+	}
+
+	// completion queue. Kernel that has IORING_FEAT_SINGLE_MMAP can map it
+	// separately too.
+	uring->cq.ring_size = params->cq_off.cqes +
+	                      params->cq_entries * sizeof (struct io_uring_cqe);
+	ring = mmap (NULL, uring->cq.ring_size, PROT_READ | PROT_WRITE,
+	             MAP_SHARED | MAP_POPULATE, uring->fd, IORING_OFF_CQ_RING);
+	if (ring == MAP_FAILED)
+		return FALSE;
+	uring->cq.ring = ring;
+	uring->cq.head = (unsigned*) (ring + params->cq_off.head);
+	uring->cq.tail = (unsigned*) (ring + params->cq_off.tail);
+	uring->cq.mask = (unsigned*) (ring + params->cq_off.ring_mask);
+	uring->cq.cqes = ring + params->cq_off.cqes;
+	return TRUE;
+}
+
+static int  uring_alloc_buffers (UgetUring* uring, int n_buffers, int buffer_size)
+{
+	struct iovec*  iov;
+	void*          addr;
+	int            index;
+
+	if (posix_memalign (&addr, 4096, (size_t) n_buffers * buffer_size) != 0)
+		return FALSE;
+	uring->buffer.addr = addr;
+	uring->buffer.size = buffer_size;
+	uring->buffer.count = n_buffers;
+	uring->buffer.free = calloc (n_buffers, sizeof (int));
+	uring->buffer.iov = calloc (n_buffers, sizeof (struct iovec));
+	uring->buffer.writes = calloc (n_buffers, sizeof (struct UgetUringWrite));
+	if (uring->buffer.free == NULL || uring->buffer.iov == NULL ||
+	    uring->buffer.writes == NULL)
+	{
+		return FALSE;
+	}
+
+	iov = uring->buffer.iov;
+	for (index = 0;  index < n_buffers;  index++) {
+		iov[index].iov_base = uring->buffer.addr + (size_t) index * buffer_size;
+		iov[index].iov_len  = buffer_size;
+		uring->buffer.free[index] = n_buffers - index - 1;
+	}
+	uring->buffer.n_free = n_buffers;
+	// fixed buffers avoid mapping user pages for each write.
+	// It may fail if RLIMIT_MEMLOCK is too small, use IORING_OP_WRITEV then.
+	if (uring_register (uring->fd, IORING_REGISTER_BUFFERS, iov, n_buffers) == 0)
+		uring->buffer.registered = TRUE;
+	return TRUE;
+}
+
+UgetUring* uget_uring_new (int n_buffers, int buffer_size)
+{
+	UgetUring*  uring;
+	struct io_uring_params  params;
+
+	if (n_buffers <= 0)
+		n_buffers = UGET_URING_BUFFERS;
+	if (buffer_size <= 0)
+		buffer_size = UGET_URING_BUFFER_SIZE;
+	// keep buffer aligned to page size
+	buffer_size = (buffer_size + 4095) & ~4095;
+
+	memset (&params, 0, sizeof (params));
+	// each buffer has at most one request in flight, the queue never overflow.
+	uring = calloc (1, sizeof (UgetUring));
+	if (uring == NULL)
+		return NULL;
+	uring->fd = uring_setup (n_buffers, &params);
+	if (uring->fd < 0) {
+		free (uring);
+		return NULL;
+	}
+	ug_mutex_init (&uring->mutex);
+	if (uring_map (uring, &params) == FALSE ||
+	    uring_alloc_buffers (uring, n_buffers, buffer_size) == FALSE)
+	{
+		uget_uring_free (uring);
+		return NULL;
+	}
+	return uring;
+}
+
+void  uget_uring_free (UgetUring* uring)
+{
+	uget_uring_flush (uring);
+	if (uring->sq.ring)
+		munmap (uring->sq.ring, uring->sq.ring_size);
+	if (uring->sq.sqes)
+		munmap (uring->sq.sqes, uring->sq.sqes_size);
+	if (uring->cq.ring)
+		munmap (uring->cq.ring, uring->cq.ring_size);
+	// registered buffers are released when io_uring is closed.
+	close (uring->fd);
+	free (uring->buffer.addr);
+	free (uring->buffer.free);
+	free (uring->buffer.iov);
+	free (uring->buffer.writes);
+	ug_mutex_clear (&uring->mutex);
+	free (uring);
+}
+
+// submit the rest of data in buffer
+static int  uring_submit (UgetUring* uring, int index)
+{
+	struct UgetUringWrite*  write;
+	struct io_uring_sqe*    sqe;
+	struct iovec*           iov;
+	unsigned                tail;
+	unsigned                slot;
+	int                     result;
+
+	write = uring->buffer.writes + index;
+	iov = (struct iovec*) uring->buffer.iov + index;
+	tail = *uring->sq.tail;
+	slot = tail & *uring->sq.mask;
+	sqe = (struct io_uring_sqe*) uring->sq.sqes + slot;
+	memset (sqe, 0, sizeof (struct io_uring_sqe));
+	sqe->fd = write->fd;
+	sqe->off = write->offset + write->done;
+	sqe->user_data = index;
+	if (uring->buffer.registered) {
+		sqe->opcode = IORING_OP_WRITE_FIXED;
+		sqe->addr = (uintptr_t) ((char*) iov->iov_base + write->done);
+		sqe->len = write->length - write->done;
+		sqe->buf_index = index;
+	}
+	else {
+		// iovec must be valid until request is submitted.
+		iov->iov_len = write->length - write->done;
+		iov->iov_base = uring->buffer.addr +
+		                (size_t) index * uring->buffer.size + write->done;
+		sqe->opcode = IORING_OP_WRITEV;
+		sqe->addr = (uintptr_t) iov;
+		sqe->len = 1;
+	}
+	uring->sq.array[slot] = slot;
+	// kernel must see sqe before new tail
+	ug_atomic_store_int (uring->sq.tail, tail + 1);
+
+	do {
+		result = uring_enter (uring->fd, 1, 0, 0);
+	} while (result < 0 && errno == EINTR);
+	if (result < 0) {
+		// take it back, kernel doesn't consume it.
+		ug_atomic_store_int (uring->sq.tail, tail);
+		return errno;
+	}
+	return 0;
+}
+
+// handle completions, wait for at least one if 'wait' is TRUE.
+// return FALSE if it can't wait.
+static int   uring_reap (UgetUring* uring, int wait)
+{
+	struct UgetUringWrite*  write;
+	struct io_uring_cqe*    cqe;
+	unsigned                head;
+	int                     index;
+	int                     result;
+
+	head = *uring->cq.head;
+	if (wait && head == ug_atomic_load_int (uring->cq.tail)) {
+		do {
+			result = uring_enter (uring->fd, 0, 1, IORING_ENTER_GETEVENTS);
+		} while (result < 0 && errno == EINTR);
+		if (result < 0) {
+			if (uring->error == 0)
+				uring->error = errno;
+			return FALSE;
+		}
+	}
+
+	for (;  head != ug_atomic_load_int (uring->cq.tail);  head++) {
+		cqe = (struct io_uring_cqe*) uring->cq.cqes + (head & *uring->cq.mask);
+		index = (int) cqe->user_data;
+		result = cqe->res;
+		write = uring->buffer.writes + index;
+		// write the rest of data if it's short write
+		if (result > 0) {
+			write->done += result;
+			if (write->done < write->length) {
+				result = uring_submit (uring, index);
+				if (result == 0)
+					continue;
+				result = -result;
+			}
+		}
+		else if (result == 0)
+			result = -ENOSPC;
+		if (result < 0 && uring->error == 0)
+			uring->error = -result;
+		// buffer can be used again
+		uring->buffer.free[uring->buffer.n_free++] = index;
+		uring->n_pending--;
+	}
+	// release completion entries to kernel
+	ug_atomic_store_int (uring->cq.head, head);
+	return TRUE;
+}
+
+int   uget_uring_write (UgetUring* uring, int fd, const char* data,
+                        size_t length, int64_t offset)
+{
+	struct UgetUringWrite*  write;
+	size_t  size;
+	int     index;
+	int     result;
+
+	ug_mutex_lock (&uring->mutex);
+	while (length > 0 && uring->error == 0) {
+		// recycle completed buffers, wait if all buffers are in flight.
+		uring_reap (uring, uring->buffer.n_free == 0);
+		if (uring->buffer.n_free == 0)
+			continue;
+		index = uring->buffer.free[--uring->buffer.n_free];
+		size = (length < (size_t) uring->buffer.size) ?
+		       length : (size_t) uring->buffer.size;
+		memcpy (uring->buffer.addr + (size_t) index * uring->buffer.size,
+		        data, size);
+		write = uring->buffer.writes + index;
+		write->fd = fd;
+		write->offset = offset;
+		write->length = (int) size;
+		write->done = 0;
+		result = uring_submit (uring, index);
+		if (result) {
+			uring->error = result;
+			uring->buffer.free[uring->buffer.n_free++] = index;
+			break;
+		}
+		uring->n_pending++;
+		data += size;
+		offset += size;
+		length -= size;
+	}
+	result = (uring->error == 0);
+	ug_mutex_unlock (&uring->mutex);
+	return result;
+}
+
+int   uget_uring_flush (UgetUring* uring)
+{
+	int  error;
+
+	ug_mutex_lock (&uring->mutex);
+	while (uring->n_pending > 0) {
+		if (uring_reap (uring, TRUE) == FALSE)
+			break;
+	}
+	error = uring->error;
+	ug_mutex_unlock (&uring->mutex);
+	return error;
+}
+
+#else  // io_uring is not available
+
+UgetUring* uget_uring_new (int n_buffers, int buffer_size)
+{
+	return NULL;
+}
+
+void  uget_uring_free (UgetUring* uring)
+{
+}
+
+int   uget_uring_write (UgetUring* uring, int fd, const char* data,
+                        size_t length, int64_t offset)
+{
+	return FALSE;
+}
+
+int   uget_uring_flush (UgetUring* uring)
+{
+	return 0;
+}
+
+#endif  // HAVE_LINUX_IO_URING_H
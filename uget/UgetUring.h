@@ -0,0 +1,123 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+
+// Asynchronous file writing by Linux io_uring
+#ifndef UGET_URING_H
+#define UGET_URING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <UgThread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UGET_URING_BUFFERS        32       // number of buffers (queue depth)
+#define UGET_URING_BUFFER_SIZE    65536    // bytes, size of each buffer
+
+typedef struct UgetUring        UgetUring;
+
+/* ----------------------------------------------------------------------------
+   UgetUring: copy data to registered buffer and submit it to io_uring, caller
+              doesn't wait for disk. If all buffers are in flight, writer wait
+              for completions. Short write is submitted again.
+              Only Linux that has io_uring (5.1+) support it, uget_uring_new()
+              return NULL on other platforms, caller use pwrite() instead.
+ */
+
+struct UgetUring
+{
+	UgMutex    mutex;
+	int        fd;         // io_uring file descriptor
+
+	// submission queue. kernel and user space share these by mmap()
+	struct {
+		unsigned*  head;
+		unsigned*  tail;
+		unsigned*  mask;
+		unsigned*  array;
+		void*      sqes;       // struct io_uring_sqe
+		void*      ring;
+		size_t     ring_size;
+		size_t     sqes_size;
+	} sq;
+
+	// completion queue
+	struct {
+		unsigned*  head;
+		unsigned*  tail;
+		unsigned*  mask;
+		void*      cqes;       // struct io_uring_cqe
+		void*      ring;
+		size_t     ring_size;
+	} cq;
+
+	// data is copied to these buffers before submitting.
+	struct {
+		char*      addr;       // aligned to page size
+		int        size;       // size of each buffer
+		int        count;
+		int        registered; // IORING_REGISTER_BUFFERS succeeded
+		int*       free;       // stack of free buffer index
+		int        n_free;
+		void*      iov;        // struct iovec, one for each buffer
+		struct UgetUringWrite* writes;
+	} buffer;
+
+	int        n_pending;  // number of buffers that are in flight
+	int        error;      // errno of the first failed write, 0 = no error
+};
+
+// return NULL if io_uring is not available.
+UgetUring* uget_uring_new (int n_buffers, int buffer_size);
+// wait for all writes and free resource
+void  uget_uring_free (UgetUring* uring);
+
+// copy data and submit it, write position is 'offset' of 'fd'.
+// return FALSE if previous write failed (see UgetUring::error).
+int   uget_uring_write (UgetUring* uring, int fd, const char* data,
+                        size_t length, int64_t offset);
+// wait for all submitted writes.
+// return 0 or errno of the first failed write.
+int   uget_uring_flush (UgetUring* uring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // End of UGET_URING_H
@@ -0,0 +1,588 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+#if defined __linux__ && !defined _GNU_SOURCE
+#define _GNU_SOURCE      // O_DIRECT
+#endif
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#ifdef __ANDROID__
+#include <android/api-level.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <UgDefine.h>
+#include <UgStdio.h>
+#include <UgetWriter.h>
+
+#if !(defined _WIN32 || defined _WIN64)
+#include <fcntl.h>     // O_DIRECT, F_NOCACHE
+#include <sys/uio.h>
+#endif
+
+// pwritev() is available since Android 7.0 (API level 24)
+#if defined _WIN32 || defined _WIN64 || \
+    (defined __ANDROID__ && __ANDROID_API__ < 24)
+#define WRITER_NO_PWRITEV    1
+#endif
+
+#define WRITER_MAX_IOV       16    // maximum number of buffers per write
+
+#define ALIGN_DOWN(value)    ((value) & ~(int64_t) (UGET_WRITER_ALIGNMENT - 1))
+#define ALIGN_UP(value)      ALIGN_DOWN ((value) + UGET_WRITER_ALIGNMENT - 1)
+
+struct UgetWriterBlock
+{
+	UgetWriterBlock*  next;
+	UgetWriterFile*   wfile;   // NULL if buffer is free
+	char*    base;
+	char*    data;       // data of O_DIRECT file has the same alignment as offset
+	int64_t  offset;
+	int      length;
+	int      capacity;
+	int      fd;
+	int      hold;       // don't write it until it is full or flushed
+	int      flush;      // counted in UgetWriterFile::n_flush
+};
+
+static UgThreadResult  uget_writer_thread (UgetWriter* writer);
+
+UgetWriter*  uget_writer_new (int n_buffers, int buffer_size, int n_threads)
+{
+	UgetWriter*       writer;
+	UgetWriterBlock*  block;
+	uintptr_t         addr;
+	int               index;
+
+	if (n_buffers <= 0)
+		n_buffers = UGET_WRITER_BUFFERS;
+	if (buffer_size <= 0)
+		buffer_size = UGET_WRITER_BUFFER_SIZE;
+	if (n_threads <= 0)
+		n_threads = UGET_WRITER_THREADS;
+	// keep buffer aligned to page size
+	buffer_size = (int) ALIGN_UP (buffer_size);
+
+	writer = ug_malloc0 (sizeof (UgetWriter));
+	writer->buffer.addr = ug_malloc ((size_t) n_buffers * buffer_size +
+	                                 UGET_WRITER_ALIGNMENT);
+	writer->buffer.blocks = ug_malloc0 (sizeof (UgetWriterBlock) * n_buffers);
+	writer->threads = ug_malloc0 (sizeof (UgThread) * n_threads);
+	if (writer->buffer.addr == NULL || writer->buffer.blocks == NULL ||
+	    writer->threads == NULL)
+	{
+		ug_free (writer->buffer.addr);
+		ug_free (writer->buffer.blocks);
+		ug_free (writer->threads);
+		ug_free (writer);
+		return NULL;
+	}
+
+	addr = ((uintptr_t) writer->buffer.addr + UGET_WRITER_ALIGNMENT - 1) &
+	       ~(uintptr_t) (UGET_WRITER_ALIGNMENT - 1);
+	for (index = n_buffers - 1;  index >= 0;  index--) {
+		block = writer->buffer.blocks + index;
+		block->base = (char*) addr + (size_t) index * buffer_size;
+		block->next = writer->buffer.free;
+		writer->buffer.free = block;
+	}
+	writer->buffer.size = buffer_size;
+	writer->stats.n_buffers = n_buffers;
+
+	ug_mutex_init (&writer->mutex);
+	ug_cond_init (&writer->queued);
+	ug_cond_init (&writer->freed);
+	ug_cond_init (&writer->written);
+
+	for (index = 0;  index < n_threads;  index++) {
+		if (ug_thread_create (&writer->threads[index],
+		        (UgThreadFunc) uget_writer_thread, writer) != UG_THREAD_OK)
+		{
+			break;
+		}
+	}
+	writer->n_threads = index;
+	if (index == 0) {
+		uget_writer_free (writer);
+		return NULL;
+	}
+	return writer;
+}
+
+// let disk writer threads write held buffers of wfile, NULL = all files.
+static void  uget_writer_release (UgetWriter* writer, UgetWriterFile* wfile)
+{
+	UgetWriterBlock*  block;
+
+	for (block = writer->queue.head;  block;  block = block->next) {
+		if (wfile == NULL || block->wfile == wfile)
+			block->hold = FALSE;
+	}
+	ug_cond_broadcast (&writer->queued);
+}
+
+void  uget_writer_free (UgetWriter* writer)
+{
+	int  index;
+
+	// threads write all queued buffers before they exit.
+	ug_mutex_lock (&writer->mutex);
+	writer->quit = TRUE;
+	uget_writer_release (writer, NULL);
+	ug_mutex_unlock (&writer->mutex);
+	for (index = 0;  index < writer->n_threads;  index++)
+		ug_thread_join (&writer->threads[index]);
+
+	ug_cond_clear (&writer->queued);
+	ug_cond_clear (&writer->freed);
+	ug_cond_clear (&writer->written);
+	ug_mutex_clear (&writer->mutex);
+	ug_free (writer->buffer.addr);
+	ug_free (writer->buffer.blocks);
+	ug_free (writer->threads);
+	ug_free (writer);
+}
+
+void  uget_writer_get_stats (UgetWriter* writer, UgetWriterStats* stats)
+{
+	ug_mutex_lock (&writer->mutex);
+	*stats = writer->stats;
+	ug_mutex_unlock (&writer->mutex);
+}
+
+// ----------------------------------------------------------------------------
+// UgetWriterFile
+
+void  uget_writer_file_init (UgetWriterFile* wfile, UgetWriter* writer)
+{
+	wfile->writer = writer;
+	wfile->n_flush = 0;
+	wfile->error = 0;
+	wfile->fd_direct = -1;
+	wfile->size = 0;
+	wfile->padded = FALSE;
+}
+
+int   uget_writer_file_write (UgetWriterFile* wfile, int fd,
+                              const char* data, size_t length, int64_t offset)
+{
+	UgetWriter*       writer;
+	UgetWriterBlock*  block;
+	size_t            size;
+	int               gap;
+
+	writer = wfile->writer;
+	ug_mutex_lock (&writer->mutex);
+	while (length > 0 && wfile->error == 0) {
+		// append data to queued buffer that end at offset.
+		for (block = writer->queue.head;  block;  block = block->next) {
+			if (block->wfile == wfile && block->fd == fd &&
+			    block->offset + block->length == offset &&
+			    block->length < block->capacity)
+			{
+				break;
+			}
+		}
+		if (block == NULL) {
+			// wait for disk writer if all buffers are in use.
+			block = writer->buffer.free;
+			if (block == NULL) {
+				writer->stats.n_waits++;
+				uget_writer_release (writer, NULL);
+				ug_cond_wait (&writer->freed, &writer->mutex, -1);
+				continue;
+			}
+			writer->buffer.free = block->next;
+			block->next   = NULL;
+			block->wfile  = wfile;
+			block->fd     = fd;
+			block->offset = offset;
+			block->length = 0;
+			block->flush  = FALSE;
+			if (wfile->fd_direct == -1) {
+				block->data = block->base;
+				block->capacity = writer->buffer.size;
+				block->hold = FALSE;
+			}
+			else {
+				// buffer end at aligned offset when it is full.
+				gap = (int) (offset - ALIGN_DOWN (offset));
+				block->data = block->base + gap;
+				block->capacity = writer->buffer.size - gap;
+				block->hold = TRUE;
+			}
+			// add it to tail of queue
+			if (writer->queue.tail)
+				writer->queue.tail->next = block;
+			else
+				writer->queue.head = block;
+			writer->queue.tail = block;
+			writer->stats.n_queued++;
+			if (++writer->stats.n_used > writer->stats.n_peak)
+				writer->stats.n_peak = writer->stats.n_used;
+			if (block->hold == FALSE)
+				ug_cond_signal (&writer->queued);
+		}
+
+		size = block->capacity - block->length;
+		if (size > length)
+			size = length;
+		memcpy (block->data + block->length, data, size);
+		block->length += (int) size;
+		data   += size;
+		offset += size;
+		length -= size;
+		if (block->hold && block->length == block->capacity) {
+			block->hold = FALSE;
+			ug_cond_signal (&writer->queued);
+		}
+	}
+	ug_mutex_unlock (&writer->mutex);
+	return (length == 0) ? TRUE : FALSE;
+}
+
+int   uget_writer_file_flush (UgetWriterFile* wfile)
+{
+	UgetWriter*       writer;
+	UgetWriterBlock*  block;
+	int               index;
+	int               error;
+
+	writer = wfile->writer;
+	ug_mutex_lock (&writer->mutex);
+	// count buffers that are queued or being written. Data that copied after
+	// this doesn't delay flush, so busy download can't starve it.
+	for (index = 0;  index < writer->stats.n_buffers;  index++) {
+		block = writer->buffer.blocks + index;
+		if (block->wfile == wfile && block->flush == FALSE) {
+			block->flush = TRUE;
+			wfile->n_flush++;
+		}
+	}
+	uget_writer_release (writer, wfile);
+	while (wfile->n_flush > 0)
+		ug_cond_wait (&writer->written, &writer->mutex, -1);
+	error = wfile->error;
+	ug_mutex_unlock (&writer->mutex);
+	return error;
+}
+
+int   uget_writer_file_open_direct (UgetWriterFile* wfile, const char* path)
+{
+	int  fd = -1;
+
+#if defined O_DIRECT
+	fd = ug_open (path, UG_O_WRONLY | UG_O_BINARY | O_DIRECT, 0);
+#elif defined __APPLE__ && defined F_NOCACHE
+	fd = ug_open (path, UG_O_WRONLY | UG_O_BINARY, 0);
+	if (fd != -1)
+		fcntl (fd, F_NOCACHE, 1);
+#endif
+	if (fd == -1)
+		return FALSE;
+
+	ug_mutex_lock (&wfile->writer->mutex);
+	if (wfile->fd_direct == -1) {
+		wfile->fd_direct = fd;
+		fd = -1;
+	}
+	ug_mutex_unlock (&wfile->writer->mutex);
+	if (fd != -1)
+		ug_close (fd);
+	return TRUE;
+}
+
+void  uget_writer_file_close_direct (UgetWriterFile* wfile)
+{
+	int  fd;
+
+	ug_mutex_lock (&wfile->writer->mutex);
+	fd = wfile->fd_direct;
+	wfile->fd_direct = -1;
+	ug_mutex_unlock (&wfile->writer->mutex);
+	if (fd != -1)
+		ug_close (fd);
+}
+
+// ----------------------------------------------------------------------------
+// disk writer thread
+
+static void  uget_writer_unlink (UgetWriter* writer, UgetWriterBlock* prev,
+                                 UgetWriterBlock* block)
+{
+	if (prev)
+		prev->next = block->next;
+	else
+		writer->queue.head = block->next;
+	if (writer->queue.tail == block)
+		writer->queue.tail = prev;
+	block->next = NULL;
+	writer->stats.n_queued--;
+}
+
+// take first buffer that isn't held and buffers that follow it.
+// return number of buffers in 'blocks'.
+static int  uget_writer_take (UgetWriter* writer, UgetWriterBlock** blocks)
+{
+	UgetWriterBlock*  block;
+	UgetWriterBlock*  prev;
+	UgetWriterBlock*  last;
+	int               count;
+
+	prev = NULL;
+	for (last = writer->queue.head;  last;  last = last->next) {
+		if (last->hold == FALSE)
+			break;
+		prev = last;
+	}
+	if (last == NULL)
+		return 0;
+	uget_writer_unlink (writer, prev, last);
+	blocks[0] = last;
+	// buffers of O_DIRECT file are written one by one.
+	if (last->wfile->fd_direct != -1)
+		return 1;
+
+	for (count = 1;  count < WRITER_MAX_IOV;  count++) {
+		prev = NULL;
+		for (block = writer->queue.head;  block;  block = block->next) {
+			if (block->wfile == last->wfile && block->fd == last->fd &&
+			    block->offset == last->offset + last->length &&
+			    block->hold == FALSE)
+			{
+				break;
+			}
+			prev = block;
+		}
+		if (block == NULL)
+			break;
+		uget_writer_unlink (writer, prev, block);
+		blocks[count] = block;
+		last = block;
+	}
+	return count;
+}
+
+// return 0 or errno.
+static int  uget_writer_pwrite_all (int fd, const char* data, int length,
+                                    int64_t offset, int* n_calls)
+{
+	int  written;
+
+	for (;  length > 0;  length -= written) {
+		*n_calls += 1;
+		written = ug_pwrite (fd, data, length, offset);
+		if (written < 0)
+			return errno;
+		if (written == 0)
+			return EIO;
+		data   += written;
+		offset += written;
+	}
+	return 0;
+}
+
+// write adjacent buffers. return 0 or errno.
+static int  uget_writer_pwrite (UgetWriterBlock** blocks, int count,
+                                int* n_calls)
+{
+	UgetWriterBlock*  block;
+	int64_t           skip = 0;
+	int               index;
+	int               error;
+
+#ifndef WRITER_NO_PWRITEV
+	struct iovec  iov[WRITER_MAX_IOV];
+	ssize_t       result;
+
+	if (count > 1) {
+		for (index = 0;  index < count;  index++) {
+			iov[index].iov_base = blocks[index]->data;
+			iov[index].iov_len  = blocks[index]->length;
+		}
+		*n_calls += 1;
+		result = pwritev (blocks[0]->fd, iov, count, blocks[0]->offset);
+		if (result < 0)
+			return errno;
+		// short write is completed by ug_pwrite() below.
+		skip = result;
+	}
+#endif
+
+	for (index = 0;  index < count;  index++) {
+		block = blocks[index];
+		if (skip >= block->length) {
+			skip -= block->length;
+			continue;
+		}
+		error = uget_writer_pwrite_all (block->fd, block->data + skip,
+		                                block->length - (int) skip,
+		                                block->offset + skip, n_calls);
+		if (error)
+			return error;
+		skip = 0;
+	}
+	return 0;
+}
+
+// write aligned part of buffer to O_DIRECT file descriptor, unaligned head
+// and tail to normal file descriptor. If buffer reach end of file, it's
+// tail is padded with zero and *padded is set to TRUE.
+// return 0 or errno.
+static int  uget_writer_pwrite_direct (UgetWriterBlock* block, int fd_direct,
+                                       int64_t size, int* n_calls, int* padded)
+{
+	int64_t  beg;
+	int64_t  end;
+	int64_t  aligned_end;
+	int      error;
+
+	beg = ALIGN_UP (block->offset);
+	end = block->offset + block->length;
+	if (end == size)
+		aligned_end = ALIGN_UP (end);
+	else
+		aligned_end = ALIGN_DOWN (end);
+	// nothing can be written by O_DIRECT
+	if (aligned_end <= beg) {
+		return uget_writer_pwrite_all (block->fd, block->data, block->length,
+		                               block->offset, n_calls);
+	}
+
+	if (beg > block->offset) {
+		error = uget_writer_pwrite_all (block->fd, block->data,
+		                                (int) (beg - block->offset),
+		                                block->offset, n_calls);
+		if (error)
+			return error;
+	}
+	if (aligned_end > end)
+		memset (block->data + block->length, 0, (size_t) (aligned_end - end));
+	error = uget_writer_pwrite_all (fd_direct,
+	                                block->data + (beg - block->offset),
+	                                (int) (aligned_end - beg), beg, n_calls);
+	// file system may reject O_DIRECT write, use normal file descriptor.
+	if (error == EINVAL) {
+		if (aligned_end > end)
+			aligned_end = end;
+		error = uget_writer_pwrite_all (block->fd,
+		                                block->data + (beg - block->offset),
+		                                (int) (aligned_end - beg), beg, n_calls);
+	}
+	else if (error == 0 && aligned_end > end)
+		*padded = TRUE;
+	if (error)
+		return error;
+
+	if (aligned_end < end) {
+		error = uget_writer_pwrite_all (block->fd,
+		                                block->data + (aligned_end - block->offset),
+		                                (int) (end - aligned_end),
+		                                aligned_end, n_calls);
+	}
+	return error;
+}
+
+static UgThreadResult  uget_writer_thread (UgetWriter* writer)
+{
+	UgetWriterBlock*  blocks[WRITER_MAX_IOV];
+	UgetWriterBlock*  block;
+	UgetWriterFile*   wfile;
+	int64_t           size;
+	int64_t           n_bytes;
+	int               n_calls;
+	int               count;
+	int               index;
+	int               error;
+	int               padded;
+	int               fd_direct;
+
+	ug_mutex_lock (&writer->mutex);
+	for (;;) {
+		count = uget_writer_take (writer, blocks);
+		if (count == 0) {
+			if (writer->quit && writer->queue.head == NULL)
+				break;
+			ug_cond_wait (&writer->queued, &writer->mutex, -1);
+			continue;
+		}
+		wfile = blocks[0]->wfile;
+		n_calls = 0;
+		padded = FALSE;
+		// don't write more data to file that failed.
+		error = wfile->error;
+		if (error == 0) {
+			fd_direct = wfile->fd_direct;
+			size = wfile->size;
+			ug_mutex_unlock (&writer->mutex);
+			if (fd_direct == -1)
+				error = uget_writer_pwrite (blocks, count, &n_calls);
+			else {
+				error = uget_writer_pwrite_direct (blocks[0], fd_direct,
+				                                   size, &n_calls, &padded);
+			}
+			ug_mutex_lock (&writer->mutex);
+			if (wfile->error == 0)
+				wfile->error = error;
+			if (padded)
+				wfile->padded = TRUE;
+		}
+
+		n_bytes = 0;
+		for (index = 0;  index < count;  index++) {
+			block = blocks[index];
+			n_bytes += block->length;
+			if (block->flush)
+				wfile->n_flush--;
+			block->wfile = NULL;
+			block->next = writer->buffer.free;
+			writer->buffer.free = block;
+		}
+		if (error == 0)
+			writer->stats.n_bytes += n_bytes;
+		writer->stats.n_writes += n_calls;
+		writer->stats.n_used -= count;
+		ug_cond_broadcast (&writer->freed);
+		ug_cond_broadcast (&writer->written);
+	}
+	ug_mutex_unlock (&writer->mutex);
+	return UG_THREAD_RESULT;
+}
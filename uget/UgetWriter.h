@@ -0,0 +1,151 @@
+/*
+ *
+ *   Copyright (C) 2011-2020 by C.H. Huang
+ *   plushuang.tw@gmail.com
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ *  ---
+ *
+ *  In addition, as a special exception, the copyright holders give
+ *  permission to link the code of portions of this program with the
+ *  OpenSSL library under certain conditions as described in each
+ *  individual source file, and distribute linked combinations
+ *  including the two.
+ *  You must obey the GNU Lesser General Public License in all respects
+ *  for all of the code used other than OpenSSL.  If you modify
+ *  file(s) with this exception, you may extend this exception to your
+ *  version of the file(s), but you are not obligated to do so.  If you
+ *  do not wish to do so, delete this exception statement from your
+ *  version.  If you delete this exception statement from all source
+ *  files in the program, then also delete it here.
+ *
+ */
+
+
+// Write-behind buffer pool and disk writer threads
+#ifndef UGET_WRITER_H
+#define UGET_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <UgThread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define UGET_WRITER_BUFFERS        32        // number of buffers in pool
+#define UGET_WRITER_BUFFER_SIZE    262144    // bytes, size of each buffer
+#define UGET_WRITER_THREADS        2
+#define UGET_WRITER_ALIGNMENT      4096      // alignment of O_DIRECT
+
+typedef struct UgetWriter        UgetWriter;
+typedef struct UgetWriterFile    UgetWriterFile;
+typedef struct UgetWriterStats   UgetWriterStats;
+typedef struct UgetWriterBlock   UgetWriterBlock;
+
+/* ----------------------------------------------------------------------------
+   UgetWriter: Write callback copy data to buffer and return, disk writer
+               threads write buffers to files later. Data that follows
+               queued buffer is appended to it, adjacent buffers are written
+               by one pwritev(), so slow disk get a few large writes.
+               Writer wait only when all buffers are in use.
+
+   UgetWriterFile: a file that written by UgetWriter.
+               If file is opened with O_DIRECT, buffer is placed at the same
+               alignment as file offset and it is held until it is full.
+               Aligned part of buffer bypass page cache, unaligned edges of
+               segments are written to normal file descriptor.
+ */
+
+struct UgetWriterStats
+{
+	int       n_buffers;   // size of pool
+	int       n_used;      // buffers that are queued or being written
+	int       n_peak;      // maximum of n_used
+	int       n_queued;    // buffers that wait for writer thread
+	int64_t   n_waits;     // number of times that pool was exhausted
+	int64_t   n_writes;    // number of system calls
+	int64_t   n_bytes;     // written bytes
+};
+
+struct UgetWriter
+{
+	UgMutex    mutex;
+	UgCond     queued;     // writer threads wait for buffer
+	UgCond     freed;      // write callbacks wait for free buffer
+	UgCond     written;    // uget_writer_flush() wait for written data
+
+	struct {
+		char*             addr;
+		int               size;   // size of each buffer
+		UgetWriterBlock*  blocks;
+		UgetWriterBlock*  free;   // singly linked list
+	} buffer;
+
+	// queue of buffers, writer threads take them from head.
+	struct {
+		UgetWriterBlock*  head;
+		UgetWriterBlock*  tail;
+	} queue;
+
+	UgThread*  threads;
+	int        n_threads;
+	int        quit;
+
+	UgetWriterStats  stats;
+};
+
+struct UgetWriterFile
+{
+	UgetWriter*  writer;
+	int          n_flush;    // buffers that uget_writer_file_flush() wait for
+	int          error;      // errno of the first failed write, 0 = no error
+
+	// O_DIRECT file descriptor, -1 if it is not opened.
+	int          fd_direct;
+	// If last buffer reach 'size', it is padded to alignment and 'padded' is
+	// set. Caller must truncate file to 'size'. 0 = unknown size.
+	int64_t      size;
+	int          padded;
+};
+
+// n_buffers, buffer_size, n_threads: 0 = default value
+// return NULL if it failed to allocate buffers or create threads.
+UgetWriter*  uget_writer_new (int n_buffers, int buffer_size, int n_threads);
+// write all queued data and stop threads.
+void  uget_writer_free (UgetWriter* writer);
+void  uget_writer_get_stats (UgetWriter* writer, UgetWriterStats* stats);
+
+void  uget_writer_file_init (UgetWriterFile* wfile, UgetWriter* writer);
+// copy data to buffer, write position is 'offset' of 'fd'.
+// return FALSE if previous write of this file failed.
+int   uget_writer_file_write (UgetWriterFile* wfile, int fd,
+                              const char* data, size_t length, int64_t offset);
+// wait for data that copied before calling this function has been written.
+// return 0 or errno of the first failed write.
+int   uget_writer_file_flush (UgetWriterFile* wfile);
+// open file with O_DIRECT (F_NOCACHE on macOS), buffered data is written to it.
+// return FALSE if platform or file system doesn't support it.
+int   uget_writer_file_open_direct (UgetWriterFile* wfile, const char* path);
+// call it after uget_writer_file_flush()
+void  uget_writer_file_close_direct (UgetWriterFile* wfile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // End of UGET_WRITER_H
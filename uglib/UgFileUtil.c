@@ -54,6 +54,7 @@
 #include <unistd.h>
 #include <utime.h>       // struct utimbuf
 #include <sys/time.h>
+#include <sys/statvfs.h> // statvfs()
 #endif
 
 // ----------------------------------------------------------------------------
@@ -366,6 +367,32 @@ int  ug_create_dir_all (const char* dir, int len)
 }
 #endif  // USE__ANDROID__SAF
 
+#if defined _WIN32 || defined _WIN64
+int64_t  ug_get_free_space (const char* dir_utf8)
+{
+	ULARGE_INTEGER  available;
+	wchar_t*        dir;
+	BOOL            result;
+
+	dir = (wchar_t*) ug_utf8_to_utf16 (dir_utf8, -1, NULL);
+	result = GetDiskFreeSpaceExW (dir, &available, NULL, NULL);
+	ug_free (dir);
+
+	if (result == FALSE)
+		return -1;
+	return (int64_t) available.QuadPart;
+}
+#else
+int64_t  ug_get_free_space (const char* dir_utf8)
+{
+	struct statvfs  fs;
+
+	if (statvfs (dir_utf8, &fs) == -1)
+		return -1;
+	return (int64_t) fs.f_bavail * fs.f_frsize;
+}
+#endif  // _WIN32 || _WIN64
+
 // ----------------------------------------------------------------------------
 // File I/O
 
@@ -51,6 +51,7 @@
 #endif
 
 #include <time.h>
+#include <stdint.h>
 #include <UgList.h>
 
 #ifdef __cplusplus
@@ -106,6 +107,10 @@ int   ug_delete_dir (const char *dir_utf8);
 int   ug_create_dir_all (const char* dir_utf8, int len);
 //int ug_delete_dir_all (const char* dir_utf8, int len);
 
+// return available space (bytes) of the file system that contain dir_utf8.
+// return -1 if error
+int64_t  ug_get_free_space (const char* dir_utf8);
+
 // ----------------------------------------------------------------------------
 // File I/O
 
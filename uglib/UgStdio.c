@@ -98,6 +98,20 @@ int  ug_truncate (int fd, int64_t length)
 	return -1;
 }
 
+int  ug_pwrite (int fd, const void* buffer, unsigned int count, int64_t offset)
+{
+	OVERLAPPED  overlapped = {0};
+	DWORD       n_written;
+	HANDLE      h_file;
+
+	h_file = (HANDLE)_get_osfhandle(fd);
+	overlapped.Offset     = (DWORD) offset;
+	overlapped.OffsetHigh = (DWORD) (offset >> 32);
+	if (WriteFile (h_file, buffer, count, &n_written, &overlapped))
+		return (int) n_written;
+	return -1;
+}
+
 FILE* ug_fopen (const char *filename, const char *mode)
 {
 	FILE *retval;
@@ -174,12 +174,23 @@ int  ug_creat (const char* filename_utf8, int mode);
 int  ug_truncate (int fd, int64_t length);
 #endif
 
+// positional write, it doesn't change file offset on POSIX platform.
+// Returns : number of bytes written, or -1 if an error occurred.
+#if defined _WIN32 || defined _WIN64
+int  ug_pwrite (int fd, const void* buffer, unsigned int count, int64_t offset);
+#elif defined __ANDROID__ && __ANDROID_API__ >= 12
+#  define  ug_pwrite    pwrite64
+#else
+#  define  ug_pwrite    pwrite
+#endif
+
 // ug_read() return 0 if end-of-file. return -1 on error.
 #if defined _WIN32 || defined _WIN64
 #  define  ug_close     _close
 #  define  ug_read      _read
 #  define  ug_write     _write
 #  define  ug_sync      _commit
+#  define  ug_datasync  _commit
 #  define  ug_seek      _lseeki64   // for MS VC
 #  define  ug_tell      _telli64    // for MS VC
 #else
@@ -187,6 +198,12 @@ int  ug_truncate (int fd, int64_t length);
 #  define  ug_read      read
 #  define  ug_write     write
 #  define  ug_sync      fsync
+// flush file data without metadata if platform support it.
+#  if defined __linux__ || defined __ANDROID__
+#    define  ug_datasync  fdatasync
+#  else
+#    define  ug_datasync  fsync
+#  endif
 #  if defined __ANDROID__
 #    define  ug_seek      lseek64
 #    define  ug_tell(fd)  lseek64(fd, 0L, SEEK_CUR)
@@ -95,5 +95,90 @@ void  ug_mutex_unlock (UgMutex* mutex)
 	LeaveCriticalSection (*mutex);
 }
 
+void  ug_cond_init (UgCond* cond)
+{
+	*cond = ug_malloc (sizeof (CONDITION_VARIABLE));
+	InitializeConditionVariable (*cond);
+}
+
+void  ug_cond_clear (UgCond* cond)
+{
+	ug_free (*cond);
+}
+
+void  ug_cond_signal (UgCond* cond)
+{
+	WakeConditionVariable (*cond);
+}
+
+void  ug_cond_broadcast (UgCond* cond)
+{
+	WakeAllConditionVariable (*cond);
+}
+
+int   ug_cond_wait (UgCond* cond, UgMutex* mutex, int milliseconds)
+{
+	DWORD  timeout;
+
+	timeout = (milliseconds < 0) ? INFINITE : (DWORD) milliseconds;
+	if (SleepConditionVariableCS (*cond, *mutex, timeout))
+		return TRUE;
+	return FALSE;
+}
+
+#else  // pthread
+
+#include <errno.h>
+#include <time.h>
+#include <sys/time.h>
+
+// Mac OS X doesn't have pthread_condattr_setclock()
+#if defined CLOCK_MONOTONIC && !defined __APPLE__
+#define UG_COND_MONOTONIC
+#endif
+
+void  ug_cond_init (UgCond* cond)
+{
+#ifdef UG_COND_MONOTONIC
+	pthread_condattr_t  attr;
+
+	// wall clock may jump, timeout must not depend on it.
+	pthread_condattr_init (&attr);
+	pthread_condattr_setclock (&attr, CLOCK_MONOTONIC);
+	pthread_cond_init (cond, &attr);
+	pthread_condattr_destroy (&attr);
+#else
+	pthread_cond_init (cond, NULL);
+#endif
+}
+
+int   ug_cond_wait (UgCond* cond, UgMutex* mutex, int milliseconds)
+{
+	struct timespec  ts;
+#ifndef UG_COND_MONOTONIC
+	struct timeval   tv;
+#endif
+
+	if (milliseconds < 0)
+		return (pthread_cond_wait (cond, mutex) == 0) ? TRUE : FALSE;
+
+#ifdef UG_COND_MONOTONIC
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	ts.tv_sec  += milliseconds / 1000;
+	ts.tv_nsec += (milliseconds % 1000) * 1000000;
+#else
+	gettimeofday (&tv, NULL);
+	ts.tv_sec  = tv.tv_sec + milliseconds / 1000;
+	ts.tv_nsec = tv.tv_usec * 1000 + (milliseconds % 1000) * 1000000;
+#endif
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	if (pthread_cond_timedwait (cond, mutex, &ts) == ETIMEDOUT)
+		return FALSE;
+	return TRUE;
+}
+
 #endif // _WIN32 || _WIN64
 
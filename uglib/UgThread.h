@@ -48,6 +48,7 @@ extern "C" {
 
 typedef uintptr_t          UgThread;
 typedef void*              UgMutex;
+typedef void*              UgCond;
 typedef unsigned           UgThreadResult;
 
 // This function must return UG_THREAD_RESULT
@@ -68,12 +69,19 @@ void  ug_mutex_clear (UgMutex* mutex);
 void  ug_mutex_lock  (UgMutex* mutex);
 void  ug_mutex_unlock(UgMutex* mutex);
 
+// condition variable ------
+void  ug_cond_init     (UgCond* cond);
+void  ug_cond_clear    (UgCond* cond);
+void  ug_cond_signal   (UgCond* cond);
+void  ug_cond_broadcast(UgCond* cond);
+
 //#elif defined(HAVE_PTHREAD)
 #else
 #include <pthread.h>
 
 typedef pthread_t          UgThread;
 typedef pthread_mutex_t    UgMutex;
+typedef pthread_cond_t     UgCond;
 typedef void*              UgThreadResult;
 
 // This function must return UG_THREAD_RESULT
@@ -107,8 +115,83 @@ typedef UgThreadResult (*UgThreadFunc)(void*);
 // void ug_mutex_unlock(UgMutex* mutex);
 #define ug_mutex_unlock(mutex)  pthread_mutex_unlock(mutex)
 
+// condition variable ------
+// timed wait of ug_cond_wait() use monotonic clock if platform support it.
+void  ug_cond_init (UgCond* cond);
+
+// void ug_cond_clear(UgCond* cond);
+#define ug_cond_clear(cond)     pthread_cond_destroy(cond)
+
+// void ug_cond_signal(UgCond* cond);
+#define ug_cond_signal(cond)    pthread_cond_signal(cond)
+
+// void ug_cond_broadcast(UgCond* cond);
+#define ug_cond_broadcast(cond) pthread_cond_broadcast(cond)
+
 #endif  // _WIN32 || _WIN64
 
+// mutex must be locked before calling this function.
+// milliseconds < 0 : wait until cond is signaled.
+// return TRUE if cond is signaled, FALSE if timed out.
+int   ug_cond_wait (UgCond* cond, UgMutex* mutex, int milliseconds);
+
+// atomic ------
+// load has acquire semantics, store has release semantics,
+// swap, cas and fence are full barrier.
+#if defined __GNUC__ || defined __clang__
+#define ug_atomic_load_ptr(pptr)             __atomic_load_n(pptr, __ATOMIC_ACQUIRE)
+#define ug_atomic_swap_ptr(pptr, value)      __atomic_exchange_n(pptr, value, __ATOMIC_SEQ_CST)
+// return TRUE if *pptr was 'expected' and has been replaced by 'desired'
+#define ug_atomic_cas_ptr(pptr, expected, desired)  \
+		__sync_bool_compare_and_swap(pptr, expected, desired)
+#define ug_atomic_load_int(ptr)              __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define ug_atomic_store_int(ptr, value)      __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#define ug_atomic_load_int64(ptr)            __atomic_load_n(ptr, __ATOMIC_ACQUIRE)
+#define ug_atomic_store_int64(ptr, value)    __atomic_store_n(ptr, value, __ATOMIC_RELEASE)
+#define ug_atomic_fence()                    __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#elif defined _MSC_VER
+#include <intrin.h>
+#define ug_atomic_load_ptr(pptr)             \
+		_InterlockedCompareExchangePointer((void* volatile*)(pptr), NULL, NULL)
+#define ug_atomic_swap_ptr(pptr, value)      \
+		_InterlockedExchangePointer((void* volatile*)(pptr), value)
+#define ug_atomic_cas_ptr(pptr, expected, desired)  \
+		(_InterlockedCompareExchangePointer((void* volatile*)(pptr),  \
+		                                    desired, expected) == (expected))
+#define ug_atomic_load_int(ptr)              _InterlockedOr((volatile long*)(ptr), 0)
+#define ug_atomic_store_int(ptr, value)      \
+		_InterlockedExchange((volatile long*)(ptr), (long)(value))
+#define ug_atomic_load_int64(ptr)            \
+		_InterlockedCompareExchange64((volatile __int64*)(ptr), 0, 0)
+#define ug_atomic_store_int64(ptr, value)    \
+		_InterlockedExchange64((volatile __int64*)(ptr), (__int64)(value))
+#define ug_atomic_fence()                    _mm_mfence()
+#endif  // __GNUC__ || __clang__ || _MSC_VER
+
+// seqlock ------
+// One writer changes data between ug_seq_write_begin() and ug_seq_write_end().
+// Readers never wait for writer, they copy data after ug_seq_read_begin() and
+// copy it again if ug_seq_read_retry() return TRUE.
+typedef unsigned int    UgSeq;
+
+// void  ug_seq_write_begin(UgSeq* seq);
+#define ug_seq_write_begin(seq)    \
+		(ug_atomic_store_int(seq, *(seq) + 1), ug_atomic_fence())
+
+// void  ug_seq_write_end(UgSeq* seq);
+#define ug_seq_write_end(seq)      \
+		ug_atomic_store_int(seq, *(seq) + 1)
+
+// UgSeq ug_seq_read_begin(UgSeq* seq);
+#define ug_seq_read_begin(seq)     \
+		(UgSeq) ug_atomic_load_int(seq)
+
+// int   ug_seq_read_retry(UgSeq* seq, UgSeq count);
+// return TRUE if data was changed while reading.
+#define ug_seq_read_retry(seq, count)    \
+		(ug_atomic_fence(), ((count) & 1) || (UgSeq) ug_atomic_load_int(seq) != (count))
+
 
 #ifdef __cplusplus
 }
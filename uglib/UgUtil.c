@@ -56,15 +56,22 @@
 #include <stdio.h>      // popen()
 #include <unistd.h>
 #include <sys/time.h>
+#include <time.h>       // clock_gettime()
 #endif
 
 // ----------------------------------------------------------------------------
 // Time
 
+// monotonic clock, it doesn't jump when user change system time.
 uint64_t ug_get_time_count (void)
 {
 #if defined _WIN32 || defined _WIN64
-	return (uint64_t) GetTickCount ();
+	return (uint64_t) GetTickCount64 ();
+#elif defined CLOCK_MONOTONIC
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ((uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
 #else
     struct timeval tv;
 
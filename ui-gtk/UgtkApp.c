@@ -517,6 +517,19 @@ void  ugtk_app_set_plugin_setting (UgtkApp* app, UgtkSetting* setting)
 
 	// set default plug-in
 	uget_app_set_default_plugin ((UgetApp*) app, default_plugin);
+	// set curl plug-in
+	uget_plugin_global_set(UgetPluginCurlInfo, UGET_PLUGIN_CURL_GLOBAL_ENGINE,
+	                 (void*)(intptr_t) setting->curl.engine);
+	uget_plugin_global_set(UgetPluginCurlInfo, UGET_PLUGIN_CURL_GLOBAL_BUFFER_SIZE,
+	                 (void*)(intptr_t) (setting->curl.buffer_size * 1024));
+	uget_plugin_global_set(UgetPluginCurlInfo, UGET_PLUGIN_CURL_GLOBAL_SPLIT,
+	                 (void*)(intptr_t) setting->curl.split);
+	uget_plugin_global_set(UgetPluginCurlInfo, UGET_PLUGIN_CURL_GLOBAL_CONTROL,
+	                 (void*)(intptr_t) setting->curl.control);
+	uget_plugin_global_set(UgetPluginCurlInfo, UGET_PLUGIN_CURL_GLOBAL_SAVE_INTERVAL,
+	                 (void*)(intptr_t) setting->curl.save_interval);
+	uget_plugin_global_set(UgetPluginCurlInfo, UGET_PLUGIN_CURL_GLOBAL_OUTPUT,
+	                 (void*)(intptr_t) setting->curl.output);
 	// set agent plug-in (used by media and MEGA plug-in)
 	uget_plugin_agent_global_set(UGET_PLUGIN_AGENT_GLOBAL_PLUGIN,
 	                 (void*) default_plugin);
@@ -567,6 +580,10 @@ void  ugtk_app_set_other_setting (UgtkApp* app, UgtkSetting* setting)
 	uget_task_set_speed (&app->task,
 			setting->bandwidth.normal.download * 1024,
 			setting->bandwidth.normal.upload   * 1024);
+	// global connection budget
+	uget_host_set_limit (app->task.host,
+			setting->connection.per_host,
+			setting->connection.total);
 }
 
 void  ugtk_app_set_menu_setting (UgtkApp* app, UgtkSetting* setting)
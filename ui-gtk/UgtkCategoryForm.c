@@ -106,6 +106,15 @@ void  ugtk_category_form_init (UgtkCategoryForm* cform)
 	gtk_grid_attach (grid, label, 0, 2, 1, 1);
 	gtk_grid_attach (grid, cform->spin_recycled, 1, 2, 1, 1);
 
+	cform->spin_speed = gtk_spin_button_new_with_range (0.0, 99999999.0, 1.0);
+	gtk_entry_set_activates_default (GTK_ENTRY (cform->spin_speed), TRUE);
+	label = gtk_label_new_with_mnemonic (_("Speed limit (KiB/s):"));
+	gtk_label_set_mnemonic_widget (GTK_LABEL(label), cform->spin_speed);
+	g_object_set (label, "margin", 2, NULL);
+	g_object_set (cform->spin_speed, "margin-top", 2, "margin-bottom", 2, NULL);
+	gtk_grid_attach (grid, label, 0, 3, 1, 1);
+	gtk_grid_attach (grid, cform->spin_speed, 1, 3, 1, 1);
+
 	// ------------------------------------------------------------------------
 	// URI Matching conditions
 	widget = gtk_frame_new (_("URI Matching conditions"));
@@ -172,6 +181,9 @@ void  ugtk_category_form_get (UgtkCategoryForm* cform, UgInfo* cnode_info)
 	// Recycled
 	category->recycled_limit = gtk_spin_button_get_value_as_int (
 			(GtkSpinButton*) cform->spin_recycled);
+	// Speed limit
+	category->speed_limit = gtk_spin_button_get_value_as_int (
+			(GtkSpinButton*) cform->spin_speed) * 1024;
 
 	// matching - clear
 	ug_array_foreach_str (&category->hosts, (UgForeachFunc) ug_free, NULL);
@@ -209,6 +221,9 @@ void  ugtk_category_form_set (UgtkCategoryForm* cform, UgInfo* cnode_info)
 	// Recycled
 	gtk_spin_button_set_value ((GtkSpinButton*) cform->spin_recycled,
 			(gdouble) category->recycled_limit);
+	// Speed limit
+	gtk_spin_button_set_value ((GtkSpinButton*) cform->spin_speed,
+			(gdouble) (category->speed_limit / 1024));
 
 	// matching
 	str = string_from_ug_array (&category->hosts);
@@ -57,6 +57,7 @@ struct UgtkCategoryForm
 	GtkWidget*	spin_active;
 	GtkWidget*	spin_finished;
 	GtkWidget*	spin_recycled;
+	GtkWidget*	spin_speed;     // download speed limit of category
 
 	GtkWidget*  hosts_label;
 	GtkWidget*  hosts_entry;
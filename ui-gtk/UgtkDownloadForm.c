@@ -70,6 +70,9 @@ void  ugtk_download_form_init (UgtkDownloadForm* dform, UgtkProxyForm* proxy, Gt
 	dform->changed.retry    = FALSE;
 	dform->changed.delay    = FALSE;
 	dform->changed.timestamp= FALSE;
+	dform->changed.preallocate = FALSE;
+	dform->changed.output   = FALSE;
+	dform->changed.checksum = FALSE;
 	dform->parent = parent;
 
 	ugtk_download_form_init_page1 (dform, proxy);
@@ -445,6 +448,55 @@ static void ugtk_download_form_init_page2 (UgtkDownloadForm* dform)
 	g_object_set (widget, "margin-top", 3, "margin-bottom", 1, NULL);
 	gtk_grid_attach (grid, widget, 0, 7, 3, 1);
 	dform->timestamp = (GtkToggleButton*) widget;
+
+	// label - Preallocate disk space
+	widget = gtk_label_new (_("Preallocate:"));
+	g_object_set (widget, "margin-left", 2, "margin-right", 2, NULL);
+	g_object_set (widget, "margin-top", 1, "margin-bottom", 1, NULL);
+	gtk_grid_attach (grid, widget, 0, 8, 2, 1);
+	// combo - Preallocate disk space (UgetPreallocate)
+	widget = gtk_combo_box_text_new ();
+	gtk_combo_box_text_insert_text ((GtkComboBoxText*) widget,
+			UGET_PREALLOCATE_NONE, _("None"));
+	gtk_combo_box_text_insert_text ((GtkComboBoxText*) widget,
+			UGET_PREALLOCATE_SPARSE, _("Sparse file"));
+	gtk_combo_box_text_insert_text ((GtkComboBoxText*) widget,
+			UGET_PREALLOCATE_FULL, _("Full"));
+	g_object_set (widget, "margin", 1, NULL);
+	gtk_grid_attach (grid, widget, 2, 8, 1, 1);
+	dform->preallocate = (GtkComboBox*) widget;
+
+	// Checksum - entry
+	widget = gtk_entry_new ();
+	gtk_entry_set_activates_default (GTK_ENTRY (widget), TRUE);
+	gtk_entry_set_placeholder_text (GTK_ENTRY (widget), "sha-256=...");
+	g_object_set (widget, "margin", 1, "hexpand", TRUE, NULL);
+	gtk_grid_attach (grid, widget, 2, 9, 2, 1);
+	g_signal_connect (GTK_EDITABLE (widget), "changed",
+			G_CALLBACK (on_entry_changed), dform);
+	dform->checksum_entry = widget;
+	// Checksum - label
+	widget = gtk_label_new_with_mnemonic (_("Checksum:"));
+	gtk_label_set_mnemonic_widget (GTK_LABEL (widget), dform->checksum_entry);
+	g_object_set (widget, "margin-left", 2, "margin-right", 2, NULL);
+	g_object_set (widget, "margin-top", 1, "margin-bottom", 1, NULL);
+	gtk_grid_attach (grid, widget, 0, 9, 2, 1);
+	dform->checksum_label = widget;
+
+	// label - Output
+	widget = gtk_label_new (_("Output:"));
+	g_object_set (widget, "margin-left", 2, "margin-right", 2, NULL);
+	g_object_set (widget, "margin-top", 1, "margin-bottom", 1, NULL);
+	gtk_grid_attach (grid, widget, 0, 10, 2, 1);
+	// combo - Output (UgetOutput)
+	widget = gtk_combo_box_text_new ();
+	gtk_combo_box_text_insert_text ((GtkComboBoxText*) widget,
+			UGET_OUTPUT_DEFAULT, _("Default"));
+	gtk_combo_box_text_insert_text ((GtkComboBoxText*) widget,
+			UGET_OUTPUT_MMAP, _("Memory-mapped file"));
+	g_object_set (widget, "margin", 1, NULL);
+	gtk_grid_attach (grid, widget, 2, 10, 1, 1);
+	dform->output = (GtkComboBox*) widget;
 }
 
 void  ugtk_download_form_get (UgtkDownloadForm* dform, UgInfo* node_info)
@@ -495,6 +547,10 @@ void  ugtk_download_form_get (UgtkDownloadForm* dform, UgInfo* node_info)
 	temp.common->max_connections = number;
 	// timestamp
 	temp.common->timestamp = gtk_toggle_button_get_active (dform->timestamp);
+	// preallocate
+	temp.common->preallocate = gtk_combo_box_get_active (dform->preallocate);
+	// output
+	temp.common->output = gtk_combo_box_get_active (dform->output);
 
 	// URI
 	if (gtk_widget_is_sensitive (dform->uri_entry) == TRUE) {
@@ -537,6 +593,13 @@ void  ugtk_download_form_get (UgtkDownloadForm* dform, UgInfo* node_info)
 		temp.common->file = (*text) ? ug_strdup (text) : NULL;
 		ug_str_remove_crlf (temp.common->file, temp.common->file);
 	}
+	// checksum
+	if (gtk_widget_is_sensitive (dform->checksum_entry) == TRUE) {
+		text = gtk_entry_get_text ((GtkEntry*)dform->checksum_entry);
+		ug_free (temp.common->checksum);
+		temp.common->checksum = (*text) ? ug_strdup (text) : NULL;
+		ug_str_remove_crlf (temp.common->checksum, temp.common->checksum);
+	}
 
 	// ------------------------------------------
 	// UgetHttp
@@ -599,6 +662,9 @@ void  ugtk_download_form_set (UgtkDownloadForm* dform, UgInfo* node_info, gboole
 		dform->changed.max_upload_speed   = common->keeping.max_upload_speed;
 		dform->changed.max_download_speed = common->keeping.max_download_speed;
 		dform->changed.timestamp = common->keeping.timestamp;
+		dform->changed.preallocate = common->keeping.preallocate;
+		dform->changed.output = common->keeping.output;
+		dform->changed.checksum = common->keeping.checksum;
 	}
 	// set data
 	if (keep_changed==FALSE || dform->changed.uri==FALSE) {
@@ -662,6 +728,16 @@ void  ugtk_download_form_set (UgtkDownloadForm* dform, UgInfo* node_info, gboole
 	}
 	if (keep_changed==FALSE || dform->changed.timestamp==FALSE)
 		gtk_toggle_button_set_active (dform->timestamp, common->timestamp);
+	if (keep_changed==FALSE || dform->changed.preallocate==FALSE)
+		gtk_combo_box_set_active (dform->preallocate, common->preallocate);
+	if (keep_changed==FALSE || dform->changed.output==FALSE)
+		gtk_combo_box_set_active (dform->output, common->output);
+	if (keep_changed==FALSE || dform->changed.checksum==FALSE) {
+		if (gtk_widget_is_sensitive (dform->checksum_entry)) {
+			gtk_entry_set_text ((GtkEntry*) dform->checksum_entry,
+					(common->checksum) ? common->checksum : "");
+		}
+	}
 
 	// ------------------------------------------
 	// UgetHttp
@@ -717,6 +793,8 @@ void  ugtk_download_form_set_multiple (UgtkDownloadForm* dform, gboolean multipl
 		gtk_widget_hide (dform->mirrors_entry);
 		gtk_widget_hide (dform->file_label);
 		gtk_widget_hide (dform->file_entry);
+		gtk_widget_hide (dform->checksum_label);
+		gtk_widget_hide (dform->checksum_entry);
 	}
 	else {
 		gtk_widget_show (dform->uri_label);
@@ -725,6 +803,8 @@ void  ugtk_download_form_set_multiple (UgtkDownloadForm* dform, gboolean multipl
 		gtk_widget_show (dform->mirrors_entry);
 		gtk_widget_show (dform->file_label);
 		gtk_widget_show (dform->file_entry);
+		gtk_widget_show (dform->checksum_label);
+		gtk_widget_show (dform->checksum_entry);
 	}
 
 	multiple_mode = !multiple_mode;
@@ -734,6 +814,8 @@ void  ugtk_download_form_set_multiple (UgtkDownloadForm* dform, gboolean multipl
 	gtk_widget_set_sensitive (dform->mirrors_entry, multiple_mode);
 	gtk_widget_set_sensitive (dform->file_label, multiple_mode);
 	gtk_widget_set_sensitive (dform->file_entry, multiple_mode);
+	gtk_widget_set_sensitive (dform->checksum_label, multiple_mode);
+	gtk_widget_set_sensitive (dform->checksum_entry, multiple_mode);
 }
 
 void  ugtk_download_form_set_folders (UgtkDownloadForm* dform, UgtkSetting* setting)
@@ -848,6 +930,8 @@ static void on_entry_changed (GtkEditable* editable, UgtkDownloadForm* dform)
 			dform->changed.user = TRUE;
 		else if (editable == GTK_EDITABLE (dform->password_entry))
 			dform->changed.password = TRUE;
+		else if (editable == GTK_EDITABLE (dform->checksum_entry))
+			dform->changed.checksum = TRUE;
 	}
 }
 
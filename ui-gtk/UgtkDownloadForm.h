@@ -113,6 +113,11 @@ struct UgtkDownloadForm
 	GtkWidget*  spin_delay;		// seconds
 
 	GtkToggleButton*  timestamp;
+	GtkComboBox*      preallocate;    // UgetPreallocate
+	GtkComboBox*      output;         // UgetOutput
+
+	GtkWidget*  checksum_label;
+	GtkWidget*  checksum_entry;     // UgetCommon::checksum
 
 	// ----------------------------------------------------
 	// User changed entry
@@ -136,6 +141,9 @@ struct UgtkDownloadForm
 		gboolean  max_upload_speed:1;   // spin_upload_speed
 		gboolean  max_download_speed:1; // spin_download_speed
 		gboolean  timestamp:1;
+		gboolean  preallocate:1;
+		gboolean  output:1;
+		gboolean  checksum:1;
 	} changed;
 
 	gboolean  completed:1;
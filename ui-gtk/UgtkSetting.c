@@ -38,6 +38,7 @@
 #include <UgString.h>
 #include <UgJsonFile.h>
 #include <UgetMedia.h>
+#include <UgetPluginCurl.h>
 #include <UgtkSetting.h>
 #include <UgtkNodeView.h>
 
@@ -270,6 +271,18 @@ static const UgEntry  UgtkBandwidthSettingEntry[] =
 	{NULL},    // null-terminated
 };
 
+// ----------------------------------------------------------------------------
+// ConnectionSetting
+
+static const UgEntry  UgtkConnectionSettingEntry[] =
+{
+	{"PerHost",           offsetof (struct UgtkConnectionSetting, per_host),
+			UG_ENTRY_INT, NULL, NULL},
+	{"Total",             offsetof (struct UgtkConnectionSetting, total),
+			UG_ENTRY_INT, NULL, NULL},
+	{NULL},    // null-terminated
+};
+
 // ----------------------------------------------------------------------------
 // SchedulerSetting
 
@@ -318,6 +331,26 @@ static const UgEntry  UgtkPluginAria2SettingEntry[] =
 	{NULL},    // null-terminated
 };
 
+// ----------------------------------------------------------------------------
+// PluginCurlSetting
+
+static const UgEntry  UgtkPluginCurlSettingEntry[] =
+{
+	{"engine",    offsetof (struct UgtkPluginCurlSetting, engine),
+			UG_ENTRY_INT,  NULL,   NULL},
+	{"buffer-size",  offsetof (struct UgtkPluginCurlSetting, buffer_size),
+			UG_ENTRY_INT,  NULL,   NULL},
+	{"split",     offsetof (struct UgtkPluginCurlSetting, split),
+			UG_ENTRY_INT,  NULL,   NULL},
+	{"control",   offsetof (struct UgtkPluginCurlSetting, control),
+			UG_ENTRY_INT,  NULL,   NULL},
+	{"save-interval",  offsetof (struct UgtkPluginCurlSetting, save_interval),
+			UG_ENTRY_INT,  NULL,   NULL},
+	{"output",    offsetof (struct UgtkPluginCurlSetting, output),
+			UG_ENTRY_INT,  NULL,   NULL},
+	{NULL},    // null-terminated
+};
+
 // ----------------------------------------------------------------------------
 // PluginMediaSetting
 
@@ -365,6 +398,8 @@ static const UgEntry  UgtkSettingEntry[] =
 			UG_ENTRY_OBJECT, (void*) UgtkClipboardSettingEntry,   NULL},
 	{"Bandwidth",       offsetof (UgtkSetting, bandwidth),
 			UG_ENTRY_OBJECT, (void*) UgtkBandwidthSettingEntry,  NULL},
+	{"Connection",      offsetof (UgtkSetting, connection),
+			UG_ENTRY_OBJECT, (void*) UgtkConnectionSettingEntry, NULL},
 	{"Commandline",     offsetof (UgtkSetting, commandline),
 			UG_ENTRY_OBJECT, (void*) UgtkCommandlineSettingEntry, NULL},
 
@@ -372,6 +407,8 @@ static const UgEntry  UgtkSettingEntry[] =
 			UG_ENTRY_INT,    NULL, NULL},
 	{"PluginAria2",     offsetof (UgtkSetting, aria2),
 			UG_ENTRY_OBJECT, (void*) UgtkPluginAria2SettingEntry, NULL},
+	{"PluginCurl",      offsetof (UgtkSetting, curl),
+			UG_ENTRY_OBJECT, (void*) UgtkPluginCurlSettingEntry, NULL},
 	{"PluginMedia",     offsetof (UgtkSetting, media),
 			UG_ENTRY_OBJECT, (void*) UgtkPluginMediaSettingEntry, NULL},
 
@@ -486,6 +523,10 @@ void  ugtk_setting_reset (UgtkSetting* setting)
 	setting->bandwidth.scheduler.upload = 0;
 	setting->bandwidth.scheduler.download = 0;
 
+	// "ConnectionSetting"
+	setting->connection.per_host = 16;
+	setting->connection.total = 0;
+
 	// "SchedulerSetting"
 	setting->scheduler.enable = FALSE;
 	ug_array_init (&setting->scheduler.state, sizeof (int), 7*24);
@@ -511,6 +552,13 @@ void  ugtk_setting_reset (UgtkSetting* setting)
 	setting->aria2.path = ug_strdup (UGTK_ARIA2_PATH);
 	setting->aria2.args = ug_strdup (UGTK_ARIA2_ARGS);
 	setting->aria2.uri  = ug_strdup (UGTK_ARIA2_URI);
+	// curl plug-in settings
+	setting->curl.engine = -1;
+	setting->curl.buffer_size = 0;
+	setting->curl.split = UGET_PLUGIN_CURL_SPLIT_THROUGHPUT;
+	setting->curl.control = UGET_PLUGIN_CURL_CONTROL_REWRITE;
+	setting->curl.save_interval = 2000;
+	setting->curl.output = UGET_PLUGIN_CURL_OUTPUT_PWRITE;
 	// media plug-in settings
 	setting->media.match_mode = UGET_MEDIA_MATCH_NEAR;
 	setting->media.quality = UGET_MEDIA_QUALITY_360P;
@@ -195,6 +195,13 @@ struct UgtkSetting
 		} normal, scheduler;
 	} bandwidth;
 
+	// "ConnectionSetting" - connection budget of all downloads, 0 = unlimited
+	struct UgtkConnectionSetting
+	{
+		int     per_host;      // connections to each host
+		int     total;         // connections to all hosts
+	} connection;
+
 	// "SchedulerSetting"
 	struct UgtkSchedulerSetting
 	{
@@ -228,6 +235,23 @@ struct UgtkSetting
 		char*  uri;
 	} aria2;
 
+	// UgetPluginCurl option
+	struct UgtkPluginCurlSetting {
+		// number of curl_multi threads, 0 = one thread per segment,
+		// -1 = number of processors
+		int    engine;
+		// receive buffer size (KiB) of each segment, 0 = libcurl default
+		int    buffer_size;
+		// policy of splitting segments, UgetPluginCurlSplit
+		int    split;
+		// how to save aria2 control file, UgetPluginCurlControl
+		int    control;
+		// interval (milliseconds) of saving aria2 control file
+		int    save_interval;
+		// how to write downloaded data, UgetPluginCurlOutput
+		int    output;
+	} curl;
+
 	// UgetPluginMedia option
 	struct UgtkPluginMediaSetting {
 		int    match_mode;